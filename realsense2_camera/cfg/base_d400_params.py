@@ -42,4 +42,14 @@ def add_base_params(gen, prefix):
                                               gen.const("ValidIn2Of8",                     int_t,  4,  "Valid In 2 Of 8"),
                                               gen.const("ValidIn1Oflast2",                 int_t,  5,  "Valid In 1 Of last2"),
                                               gen.const("ValidIn1Oflast5",                 int_t,  6,  "Valid in 1 Of last5")], "Temporal Filter Holes Fill")
-  gen.add(str(prefix) + "temporal_filter_holes_fill",              int_t,    19, "Temporal Filter Holes Fill",       3,       0,    6, edit_method=temporal_filter_holes_fill_enum)
\ No newline at end of file
+  gen.add(str(prefix) + "temporal_filter_holes_fill",              int_t,    19, "Temporal Filter Holes Fill",       3,       0,    6, edit_method=temporal_filter_holes_fill_enum)
+  gen.add(str(prefix) + "enable_decimation_filter",                bool_t,   20, "Enable Decimation Filter",           True)
+  gen.add(str(prefix) + "decimation_filter_magnitude",             int_t,    21, "Decimation Filter Magnitude",      2,      1,     8)
+  gen.add(str(prefix) + "enable_threshold_filter",                 bool_t,   22, "Enable Threshold Filter",            True)
+  gen.add(str(prefix) + "threshold_filter_min_distance",           double_t, 23, "Threshold Filter Min Distance",    0.1,    0.0,   16.0)
+  gen.add(str(prefix) + "threshold_filter_max_distance",           double_t, 24, "Threshold Filter Max Distance",    0.0,    0.0,   16.0)
+  gen.add(str(prefix) + "enable_hole_filling_filter",              bool_t,   25, "Enable Hole Filling Filter",         True)
+  hole_filling_filter_mode_enum = gen.enum([gen.const("FillFromLeft",        int_t,  0,  "Fill From Left"),
+                                            gen.const("FarestFromAround",    int_t,  1,  "Farest From Around"),
+                                            gen.const("NearestFromAround",   int_t,  2,  "Nearest From Around")], "Hole Filling Filter Mode")
+  gen.add(str(prefix) + "hole_filling_filter_mode",                int_t,    26, "Hole Filling Filter Mode",         1,       0,    2, edit_method=hole_filling_filter_mode_enum)
@@ -0,0 +1,40 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2018 Intel Corporation. All Rights Reserved
+
+#ifndef REALSENSE2_CAMERA_COLOR_SAMPLING_H
+#define REALSENSE2_CAMERA_COLOR_SAMPLING_H
+
+#include <cstddef>
+#include <cstdint>
+
+#include <librealsense2/rs.hpp>
+
+namespace realsense2_camera
+{
+    // Packed PointCloud2 "rgb" (0x00rrggbb) of points that fall outside the color image.
+    // Same shade of blue librealsense uses, so holes are easy to tell apart.
+    const uint32_t OUT_OF_BOUNDS_RGB = (96 << 16) | (157 << 8) | 198;
+
+    /**
+    Projects depth points into the color image: transform by depth_to_color, then
+    rs2_project_point_to_pixel, with identical results.
+    Points are point_step (at least 4) floats apart with x, y, z at offsets 0, 1, 2.
+    Pixel coordinates go to u and v.
+    Runs 8 points at a time on AVX2 (4 on SSE4.2) for pinhole and modified Brown-Conrady color
+    intrinsics, and falls back to librealsense otherwise.
+    */
+    void projectToColor(const rs2_extrinsics& depth_to_color, const rs2_intrinsics& color_intrin,
+                        const float* points, int point_step, int count, float* u, float* v);
+
+    /**
+    Looks up the RGB8 color at (u, v) and stores it as one packed "rgb" uint32, out_step bytes apart.
+    Nearest sampling truncates the coordinates. Bilinear sampling treats integer coordinates as
+    pixel centers and clamps to the image edge. Points outside the image get OUT_OF_BOUNDS_RGB.
+    Uses AVX2 gathers when available.
+    */
+    void sampleColor(const rs2_intrinsics& color_intrin, const uint8_t* color_data,
+                     const float* u, const float* v, int count, bool bilinear,
+                     uint8_t* out, size_t out_step);
+}  // namespace realsense2_camera
+
+#endif  // REALSENSE2_CAMERA_COLOR_SAMPLING_H
@@ -35,9 +35,40 @@ namespace realsense2_camera
 
     const bool ALIGN_DEPTH    = false;
     const bool POINTCLOUD     = false;
+    const bool POINTCLOUD_ORGANIZED = true;   // false publishes only the valid points, as a single row
+    const int POINTCLOUD_STRIDE     = 1;      // Deproject every n-th pixel of every n-th row
+    const double POINTCLOUD_VOXEL_LEAF = 0.0; // Voxel grid leaf size in meters, 0 disables downsampling
+    const double POINTCLOUD_MIN_Z   = 0.0;    // Meters
+    const double POINTCLOUD_MAX_Z   = 0.0;    // Meters, 0 means no limit
+    const int POINTCLOUD_ROI_X      = 0;      // Depth pixel rectangle of the point clouds
+    const int POINTCLOUD_ROI_Y      = 0;
+    const int POINTCLOUD_ROI_WIDTH  = 0;      // 0 extends it to the image edge
+    const int POINTCLOUD_ROI_HEIGHT = 0;
+    const bool POINTCLOUD_BILINEAR_COLOR = false;  // Interpolate the color of depth/color/points
+    const std::string POINTCLOUD_FRAME_ID = "";    // Empty publishes the clouds in the depth optical frame
+    const bool POINTCLOUD_NORMALS   = false;  // Publish depth/points_normals
+    const int POINTCLOUD_NORMALS_WINDOW = 7;  // Side of the normal estimation window, in points
+    const bool POINTCLOUD_INTENSITY = false;  // Publish depth/points_intensity, needs INFRA1
+    const bool ALIGN_DEPTH_ZBUFFER  = true;   // Nearest depth wins in aligned images, false for last in row order
+    const double ALIGN_DEPTH_OUTPUT_SCALE = 1.0;  // Size of the aligned depth images relative to their target stream
+    const std::string FILTERS = "disparity,spatial,temporal";  // Depth post-processing chain, in order
     const bool SYNC_FRAMES    = false;
     const bool USE_ROS_TIME   = false;
 
+    const int PIPELINE_QUEUE_SIZE = 2;
+    const int PUBLISH_RING_SIZE   = 2;
+    const int MESSAGE_POOL_SIZE   = 4;   // Messages kept per publisher for reuse, 0 allocates every message
+    const int WORKER_THREADS      = 0;   // Threads splitting per-frame work, 0 means one per core
+    const int POINTCLOUD_TILE_ROWS = 16; // Rows per point cloud work item
+    const bool GOVERNOR           = false;  // Degrade processing to hold the depth frame rate
+    const std::string GOVERNOR_LADDER = "temporal,spatial,pointcloud_stride,align_every_other";
+    const double GOVERNOR_HIGH_LOAD = 0.9;  // Slowest stage time over the frame period that takes a step
+    const double GOVERNOR_LOW_LOAD  = 0.6;  // And that gives it back
+
+    const std::string DEFAULT_DROP_POLICY = "drop_oldest";
+    const double DEFAULT_DROP_TIMEOUT_MS  = 0.0;  // 0 waits MAX_DROP_TIMEOUT_PERIODS
+    const double MAX_DROP_TIMEOUT_PERIODS = 0.5;  // Longest block wait on the capture thread without a warning, in frame periods
+
     const int DEPTH_WIDTH     = 640;
     const int DEPTH_HEIGHT    = 480;
 
@@ -94,6 +125,36 @@ namespace realsense2_camera
     const std::string DEFAULT_ALIGNED_DEPTH_TO_FISHEYE_FRAME_ID = "camera_aligned_depth_to_fisheye_frame";
 
     using stream_index_pair = std::pair<rs2_stream, int>;
+
+    // Dense index of the supported streams, used to address per-stream state without map lookups
+    enum stream_id
+    {
+        DEPTH_ID,
+        INFRA1_ID,
+        INFRA2_ID,
+        COLOR_ID,
+        FISHEYE_ID,
+        GYRO_ID,
+        ACCEL_ID,
+        STREAM_COUNT,
+        INVALID_STREAM_ID = STREAM_COUNT
+    };
+
+    constexpr int streamId(rs2_stream stream_type, int stream_index)
+    {
+        return (RS2_STREAM_DEPTH == stream_type)    ? DEPTH_ID :
+               (RS2_STREAM_INFRARED == stream_type) ? ((1 == stream_index) ? INFRA1_ID :
+                                                       (2 == stream_index) ? INFRA2_ID : INVALID_STREAM_ID) :
+               (RS2_STREAM_COLOR == stream_type)    ? COLOR_ID :
+               (RS2_STREAM_FISHEYE == stream_type)  ? FISHEYE_ID :
+               (RS2_STREAM_GYRO == stream_type)     ? GYRO_ID :
+               (RS2_STREAM_ACCEL == stream_type)    ? ACCEL_ID : INVALID_STREAM_ID;
+    }
+
+    constexpr int streamId(const stream_index_pair& stream)
+    {
+        return streamId(stream.first, stream.second);
+    }
 }  // namespace realsense2_camera
 
 #endif  // REALSENSE2_CAMERA_CONSTANTS_H
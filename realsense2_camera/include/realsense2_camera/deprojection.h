@@ -0,0 +1,104 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2018 Intel Corporation. All Rights Reserved
+
+#ifndef REALSENSE2_CAMERA_DEPROJECTION_H
+#define REALSENSE2_CAMERA_DEPROJECTION_H
+
+#include <cstdint>
+#include <vector>
+
+#include <librealsense2/rs.hpp>
+
+namespace realsense2_camera
+{
+    /**
+    Unit depth rays of every pixel of a stream, with the distortion model already applied:
+    pixel (x, y) at depth d deprojects to (d * ray_x, d * ray_y, d), exactly as
+    rs2_deproject_pixel_to_point computes it. Intrinsics only change with the stream profile,
+    so the table is built once and deprojection becomes a multiply by depth.
+    Built with a rigid transform, the rays are stored already rotated, with a z plane, and points
+    come out as d * ray + translation: moving the cloud to another frame costs one add per coordinate.
+    The components are kept in separate planes so they load straight into vectors.
+    */
+    class RayTable
+    {
+    public:
+        RayTable() : _intrin(), _transform(), _transformed(false) {}
+
+        // Rebuilds the table when the intrinsics or the transform (null for none) differ from the
+        // ones it was built for. Returns true if it was rebuilt.
+        bool update(const rs2_intrinsics& intrin, const rs2_extrinsics* transform = nullptr);
+
+        bool empty() const { return _ray_x.empty(); }
+        bool transformed() const { return _transformed; }
+        const rs2_intrinsics& intrinsics() const { return _intrin; }
+        const rs2_extrinsics& transform() const { return _transform; }
+        const float* rowX(int y) const { return _ray_x.data() + y * _intrin.width; }
+        const float* rowY(int y) const { return _ray_y.data() + y * _intrin.width; }
+        const float* rowZ(int y) const { return _ray_z.data() + y * _intrin.width; }
+
+    private:
+        rs2_intrinsics _intrin;
+        rs2_extrinsics _transform;
+        bool _transformed;
+        std::vector<float> _ray_x;
+        std::vector<float> _ray_y;
+        std::vector<float> _ray_z;   // Empty without a transform
+    };
+
+    struct DeprojectionParams
+    {
+        float depth_scale;   // Meters per depth unit
+        float min_z;         // Pixels whose depth is outside [min_z, max_z] are invalid, whatever the transform
+        float max_z;
+        int x_begin;         // Columns [x_begin, x_end) of the row are deprojected, the rest cost nothing
+        int x_end;
+        int y_begin;         // Rows the caller walks, not used by deprojectDepthRow
+        int y_end;
+        int stride;          // Deproject every stride-th pixel of the range, starting with the first
+        bool compact;        // Write only valid points, back to back, instead of one (maybe zero) point per pixel
+    };
+
+    // Whether deprojectDepthRow makes a valid point of this depth pixel
+    inline bool validDepth(uint16_t raw, const DeprojectionParams& params)
+    {
+        float depth = static_cast<float>(raw) * params.depth_scale;
+        return depth > 0.f && depth >= params.min_z && depth <= params.max_z;
+    }
+
+    enum deprojection_kernel
+    {
+        DEPROJECTION_BEST,      // The fastest one the CPU runs
+        DEPROJECTION_SCALAR,
+        DEPROJECTION_SSE42,
+        DEPROJECTION_AVX2
+    };
+
+    /**
+    Converts one row of Z16 depth pixels into XYZ points, written straight into a PointCloud2 buffer.
+    Handles 8 (AVX2) or 4 (SSE4.2) pixels per iteration when the CPU supports it, picked once at
+    runtime, and plain scalar code otherwise or when striding. Tests and benchmarks may ask for
+    a given kernel instead, one the CPU doesn't run falls back to scalar code.
+    Points are in the frame of the ray table's transform, if any, otherwise in the optical frame.
+    They are point_step floats apart with x, y, z at offsets 0, 1, 2; the vector paths also zero
+    offset 3, which is padding in the clouds published by the node. Invalid pixels (no depth or
+    out of the depth range) become (0, 0, 0) or are skipped when compacting. A compacting call may
+    scribble over the records following the points it returns, up to the width of the column range.
+    Returns the number of points written.
+    */
+    int deprojectDepthRow(const RayTable& rays, int y, const uint16_t* depth_row,
+                          const DeprojectionParams& params, float* out, int point_step,
+                          deprojection_kernel kernel = DEPROJECTION_BEST);
+
+    // Rigid transform helpers, with the rs2_transform_point_to_point conventions
+    rs2_extrinsics inverseExtrinsics(const rs2_extrinsics& a_to_b);
+    rs2_extrinsics composeExtrinsics(const rs2_extrinsics& a_to_b, const rs2_extrinsics& b_to_c);
+
+    // Whether this CPU runs the kernel
+    bool deprojectionKernelSupported(deprojection_kernel kernel);
+
+    // Name of the instruction set the kernel uses, the best one names what this CPU runs
+    const char* deprojectionKernelName(deprojection_kernel kernel = DEPROJECTION_BEST);
+}  // namespace realsense2_camera
+
+#endif  // REALSENSE2_CAMERA_DEPROJECTION_H
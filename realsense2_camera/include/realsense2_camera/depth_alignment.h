@@ -0,0 +1,112 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2018 Intel Corporation. All Rights Reserved
+
+#ifndef REALSENSE2_CAMERA_DEPTH_ALIGNMENT_H
+#define REALSENSE2_CAMERA_DEPTH_ALIGNMENT_H
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include <librealsense2/rs.hpp>
+
+#include <realsense2_camera/worker_pool.h>
+
+namespace realsense2_camera
+{
+    /**
+    Aligns Z16 depth images to other cameras. Every depth pixel is spread over the rectangle
+    between the projections of its top-left and bottom-right corners, in millimeters, like
+    librealsense's align does.
+    Deprojection is linear in depth, so the unit rays of all pixel corners are computed once per
+    depth calibration and shared by all targets. One pass over row tiles serves every target: each
+    depth row is read, and its rays loaded, once for all of them while they are in cache, then
+    transformed and projected per target. Both corners of 8 (AVX2) or 4 (SSE4.2) pixels are
+    projected together when the target is pinhole or modified Brown-Conrady, other models go
+    through librealsense. The arithmetic follows librealsense's order, so the result is the same.
+    Output buffers are only cleared on the rows the previous image written to them covered.
+
+    The same pass can resample a target image onto the depth grid, the other way round: every
+    depth pixel takes the target pixel at the bottom-right end of its rectangle, which is what
+    librealsense's align to depth keeps, and pixels without depth or out of the target are zero.
+    RGB8 images are gathered 8 pixels at a time on AVX2. The same pixels can also come out as
+    packed point cloud "rgb", for coloring points by the depth pixel they come from.
+
+    Neighboring depth pixels often cover the same target pixels. With the z-buffer on, the nearest
+    depth wins, so the output is the same whatever the number of threads: row tiles are projected
+    in parallel, then written in parallel, with an atomic minimum on the target rows that more than
+    one tile covers. Without it the last pixel in row order wins, as librealsense does, which needs
+    the rows to run in order on a single thread.
+    */
+    class DepthAligner
+    {
+    public:
+        // One camera depth is aligned to
+        struct Target
+        {
+            rs2_intrinsics intrinsics;
+            rs2_extrinsics depth_to_other;
+            std::vector<uint8_t>* out;         // Resized to a Z16 image of the target, nullptr for none
+            const uint8_t* image;              // Target image to resample onto the depth grid, or nullptr
+            int image_bpp;                     // Its bytes per pixel
+            std::vector<uint8_t>* image_out;   // Resized to the depth resolution, nullptr for none
+            // RGB8 images only: resized to the depth resolution, packed 0x00rrggbb of the pixel each depth
+            // pixel takes and OUT_OF_BOUNDS_RGB where it takes none, or nullptr
+            std::vector<uint32_t>* rgb_out;
+        };
+
+        DepthAligner() : _depth_intrin() {}
+
+        /**
+        Aligns a depth image of depth_intrin to all targets at once, and resamples the target
+        images that are given. Row tiles run on the pool when z_buffer is set. Outputs may be
+        buffers this aligner filled before, they are then only cleared where needed.
+        */
+        void align(const rs2_intrinsics& depth_intrin, const uint16_t* depth, float depth_scale, bool z_buffer,
+                   const std::vector<Target>& targets, WorkerPool& pool);
+
+    private:
+        struct Rows
+        {
+            int first;
+            int last;   // Empty when last < first
+        };
+
+        // Where the pixels of one row tile land in one target, x0 is -1 where nothing is written
+        struct Corners
+        {
+            std::vector<int32_t> x0, y0, x1, y1;
+            Rows touched;
+        };
+
+        // Scratch of one row tile, one entry per target
+        typedef std::vector<Corners> Tile;
+
+        // Rebuilds the corner rays when the depth calibration changed
+        void update(const rs2_intrinsics& depth_intrin);
+
+        void projectRows(int y_begin, int y_end, const uint16_t* depth, float depth_scale,
+                         const std::vector<Target>& targets, Tile& tile) const;
+
+        // shared_rows counts the tiles writing to each row of each target, rows written by more than
+        // one use atomics; nullptr when tiles run one after another
+        void writeRows(int y_begin, int y_end, const uint16_t* depth, float depth_scale, bool z_buffer,
+                       const std::vector<Target>& targets, const std::vector<int>* shared_rows, const Tile& tile) const;
+
+        rs2_intrinsics _depth_intrin;
+        // Unit rays of the (width + 1) x (height + 1) pixel corners, z is 1
+        std::vector<float> _corner_x;
+        std::vector<float> _corner_y;
+        std::vector<Tile> _tiles;
+        std::vector<std::vector<int>> _shared_rows;
+        std::vector<Rows> _touched;    // Per target, by the image being aligned
+        // Bytes written in each output buffer, so buffers can move between targets of any size
+        std::unordered_map<const uint8_t*, std::pair<size_t, size_t>> _dirty_bytes;
+    };
+
+    // Intrinsics of the same camera with width and height scaled and rounded; focal lengths and
+    // principal point follow the actual scale of each axis, with pixel centers kept aligned
+    rs2_intrinsics scaleIntrinsics(const rs2_intrinsics& intrin, double scale);
+}  // namespace realsense2_camera
+
+#endif  // REALSENSE2_CAMERA_DEPTH_ALIGNMENT_H
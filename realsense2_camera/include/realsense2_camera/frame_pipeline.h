@@ -0,0 +1,238 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2018 Intel Corporation. All Rights Reserved
+
+#ifndef REALSENSE2_CAMERA_FRAME_PIPELINE_H
+#define REALSENSE2_CAMERA_FRAME_PIPELINE_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace realsense2_camera
+{
+    // What to do with a frame when the consumer of its queue can't keep up
+    enum drop_policy
+    {
+        LATEST_ONLY,         // Keep only the freshest frame
+        DROP_OLDEST,         // Keep up to queue size frames, discarding the oldest
+        BLOCK_WITH_TIMEOUT,  // Wait for room up to a timeout, then discard the oldest
+        DROP_POLICY_COUNT
+    };
+
+    /**
+    Bounded FIFO shared between two pipeline stages.
+    push() blocks while the queue is full, so a slow stage throttles the one feeding it.
+    The policy overload is meant for the librealsense callback thread and returns
+    the number of queued items discarded to make room.
+    Items live in a ring allocated once, so steady state pushes and pops don't allocate.
+    */
+    template<class T>
+    class BoundedQueue
+    {
+    public:
+        explicit BoundedQueue(size_t capacity) :
+            _capacity(std::max<size_t>(capacity, 1)),
+            _closed(false),
+            _items(_capacity),
+            _head(0),
+            _count(0) {}
+
+        bool push(T&& item)
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _not_full.wait(lock, [this]{ return _closed || _count < _capacity; });
+            if (_closed)
+                return false;
+
+            pushBack(std::move(item));
+            _not_empty.notify_one();
+            return true;
+        }
+
+        // Discarded items are handed to on_drop so their buffers can be reused
+        template<class OnDrop>
+        size_t push(T&& item, drop_policy policy, std::chrono::microseconds timeout, OnDrop on_drop)
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            if (BLOCK_WITH_TIMEOUT == policy)
+                _not_full.wait_for(lock, timeout, [this]{ return _closed || _count < _capacity; });
+            if (_closed)
+                return 0;
+
+            size_t dropped = 0;
+            auto capacity = (LATEST_ONLY == policy) ? 1 : _capacity;
+            while (_count >= capacity)
+            {
+                T oldest;
+                popFront(oldest);
+                on_drop(std::move(oldest));
+                ++dropped;
+            }
+            pushBack(std::move(item));
+            _not_empty.notify_one();
+            return dropped;
+        }
+
+        // Blocks until an item is available. Returns false once the queue is closed and drained.
+        bool pop(T& item)
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _not_empty.wait(lock, [this]{ return _closed || _count > 0; });
+            if (0 == _count)
+                return false;
+
+            popFront(item);
+            _not_full.notify_one();
+            return true;
+        }
+
+        void close()
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _closed = true;
+            _not_empty.notify_all();
+            _not_full.notify_all();
+        }
+
+    private:
+        void pushBack(T&& item)
+        {
+            _items[(_head + _count) % _capacity] = std::move(item);
+            ++_count;
+        }
+
+        void popFront(T& item)
+        {
+            item = std::move(_items[_head]);
+            _head = (_head + 1) % _capacity;
+            --_count;
+        }
+
+        const size_t _capacity;
+        bool _closed;
+        std::vector<T> _items;
+        size_t _head;
+        size_t _count;
+        std::mutex _mutex;
+        std::condition_variable _not_empty;
+        std::condition_variable _not_full;
+    };
+
+    /**
+    Chain of processing stages, each running on its own worker thread and connected
+    to the next one through a BoundedQueue. A job enters through enqueue() and visits
+    every stage in order; stages never run concurrently on the same job.
+    Finished and dropped jobs are clear()-ed and kept for acquire(), so the buffers
+    they own are reused instead of being reallocated for every frame.
+    */
+    template<class Job>
+    class StagedPipeline
+    {
+    public:
+        using Stage = std::function<void(Job&)>;
+
+        StagedPipeline() : _dropped(0), _free_capacity(0) {}
+        ~StagedPipeline() { stop(); }
+
+        void addStage(Stage stage)
+        {
+            _stages.push_back(stage);
+        }
+
+        void start(size_t queue_size)
+        {
+            // Jobs in flight: one per queue slot, one per worker and the one being filled by the producer
+            _free_capacity = _stages.size() * (queue_size + 1) + 1;
+            _free.reserve(_free_capacity);
+            for (size_t i = 0; i < _stages.size(); ++i)
+                _queues.emplace_back(new BoundedQueue<Job>(queue_size));
+
+            for (size_t i = 0; i < _stages.size(); ++i)
+                _workers.emplace_back(&StagedPipeline::run, this, i);
+        }
+
+        void stop()
+        {
+            for (auto& queue : _queues)
+                queue->close();
+            for (auto& worker : _workers)
+            {
+                if (worker.joinable())
+                    worker.join();
+            }
+            _workers.clear();
+            _queues.clear();
+        }
+
+        // Returns a recycled job if one is available, keeping the capacity of its buffers
+        Job acquire()
+        {
+            std::lock_guard<std::mutex> lock(_free_mutex);
+            if (_free.empty())
+                return Job();
+
+            Job job(std::move(_free.back()));
+            _free.pop_back();
+            return job;
+        }
+
+        // Only blocks under BLOCK_WITH_TIMEOUT, which holds up the caller: keep the timeout well within
+        // a frame period on the capture thread. Returns false if pending jobs were dropped to make room.
+        bool enqueue(Job&& job, drop_policy policy = DROP_OLDEST,
+                     std::chrono::microseconds timeout = std::chrono::microseconds(0))
+        {
+            if (_queues.empty())
+                return true;
+
+            auto dropped = _queues.front()->push(std::move(job), policy, timeout,
+                                                 [this](Job&& dropped_job){ recycle(std::move(dropped_job)); });
+            _dropped += dropped;
+            return (0 == dropped);
+        }
+
+        unsigned long long dropped() const { return _dropped; }
+
+    private:
+        void run(size_t index)
+        {
+            Job job;
+            while (_queues[index]->pop(job))
+            {
+                _stages[index](job);
+                if (index + 1 < _queues.size())
+                {
+                    if (!_queues[index + 1]->push(std::move(job)))
+                        break;
+                }
+                else
+                {
+                    recycle(std::move(job));
+                }
+            }
+        }
+
+        void recycle(Job&& job)
+        {
+            job.clear();
+            std::lock_guard<std::mutex> lock(_free_mutex);
+            if (_free.size() < _free_capacity)
+                _free.push_back(std::move(job));
+        }
+
+        std::vector<Stage> _stages;
+        std::vector<std::unique_ptr<BoundedQueue<Job>>> _queues;
+        std::vector<std::thread> _workers;
+        std::atomic<unsigned long long> _dropped;
+        std::vector<Job> _free;
+        size_t _free_capacity;
+        std::mutex _free_mutex;
+    };
+}  // namespace realsense2_camera
+
+#endif  // REALSENSE2_CAMERA_FRAME_PIPELINE_H
@@ -0,0 +1,194 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2018 Intel Corporation. All Rights Reserved
+
+#ifndef REALSENSE2_CAMERA_FRAME_RING_BUFFER_H
+#define REALSENSE2_CAMERA_FRAME_RING_BUFFER_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+
+#include <librealsense2/rs.hpp>
+#include <realsense2_camera/frame_pipeline.h>
+
+namespace realsense2_camera
+{
+    /**
+    Lock-free single-producer/single-consumer ring of rs2::frame handles.
+    Under LATEST_ONLY and DROP_OLDEST push() is wait-free and never blocks the capture
+    thread: when the ring is full the oldest unread frame is overwritten and released.
+    Under BLOCK_WITH_TIMEOUT the producer first waits for a free slot up to the timeout; the
+    consumer only takes a lock to wake it while it waits.
+    Every slot carries a sequence number (seqlock) so the consumer detects a slot that
+    was overwritten while reading it. Each frame travels with a caller supplied 64 bit stamp.
+    */
+    class FrameRingBuffer
+    {
+    public:
+        FrameRingBuffer(size_t depth, drop_policy policy = DROP_OLDEST,
+                        std::chrono::microseconds timeout = std::chrono::microseconds(0)) :
+            _depth((LATEST_ONLY == policy || 0 == depth) ? 1 : depth),
+            _policy(policy),
+            _timeout(timeout),
+            _slots(new Slot[_depth]),
+            _head(0),
+            _tail(0),
+            _overwritten(0),
+            _timed_out(0),
+            _waiting(false)
+        {
+            for (size_t i = 0; i < _depth; ++i)
+            {
+                _slots[i].seq = 0;
+                _slots[i].frame = nullptr;
+                _slots[i].stamp = 0;
+            }
+        }
+
+        ~FrameRingBuffer()
+        {
+            for (size_t i = 0; i < _depth; ++i)
+            {
+                auto frame = _slots[i].frame.exchange(nullptr);
+                if (frame)
+                    rs2_release_frame(frame);
+            }
+        }
+
+        FrameRingBuffer(const FrameRingBuffer&) = delete;
+        FrameRingBuffer& operator=(const FrameRingBuffer&) = delete;
+
+        // Producer side only
+        void push(const rs2::frame& f, uint64_t stamp)
+        {
+            auto raw = f.get();
+            rs2_error* e = nullptr;
+            rs2_frame_add_ref(raw, &e);
+            rs2::error::handle(e);
+
+            auto ticket = _tail.load(std::memory_order_relaxed);
+            if (BLOCK_WITH_TIMEOUT == _policy && ticket - _head.load(std::memory_order_acquire) >= _depth)
+                waitForRoom(ticket);
+
+            auto& slot = _slots[ticket % _depth];
+            slot.seq.store(2 * ticket + 1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+            slot.stamp.store(stamp, std::memory_order_relaxed);
+            auto old = slot.frame.exchange(raw, std::memory_order_acq_rel);
+            slot.seq.store(2 * ticket + 2, std::memory_order_release);
+            _tail.store(ticket + 1, std::memory_order_release);
+
+            if (old)
+            {
+                rs2_release_frame(old);
+                _overwritten.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+
+        // Consumer side only. Returns false when no unread frame is left.
+        bool pop(rs2::frame& f, uint64_t& stamp)
+        {
+            while (true)
+            {
+                auto tail = _tail.load(std::memory_order_acquire);
+                auto ticket = _head.load(std::memory_order_relaxed);
+                if (ticket == tail)
+                    return false;
+
+                // Tickets older than the ring depth were already overwritten (and accounted) by the producer
+                if (tail - ticket > _depth)
+                    ticket = tail - _depth;
+
+                auto& slot = _slots[ticket % _depth];
+                auto seq = slot.seq.load(std::memory_order_acquire);
+                if (seq != 2 * ticket + 2)
+                {
+                    advanceHead(ticket + 1);
+                    continue;
+                }
+
+                auto slot_stamp = slot.stamp.load(std::memory_order_relaxed);
+                auto raw = slot.frame.exchange(nullptr, std::memory_order_acq_rel);
+                std::atomic_thread_fence(std::memory_order_acquire);
+                bool torn = (slot.seq.load(std::memory_order_relaxed) != seq);
+
+                // Free the slot only after reading it, so a blocking producer never overwrites it mid-read
+                advanceHead(ticket + 1);
+                if (torn)
+                {
+                    // Overwritten while reading - the frame and stamp may not belong together, and
+                    // the frame may already be the producer's new one. Hand it back to the slot, the
+                    // producer releases it when it overwrites it and the newer ticket reads it otherwise.
+                    rs2_frame* empty = nullptr;
+                    if (raw && !slot.frame.compare_exchange_strong(empty, raw, std::memory_order_acq_rel))
+                    {
+                        rs2_release_frame(raw);
+                        _overwritten.fetch_add(1, std::memory_order_relaxed);
+                    }
+                    continue;
+                }
+                if (!raw)
+                    continue;
+
+                f = rs2::frame(raw);
+                stamp = slot_stamp;
+                return true;
+            }
+        }
+
+        drop_policy policy() const { return _policy; }
+
+        // Number of frames discarded because the consumer didn't keep up
+        uint64_t overwritten() const { return _overwritten.load(std::memory_order_relaxed); }
+
+        // Number of BLOCK_WITH_TIMEOUT pushes that gave up waiting for room
+        uint64_t timedOut() const { return _timed_out.load(std::memory_order_relaxed); }
+
+    private:
+        void waitForRoom(uint64_t ticket)
+        {
+            // _waiting and _head are both seq_cst, so either the consumer sees the producer waiting
+            // or the producer sees the slot it freed
+            std::unique_lock<std::mutex> lock(_room_mutex);
+            _waiting.store(true);
+            auto has_room = _room.wait_for(lock, _timeout, [&]{ return ticket - _head.load() < _depth; });
+            _waiting.store(false);
+            if (!has_room)
+                _timed_out.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        void advanceHead(uint64_t head)
+        {
+            _head.store(head);
+            if (_waiting.load())
+            {
+                // Taking the lock makes sure the producer is waiting, not between its check and the wait
+                std::lock_guard<std::mutex> lock(_room_mutex);
+                _room.notify_one();
+            }
+        }
+
+        struct Slot
+        {
+            std::atomic<uint64_t> seq;
+            std::atomic<rs2_frame*> frame;
+            std::atomic<uint64_t> stamp;
+        };
+
+        const size_t _depth;
+        const drop_policy _policy;
+        const std::chrono::microseconds _timeout;
+        std::unique_ptr<Slot[]> _slots;
+        std::atomic<uint64_t> _head;        // Next ticket to read, written by the consumer only
+        std::atomic<uint64_t> _tail;        // Next ticket to write, written by the producer only
+        std::atomic<uint64_t> _overwritten;
+        std::atomic<uint64_t> _timed_out;
+        std::atomic<bool> _waiting;         // Producer is in waitForRoom()
+        std::mutex _room_mutex;
+        std::condition_variable _room;
+    };
+}  // namespace realsense2_camera
+
+#endif  // REALSENSE2_CAMERA_FRAME_RING_BUFFER_H
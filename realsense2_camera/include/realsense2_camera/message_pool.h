@@ -0,0 +1,67 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2018 Intel Corporation. All Rights Reserved
+
+#ifndef REALSENSE2_CAMERA_MESSAGE_POOL_H
+#define REALSENSE2_CAMERA_MESSAGE_POOL_H
+
+#include <mutex>
+#include <vector>
+
+#include <boost/make_shared.hpp>
+#include <boost/shared_ptr.hpp>
+
+namespace realsense2_camera
+{
+    /**
+    Pool of ROS messages handed out as boost::shared_ptr.
+    The pool keeps a reference to each of its messages; once that is the only one left (every
+    subscriber dropped theirs) the message is free again, so its data vectors keep their capacity
+    and the next frame of the same size doesn't reallocate them. Handing out a pooled message only
+    copies the shared_ptr, nothing is allocated. When all of them are busy a new message is made,
+    and kept if the pool isn't full yet.
+    Messages are returned as-is: the user overwrites every field it publishes.
+    The pool can be destroyed while subscribers still hold messages.
+    */
+    template<class M>
+    class MessagePool
+    {
+    public:
+        explicit MessagePool(size_t capacity) : _capacity(capacity)
+        {
+            _messages.reserve(capacity);
+        }
+
+        boost::shared_ptr<M> acquire()
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            // Only the pool hands its messages out, so one nobody else holds stays free until returned
+            for (auto& msg : _messages)
+            {
+                if (msg.unique())
+                    return msg;
+            }
+
+            auto msg = boost::make_shared<M>();
+            if (_messages.size() < _capacity)
+                _messages.push_back(msg);
+            return msg;
+        }
+
+        // Messages past the new capacity are let go, subscribers may still hold them
+        void setCapacity(size_t capacity)
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _capacity = capacity;
+            if (_messages.size() > capacity)
+                _messages.resize(capacity);
+            _messages.reserve(capacity);
+        }
+
+    private:
+        size_t _capacity;
+        std::vector<boost::shared_ptr<M>> _messages;
+        std::mutex _mutex;
+    };
+}  // namespace realsense2_camera
+
+#endif  // REALSENSE2_CAMERA_MESSAGE_POOL_H
@@ -0,0 +1,64 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2018 Intel Corporation. All Rights Reserved
+
+#ifndef REALSENSE2_CAMERA_NORMAL_ESTIMATION_H
+#define REALSENSE2_CAMERA_NORMAL_ESTIMATION_H
+
+#include <vector>
+
+namespace realsense2_camera
+{
+    /**
+    Surface normals of an organized cloud from integral images, as PCL's IntegralImageNormalEstimation
+    with the covariance matrix method: the summed-area tables of the points and of their products
+    give the covariance of any window in constant time, and its smallest eigenvector is the normal.
+    Curvature is the smallest eigenvalue over the sum of eigenvalues.
+    Invalid points are (0, 0, 0) and are left out of the windows.
+
+    Building the tables takes two steps so the work can be split: addRow() sums each row as soon as
+    it is deprojected, rows in any order, then integrateColumns() sums down the columns, over any
+    split of the columns. computeRow() can then run on any rows.
+    Sums are kept in double, as in PCL, since windows are differences of large totals.
+    Memory is kept between frames.
+    */
+    class NormalEstimation
+    {
+    public:
+        NormalEstimation() : _width(0), _height(0) {}
+
+        // Starts a cloud of width x height points
+        void resize(int width, int height);
+
+        // Adds row y, its points are point_step floats apart with x, y, z first
+        void addRow(int y, const float* points, int point_step);
+
+        // Finishes the tables for columns [begin, end), once every row has been added
+        void integrateColumns(int begin, int end);
+
+        /**
+        Computes the normals of row y over windows of (2 * half_window + 1) points a side,
+        clipped to the cloud. Records are point_step floats apart, with x, y, z at offsets 0 to 2,
+        the normal written at offsets 4 to 6 and the curvature at offset 8, which is PCL's
+        PointNormal layout. Normals face viewpoint. Invalid points, and points with fewer than
+        3 valid neighbors, get NaN normals and curvature.
+        */
+        void computeRow(int y, int half_window, const float* viewpoint, float* points, int point_step) const;
+
+    private:
+        struct Sums
+        {
+            double count;
+            double x, y, z;
+            double xx, xy, xz, yy, yz, zz;
+        };
+
+        Sums* row(int y) { return _sums.data() + y * (_width + 1); }
+        const Sums* row(int y) const { return _sums.data() + y * (_width + 1); }
+
+        int _width;
+        int _height;
+        std::vector<Sums> _sums;   // (width + 1) x (height + 1), first row and column are zero
+    };
+}  // namespace realsense2_camera
+
+#endif  // REALSENSE2_CAMERA_NORMAL_ESTIMATION_H
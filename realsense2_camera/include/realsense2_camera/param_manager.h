@@ -31,11 +31,18 @@ enum base_depth_param{
     base_temporal_filter_smooth_alpha,
     base_temporal_filter_smooth_delta,
     base_temporal_filter_holes_fill,
+    base_enable_decimation_filter,
+    base_decimation_filter_magnitude,
+    base_enable_threshold_filter,
+    base_threshold_filter_min_distance,
+    base_threshold_filter_max_distance,
+    base_enable_hole_filling_filter,
+    base_hole_filling_filter_mode,
     base_depth_count
 };
 
 enum rs435_param{
-    rs435_depth_exposure = 20,
+    rs435_depth_exposure = 27,
     rs435_depth_laser_power,
     rs435_depth_emitter_enabled,
     rs435_color_backlight_compensation,
@@ -57,7 +64,7 @@ enum rs435_param{
 };
 
 enum rs415_param{
-    rs415_depth_enable_auto_white_balance = 20,
+    rs415_depth_enable_auto_white_balance = 27,
     rs415_depth_exposure,
     rs415_depth_laser_power,
     rs415_depth_emitter_enabled,
@@ -164,6 +171,7 @@ public:
 private:
     void callback(RealSenseNode* node_ptr, typename ModelTraits<Model>::Config &config, uint32_t level);
     void setOption(RealSenseNode *node_ptr, stream_index_pair sip, rs2_option opt, float val);
+    void enableFilter(RealSenseNode *node_ptr, filters type, bool enable);
 
     std::shared_ptr<dynamic_reconfigure::Server<typename ModelTraits<Model>::Config>> _server;
     typename dynamic_reconfigure::Server<typename ModelTraits<Model>::Config>::CallbackType _f;
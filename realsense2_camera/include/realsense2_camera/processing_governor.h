@@ -0,0 +1,64 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2018 Intel Corporation. All Rights Reserved
+
+#ifndef REALSENSE2_CAMERA_PROCESSING_GOVERNOR_H
+#define REALSENSE2_CAMERA_PROCESSING_GOVERNOR_H
+
+#include <atomic>
+#include <string>
+#include <vector>
+
+namespace realsense2_camera
+{
+    enum governor_step
+    {
+        GOVERNOR_TEMPORAL_FILTER,       // Skip the temporal filter
+        GOVERNOR_SPATIAL_FILTER,        // Skip the spatial filter
+        GOVERNOR_POINTCLOUD_STRIDE,     // Double the point cloud stride
+        GOVERNOR_ALIGN_EVERY_OTHER,     // Align depth on every other frame only
+        GOVERNOR_STEP_COUNT
+    };
+
+    /**
+    Trades processing quality for frame rate. The load is the time the slowest pipeline stage spent
+    on a frame over the frame period, as that stage bounds the rate the pipeline sustains, averaged
+    over about ten frames. Above high_load the governor takes the next step of its ladder, below
+    low_load it gives the last one back. It waits for the average to reflect a change before
+    deciding again, and only restores after the load stayed low for a while, so it neither
+    oscillates between two levels nor reacts to a single slow frame.
+    update() is called by one thread, the other members may be read from any thread.
+    */
+    class ProcessingGovernor
+    {
+    public:
+        ProcessingGovernor();
+
+        // Steps taken in order under overload; thresholds are fractions of the frame period
+        void configure(const std::vector<governor_step>& ladder, double frame_period, double high_load, double low_load);
+
+        // Once per processed frame, with the seconds its slowest stage took
+        void update(double busy_seconds);
+
+        bool isDegraded(governor_step step) const;
+        int level() const { return _level; }
+        double load() const { return _load; }
+        const std::vector<governor_step>& ladder() const { return _ladder; }
+
+        // Name of a step as given in the governor_ladder parameter
+        static const char* stepName(governor_step step);
+        // GOVERNOR_STEP_COUNT for an unknown name
+        static governor_step parseStep(const std::string& name);
+
+    private:
+        std::vector<governor_step> _ladder;
+        double _frame_period;
+        double _high_load;
+        double _low_load;
+        std::atomic<double> _load;
+        std::atomic<int> _level;
+        int _frames;            // Since the last level change, up to the settling time
+        int _low_frames;        // In a row with the load below low_load, up to the restoring time
+    };
+}  // namespace realsense2_camera
+
+#endif  // REALSENSE2_CAMERA_PROCESSING_GOVERNOR_H
@@ -6,8 +6,13 @@
 
 #include <csignal>
 #include <fstream>
+#include <array>
 #include <atomic>
+#include <bitset>
+#include <chrono>
+#include <condition_variable>
 #include <mutex>
+#include <thread>
 
 #include <eigen3/Eigen/Geometry>
 
@@ -16,7 +21,17 @@
 #include <librealsense2/hpp/rs_processing.hpp>
 #include <librealsense2/rs_advanced_mode.hpp>
 
+#include <realsense2_camera/color_sampling.h>
 #include <realsense2_camera/constants.h>
+#include <realsense2_camera/depth_alignment.h>
+#include <realsense2_camera/deprojection.h>
+#include <realsense2_camera/frame_pipeline.h>
+#include <realsense2_camera/frame_ring_buffer.h>
+#include <realsense2_camera/message_pool.h>
+#include <realsense2_camera/normal_estimation.h>
+#include <realsense2_camera/processing_governor.h>
+#include <realsense2_camera/voxel_grid.h>
+#include <realsense2_camera/worker_pool.h>
 #include <realsense2_camera/Extrinsics.h>
 #include <realsense2_camera/IMUInfo.h>
 #include <realsense2_camera/realsense_node.h>
@@ -48,7 +63,10 @@ class RealSenseParamManager;
         DEPTH_TO_DISPARITY,
         SPATIAL,
         TEMPORAL,
-        DISPARITY_TO_DEPTH
+        DISPARITY_TO_DEPTH,
+        DECIMATION,
+        THRESHOLD,
+        HOLE_FILLING
     };
 
     struct FrequencyDiagnostics
@@ -81,13 +99,111 @@ class RealSenseParamManager;
     class filter_options
     {
     public:
-        filter_options(const std::string name, rs2::process_interface &filter);
+        filter_options(filters type, const std::string name, rs2::process_interface &filter, bool is_enabled);
         filter_options(filter_options&& other);
+        filters type;                      // Which of the node's filters this is
         std::string filter_name;           // Friendly name of the filter
         rs2::process_interface& filter;    // The filter in use
         std::atomic_bool is_enabled;       // A boolean controlled by the user that determines whether to apply the filter or not
     };
 
+    /**
+    Unit of work created by the frame callback and handed through the processing stages.
+    Jobs are recycled by the pipeline: clear() drops the frames but keeps the buffers allocated.
+    */
+    struct FrameJob
+    {
+        rs2::frame frame;                                   // Frame or frameset as delivered by librealsense
+        ros::Time t;                                        // ROS timestamp computed on arrival
+        std::bitset<STREAM_COUNT> is_frame_arrived;         // Indexed by stream_id
+        std::vector<rs2::frame> frames;                     // Video frames of the set, depth already filtered
+        rs2::frame depth_frame;
+        rs2::frame color_frame;
+        rs2::frame infra1_frame;                            // Pixel-aligned with depth on D400
+        rs2_intrinsics depth_intrinsics;                    // Of depth_frame, which filters may have resized
+        std::bitset<STREAM_COUNT> is_depth_aligned;         // Which aligned_depth_images hold this job's output
+        std::array<sensor_msgs::ImagePtr, STREAM_COUNT> aligned_depth_images;  // Aligned straight into a pooled message
+        sensor_msgs::ImagePtr aligned_color_image;          // Color resampled onto the depth grid
+        bool has_depth_pixel_rgb = false;                   // Whether depth_pixel_rgb holds this job's colors
+        std::vector<uint32_t> depth_pixel_rgb;              // Packed color of every depth pixel, from the aligner
+        sensor_msgs::PointCloud2Ptr pointcloud_xyz;
+        sensor_msgs::PointCloud2Ptr pointcloud_xyzrgb;
+        sensor_msgs::PointCloud2Ptr pointcloud_normals;
+        sensor_msgs::PointCloud2Ptr pointcloud_intensity;
+        double busiest_stage = 0.0;                         // Seconds, of the stages the job went through
+
+        void clear()
+        {
+            frame = rs2::frame();
+            is_frame_arrived.reset();
+            frames.clear();
+            depth_frame = rs2::frame();
+            color_frame = rs2::frame();
+            infra1_frame = rs2::frame();
+            is_depth_aligned.reset();
+            for (auto& img : aligned_depth_images)
+                img.reset();
+            aligned_color_image.reset();
+            has_depth_pixel_rgb = false;
+            pointcloud_xyz.reset();
+            pointcloud_xyzrgb.reset();
+            pointcloud_normals.reset();
+            pointcloud_intensity.reset();
+            busiest_stage = 0.0;
+        }
+    };
+
+    /**
+    Scratch memory of one row tile of the point clouds, kept between frames.
+    Tiles are processed in parallel, each only touches its own.
+    */
+    struct PointCloudTile
+    {
+        std::vector<float> points;      // One row of points on its way into the voxel grid
+        std::vector<float> u;           // Where the points of the row land in the color image
+        std::vector<float> v;
+        std::vector<uint32_t> rgb;      // Packed colors of the row, for the voxel grid
+        VoxelGrid grid;
+        size_t count = 0;               // Points written by the tile
+    };
+
+    /**
+    Per-frame state of a single stream, kept in a dense array indexed by stream_id.
+    Members touched on every published frame come first.
+    */
+    struct StreamState
+    {
+        StreamState() :
+            seq(0),
+            image_pool(MESSAGE_POOL_SIZE),
+            info_pool(MESSAGE_POOL_SIZE),
+            profile_info_id(-1),
+            intrinsics(),
+            depth_to_other() {}
+
+        void setPoolCapacity(size_t capacity)
+        {
+            image_pool.setCapacity(capacity);
+            info_pool.setCapacity(capacity);
+        }
+
+        int seq;
+        MessagePool<sensor_msgs::Image> image_pool;
+        MessagePool<sensor_msgs::CameraInfo> info_pool;
+        std::string encoding;
+        std::string optical_frame_id;
+        std::unique_ptr<FrameRingBuffer> publish_ring;
+        ImagePublisherWithFrequencyDiagnostics image_publisher;
+        ros::Publisher info_publisher;
+        ros::Publisher imu_publisher;
+        sensor_msgs::CameraInfo camera_info;
+        int profile_info_id;                   // Profile profile_info was made for, -1 for none
+        sensor_msgs::CameraInfo profile_info;  // camera_info with the geometry of that profile
+        rs2_intrinsics intrinsics;
+        rs2_extrinsics depth_to_other;   // Extrinsics from the depth stream to this one
+        RayTable rays;                   // Only built for depth
+    };
+
     class RealSenseNode
     {
     public:
@@ -99,7 +215,7 @@ class RealSenseParamManager;
         void createParamsManager();
 
         void publishTopics();
-        ~RealSenseNode() {}
+        ~RealSenseNode();
 
         static constexpr stream_index_pair COLOR{RS2_STREAM_COLOR, 0};
         static constexpr stream_index_pair DEPTH{RS2_STREAM_DEPTH, 0};
@@ -120,7 +236,11 @@ class RealSenseParamManager;
         rs2::temporal_filter temp_filter;    // Temporal   - reduces temporal noise
         rs2::disparity_transform depth_to_disparity{true};
         rs2::disparity_transform disparity_to_depth{false};
-        std::vector<filter_options> filters;
+        rs2::decimation_filter dec_filter;      // Decimation - reduces depth resolution, and every later cost with it
+        rs2::threshold_filter thresh_filter;    // Threshold  - drops depth outside a range
+        rs2::hole_filling_filter hole_filling_filter;   // Hole filling - fills invalid pixels from their neighbors
+        std::string _filter_list;
+        std::vector<filter_options> filters;    // In the order of _filter_list, only the listed ones
         std::mutex _mutex;
 
 
@@ -136,6 +256,7 @@ class RealSenseParamManager;
 
         static std::string getNamespaceStr();
         void getParameters();
+        void setMessagePoolSize(size_t size);
         bool enableStreams(std_srvs::SetBool::Request  &req, std_srvs::SetBool::Response &res);
         void setupDevice();
         void setupPublishers();
@@ -143,6 +264,7 @@ class RealSenseParamManager;
         void enable_devices();
         void setupStreams();
         void updateStreamCalibData(const rs2::video_stream_profile& video_profile);
+        static void setCameraInfoGeometry(const rs2_intrinsics& intrinsics, sensor_msgs::CameraInfo& camera_info);
         tf::Quaternion rotationMatrixToQuaternion(const float rotation[9]) const;
         void publish_static_tf(const ros::Time& t,
                                const float3& trans,
@@ -150,36 +272,54 @@ class RealSenseParamManager;
                                const std::string& from,
                                const std::string& to);
         void publishStaticTransforms();
-        void publishRgbToDepthPCTopic(const ros::Time& t, const std::map<stream_index_pair, bool>& is_frame_arrived);
-        void publishDepthPCTopic(const ros::Time& t, const std::map<stream_index_pair, bool>& is_frame_arrived);
+        void setupPointCloudFrame();
+        const rs2_extrinsics* pointCloudTransform() const;
+        sensor_msgs::PointCloud2Ptr createRgbToDepthPCMsg(const FrameJob& job);
+        sensor_msgs::PointCloud2Ptr createDepthPCMsg(const FrameJob& job);
+        sensor_msgs::PointCloud2Ptr createNormalsPCMsg(const FrameJob& job);
+        sensor_msgs::PointCloud2Ptr createIntensityPCMsg(const FrameJob& job);
+        void fillPointCloud(const FrameJob& job, const DeprojectionParams& params, bool with_color,
+                            sensor_msgs::PointCloud2& msg);
+        bool useVoxelGrid() const;
+        DeprojectionParams pointCloudParams(const rs2_intrinsics& depth_intrinsics) const;
+        void setPointCloudSize(sensor_msgs::PointCloud2& msg, const DeprojectionParams& params) const;
         Extrinsics rsExtrinsicsToMsg(const rs2_extrinsics& extrinsics, const std::string& frame_id) const;
         rs2_extrinsics getRsExtrinsics(const stream_index_pair& from_stream, const stream_index_pair& to_stream);
 
         IMUInfo getImuInfo(const stream_index_pair& stream_index);
+        void setupFilters();
+        filter_options* findFilter(realsense2_camera::filters type);   // nullptr when it is not in the chain
         void filterFrame(rs2::frame& f);
+        const rs2_intrinsics& filteredDepthIntrinsics(const rs2::frame& depth_frame);
+        const sensor_msgs::CameraInfo& profileCameraInfo(StreamState& state, const rs2::stream_profile& profile);
         void publishFrame(rs2::frame f, const ros::Time& t,
-                          const stream_index_pair& stream,
-                          std::map<stream_index_pair, cv::Mat>& images,
-                          const std::map<stream_index_pair, ros::Publisher>& info_publishers,
-                          const std::map<stream_index_pair, ImagePublisherWithFrequencyDiagnostics>& image_publishers,
-                          std::map<stream_index_pair, int>& seq,
-                          std::map<stream_index_pair, sensor_msgs::CameraInfo>& camera_info,
-                          const std::map<stream_index_pair, std::string>& optical_frame_id,
-                          const std::map<stream_index_pair, std::string>& encoding,
-                          bool copy_data_from_frame = true);
+                          StreamState& state,
+                          sensor_msgs::ImagePtr img = nullptr,
+                          rs2::frame geometry = rs2::frame());
+        StreamState& streamState(const stream_index_pair& stream) { return _streams.at(streamId(stream)); }
         bool getEnabledProfile(const stream_index_pair& stream_index, rs2::stream_profile& profile);
 
-        void updateIsFrameArrived(std::map<stream_index_pair, bool>& is_frame_arrived,
+        void updateIsFrameArrived(std::bitset<STREAM_COUNT>& is_frame_arrived,
                                   rs2_stream stream_type, int stream_index);
 
-        void publishAlignedDepthToOthers(rs2::frame depth_frame, const std::vector<rs2::frame>& frames, const ros::Time& t);
-
-        void alignFrame(const rs2_intrinsics& from_intrin,
-                        const rs2_intrinsics& other_intrin,
-                        rs2::frame from_image,
-                        uint32_t output_image_bytes_per_pixel,
-                        const rs2_extrinsics& from_to_other,
-                        std::vector<uint8_t>& out_vec);
+        void alignDepthToOthers(FrameJob& job);
+        void publishAlignedDepthToOthers(const FrameJob& job);
+
+        void setupPipeline();
+        void setupPublishRings();
+        drop_policy parseDropPolicy(const std::string& name, const stream_index_pair& stream) const;
+        double dropTimeoutMs(const stream_index_pair& stream, drop_policy policy) const;
+        void dropStatsUpdate(diagnostic_updater::DiagnosticStatusWrapper& stat, const stream_index_pair& stream);
+        void pushToPublishRing(const rs2::frame& f, const ros::Time& t);
+        void pushToPublishRing(StreamState& state, const rs2::frame& f, const ros::Time& t);
+        void publishRingsLoop();
+        void ingestFrame(rs2::frame frame);
+        void filterStage(FrameJob& job);
+        void alignStage(FrameJob& job);
+        void pointcloudStage(FrameJob& job);
+        void publishStage(FrameJob& job);
+        void setupGovernor();
+        void governorStatusUpdate(diagnostic_updater::DiagnosticStatusWrapper& stat);
 
         void TemperatureUpdate(diagnostic_updater::DiagnosticStatusWrapper& stat);
 
@@ -190,7 +330,6 @@ class RealSenseParamManager;
         std::string _serial_no;
         float _depth_scale_meters;
 
-        std::map<stream_index_pair, rs2_intrinsics> _stream_intrinsics;
         std::map<stream_index_pair, int> _width;
         std::map<stream_index_pair, int> _height;
         std::map<stream_index_pair, int> _fps;
@@ -198,21 +337,11 @@ class RealSenseParamManager;
         std::map<stream_index_pair, std::string> _stream_name;
         tf2_ros::StaticTransformBroadcaster _static_tf_broadcaster;
 
-        std::map<stream_index_pair, ImagePublisherWithFrequencyDiagnostics> _image_publishers;
-        std::map<stream_index_pair, ros::Publisher> _imu_publishers;
-        std::map<stream_index_pair, int> _image_format;
         std::map<stream_index_pair, rs2_format> _format;
-        std::map<stream_index_pair, ros::Publisher> _info_publisher;
-        std::map<stream_index_pair, cv::Mat> _image;
-        std::map<stream_index_pair, std::string> _encoding;
-        std::map<stream_index_pair, std::vector<uint8_t>> _aligned_depth_images;
 
         std::string _base_frame_id;
         std::map<stream_index_pair, std::string> _frame_id;
-        std::map<stream_index_pair, std::string> _optical_frame_id;
-        std::map<stream_index_pair, int> _seq;
         std::map<stream_index_pair, int> _unit_step_size;
-        std::map<stream_index_pair, sensor_msgs::CameraInfo> _camera_info;
         bool _intialize_time_base;
         double _camera_time_base;
         double _prev_camera_time_stamp;
@@ -220,27 +349,82 @@ class RealSenseParamManager;
 
         ros::Publisher _pointcloud_xyz_publisher;
         ros::Publisher _pointcloud_xyzrgb_publisher;
+        MessagePool<sensor_msgs::PointCloud2> _pointcloud_xyz_pool;
+        MessagePool<sensor_msgs::PointCloud2> _pointcloud_xyzrgb_pool;
+        ros::Publisher _pointcloud_normals_publisher;
+        MessagePool<sensor_msgs::PointCloud2> _pointcloud_normals_pool;
+        ros::Publisher _pointcloud_intensity_publisher;
+        MessagePool<sensor_msgs::PointCloud2> _pointcloud_intensity_pool;
         ros::ServiceServer _enable_streams_service;
         ros::Time _ros_time_base;
         bool _align_depth;
+        bool _align_depth_zbuffer;
+        double _align_depth_output_scale;
+        DepthAligner _depth_aligner;
+        std::vector<DepthAligner::Target> _align_targets;    // Scratch of the align stage
         bool _sync_frames;
         bool _pointcloud;
+        bool _pointcloud_organized;
+        int _pointcloud_stride;
+        double _pointcloud_voxel_leaf;
+        double _pointcloud_min_z;
+        double _pointcloud_max_z;
+        int _pointcloud_roi_x;              // Depth pixels deprojected into point clouds
+        int _pointcloud_roi_y;
+        int _pointcloud_roi_width;
+        int _pointcloud_roi_height;
+        bool _pointcloud_bilinear_color;
+        std::string _pointcloud_frame_id;   // Frame the clouds are published in
+        bool _pointcloud_transformed;       // Whether it differs from the depth optical frame
+        rs2_extrinsics _pointcloud_transform;   // Depth optical frame to _pointcloud_frame_id
+        bool _pointcloud_normals;
+        int _pointcloud_normals_window;
+        NormalEstimation _normal_estimation;
+        bool _pointcloud_intensity;
+        // Point cloud scratch, shared by both clouds, which are built one after the other
+        VoxelGrid _voxel_grid;
+        std::vector<PointCloudTile> _pointcloud_tiles;
+        int _pointcloud_tile_rows;
         bool _use_ros_time;
         rs2::asynchronous_syncer _syncer;
 
-        std::map<stream_index_pair, cv::Mat> _depth_aligned_image;
-        std::map<stream_index_pair, std::string> _depth_aligned_encoding;
-        std::map<stream_index_pair, sensor_msgs::CameraInfo> _depth_aligned_camera_info;
-        std::map<stream_index_pair, int> _depth_aligned_seq;
-        std::map<stream_index_pair, ros::Publisher> _depth_aligned_info_publisher;
-        std::map<stream_index_pair, ImagePublisherWithFrequencyDiagnostics> _depth_aligned_image_publishers;
+        // Per-frame state, indexed by stream_id. Setup-only configuration stays in the maps above.
+        std::array<StreamState, STREAM_COUNT> _streams;
+        // Intrinsics of the profile filtered depth frames came in last, read again when it changes
+        int _filtered_depth_profile_id;
+        rs2_intrinsics _filtered_depth_intrinsics;
+        std::array<StreamState, STREAM_COUNT> _depth_aligned_streams;   // Depth aligned to each other stream
+        StreamState _color_aligned_to_depth;
+        StreamState _filtered_depth;        // Depth after the filter chain, depth itself is published raw
+
         std::map<stream_index_pair, std::string> _depth_aligned_frame_id;
         std::map<stream_index_pair, ros::Publisher> _depth_to_other_extrinsics_publishers;
-        std::map<stream_index_pair, rs2_extrinsics> _depth_to_other_extrinsics;
 
         std::function<void(rs2::frame)> _frame_callback;
+        int _pipeline_queue_size;
+        int _publish_ring_size;
+        int _message_pool_size;
+        std::map<stream_index_pair, std::string> _drop_policy_name;
+        std::map<stream_index_pair, double> _drop_timeout_ms;
+        drop_policy _pipeline_drop_policy;
+        int _worker_threads;
+        std::unique_ptr<WorkerPool> _worker_pool;
+        std::chrono::microseconds _pipeline_drop_timeout;
+        bool _governor_enabled;
+        std::string _governor_ladder;
+        double _governor_high_load;
+        double _governor_low_load;
+        ProcessingGovernor _governor;
+        unsigned _align_frames;             // Align stage only, for align_every_other
+
+        // Frames are handed from capture to the image publishing thread through StreamState::publish_ring
+        std::thread _publish_thread;
+        std::atomic_bool _publish_running;
+        std::atomic_bool _publish_pending;
+        std::atomic_bool _publish_sleeping;   // Set by the publishing thread before it waits, producers only notify then
+        std::mutex _publish_mutex;
+        std::condition_variable _publish_cv;
 
-        std::map<stream_index_pair, bool> _is_frame_arrived;
         const std::string _namespace;
 
         diagnostic_updater::Updater temp_diagnostic_updater_;
@@ -249,6 +433,7 @@ class RealSenseParamManager;
         ros::Timer depth_callback_timer_;
         ros::Duration depth_callback_timeout_;
         std::unique_ptr<RealSenseParamManagerBase> _params;
+        StagedPipeline<FrameJob> _pipeline;
 
         const std::vector<std::vector<stream_index_pair>> IMAGE_STREAMS = {{{DEPTH, INFRA1, INFRA2},
                                                                             {COLOR},
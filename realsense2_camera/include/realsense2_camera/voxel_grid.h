@@ -0,0 +1,62 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2018 Intel Corporation. All Rights Reserved
+
+#ifndef REALSENSE2_CAMERA_VOXEL_GRID_H
+#define REALSENSE2_CAMERA_VOXEL_GRID_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace realsense2_camera
+{
+    /**
+    Single pass voxel-grid downsampling: points are added one at a time, while they are still in
+    cache, and each occupied cube of leaf_size meters ends up as the centroid of its points,
+    with their average color. Voxels are found through an open-addressing hash of their integer
+    coordinates, so the cost doesn't depend on the extent of the cloud.
+    Voxels are written in the order they were first hit, which keeps the output deterministic.
+    Memory is kept between frames.
+    */
+    class VoxelGrid
+    {
+    public:
+        VoxelGrid() : _inv_leaf(0.f), _slot_mask(0) {}
+
+        // Starts a new cloud
+        void reset(float leaf_size);
+
+        // Adds a point given as x, y, z, with its color packed as PointCloud2 "rgb" (0x00rrggbb)
+        void add(const float* point, uint32_t rgb = 0);
+
+        // Adds the points of another grid with the same leaf size, as if they were added here.
+        // Its voxels keep their order after the ones already here.
+        void merge(const VoxelGrid& other);
+
+        size_t size() const { return _voxels.size(); }
+
+        // Writes the centroids as x, y, z floats, point_step bytes apart.
+        // If rgb_offset is not negative the average color is also written there, packed as "rgb".
+        void write(uint8_t* out, size_t point_step, int rgb_offset) const;
+
+    private:
+        struct Voxel
+        {
+            uint64_t key;
+            float x, y, z;
+            uint32_t r, g, b;
+            uint32_t count;
+        };
+
+        // Finds the voxel of key, inserting an empty one if needed
+        Voxel& voxelAt(uint64_t key);
+        void rehash(size_t slot_count);
+
+        float _inv_leaf;
+        std::vector<Voxel> _voxels;
+        std::vector<int32_t> _slots;   // Index into _voxels, -1 when empty. Size is a power of two.
+        size_t _slot_mask;
+    };
+}  // namespace realsense2_camera
+
+#endif  // REALSENSE2_CAMERA_VOXEL_GRID_H
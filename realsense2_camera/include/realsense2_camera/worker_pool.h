@@ -0,0 +1,148 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2018 Intel Corporation. All Rights Reserved
+
+#ifndef REALSENSE2_CAMERA_WORKER_POOL_H
+#define REALSENSE2_CAMERA_WORKER_POOL_H
+
+#include <algorithm>
+#include <condition_variable>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace realsense2_camera
+{
+    /**
+    Fixed set of threads that per-frame work (point cloud tiles, ...) is spread over.
+    parallelFor() runs task(0) .. task(count - 1) on the workers and on the calling thread and
+    returns once all of them are done, so callers get the same result as a plain loop as long
+    as tasks write to disjoint outputs. Several pipeline stages may call it at the same time;
+    their tasks are handed out in call order.
+    The first exception thrown by a task is rethrown to the caller.
+    Tasks are called through a plain function pointer rather than a std::function, so handing
+    out a batch never allocates, whatever the task captures.
+    */
+    class WorkerPool
+    {
+    public:
+        // Number of threads besides the callers, 0 runs everything on the calling thread
+        explicit WorkerPool(size_t threads) : _stopping(false)
+        {
+            _batches.reserve(RESERVED_BATCHES);
+            for (size_t i = 0; i < threads; ++i)
+                _threads.emplace_back(&WorkerPool::run, this);
+        }
+
+        ~WorkerPool()
+        {
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                _stopping = true;
+            }
+            _work_ready.notify_all();
+            for (auto& thread : _threads)
+                thread.join();
+        }
+
+        size_t size() const { return _threads.size(); }
+
+        template<class Task>
+        void parallelFor(int count, const Task& task)
+        {
+            if (count <= 0)
+                return;
+
+            Batch batch(&task, &Batch::template call<Task>, count);
+            std::unique_lock<std::mutex> lock(_mutex);
+            if (count > 1 && !_threads.empty())
+            {
+                _batches.push_back(&batch);
+                _work_ready.notify_all();
+            }
+
+            // Help with our own batch rather than sleeping
+            while (batch.next < batch.count)
+                runOne(batch, lock);
+            _batch_done.wait(lock, [&batch]{ return batch.done == batch.count; });
+
+            if (batch.error)
+                std::rethrow_exception(batch.error);
+        }
+
+    private:
+        struct Batch
+        {
+            Batch(const void* task, void (*run)(const void*, int), int count) :
+                task(task), run(run), count(count), next(0), done(0) {}
+
+            template<class Task>
+            static void call(const void* task, int index)
+            {
+                (*static_cast<const Task*>(task))(index);
+            }
+
+            const void* task;
+            void (*run)(const void*, int);
+            const int count;
+            int next;       // Guarded by the pool mutex, like the rest
+            int done;
+            std::exception_ptr error;
+        };
+
+        // Called and returns with the lock held
+        void runOne(Batch& batch, std::unique_lock<std::mutex>& lock)
+        {
+            auto index = batch.next++;
+            if (batch.next == batch.count)
+            {
+                // Everything is handed out, nobody needs to find this batch anymore
+                auto it = std::find(_batches.begin(), _batches.end(), &batch);
+                if (it != _batches.end())
+                    _batches.erase(it);
+            }
+
+            lock.unlock();
+            std::exception_ptr error;
+            try
+            {
+                batch.run(batch.task, index);
+            }
+            catch (...)
+            {
+                error = std::current_exception();
+            }
+            lock.lock();
+
+            if (error && !batch.error)
+                batch.error = error;
+            if (++batch.done == batch.count)
+                _batch_done.notify_all();
+        }
+
+        void run()
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            while (true)
+            {
+                _work_ready.wait(lock, [this]{ return _stopping || !_batches.empty(); });
+                if (_stopping)
+                    return;
+
+                runOne(*_batches.front(), lock);
+            }
+        }
+
+        // Batches in flight at once, one per pipeline stage calling in, more only grow the vector
+        static const size_t RESERVED_BATCHES = 16;
+
+        std::vector<std::thread> _threads;
+        std::vector<Batch*> _batches;    // In call order
+        std::mutex _mutex;
+        std::condition_variable _work_ready;
+        std::condition_variable _batch_done;
+        bool _stopping;
+    };
+}  // namespace realsense2_camera
+
+#endif  // REALSENSE2_CAMERA_WORKER_POOL_H
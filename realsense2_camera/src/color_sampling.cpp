@@ -0,0 +1,331 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2018 Intel Corporation. All Rights Reserved
+
+#include <realsense2_camera/color_sampling.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include <librealsense2/rsutil.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define REALSENSE2_CAMERA_X86_KERNELS
+#endif
+
+using namespace realsense2_camera;
+
+namespace
+{
+    bool vectorProjectionSupported(const rs2_intrinsics& intrin)
+    {
+        return RS2_DISTORTION_NONE == intrin.model || RS2_DISTORTION_MODIFIED_BROWN_CONRADY == intrin.model;
+    }
+
+    void storeRgb(uint8_t* out, uint32_t rgb)
+    {
+        std::memcpy(out, &rgb, sizeof(rgb));
+    }
+
+    uint32_t loadRgb8(const uint8_t* color_data, int width, int x, int y)
+    {
+        auto p = color_data + (y * width + x) * 3;
+        return (static_cast<uint32_t>(p[0]) << 16) | (static_cast<uint32_t>(p[1]) << 8) | p[2];
+    }
+
+    // Per channel lerp, written the same way as the vector code so both round identically
+    uint32_t bilinearRgb(uint32_t c00, uint32_t c10, uint32_t c01, uint32_t c11, float fx, float fy)
+    {
+        uint32_t rgb = 0;
+        for (int shift = 16; shift >= 0; shift -= 8)
+        {
+            float a = static_cast<float>((c00 >> shift) & 0xff), b = static_cast<float>((c10 >> shift) & 0xff);
+            float c = static_cast<float>((c01 >> shift) & 0xff), d = static_cast<float>((c11 >> shift) & 0xff);
+            float top = a + (b - a) * fx;
+            float bottom = c + (d - c) * fx;
+            rgb |= static_cast<uint32_t>(std::nearbyint(top + (bottom - top) * fy)) << shift;
+        }
+        return rgb;
+    }
+
+    void projectScalar(const rs2_extrinsics& extrin, const rs2_intrinsics& intrin,
+                       const float* points, int point_step, int begin, int count, float* u, float* v)
+    {
+        for (int i = begin; i < count; ++i)
+        {
+            float color_point[3], color_pixel[2];
+            rs2_transform_point_to_point(color_point, &extrin, points + i * point_step);
+            rs2_project_point_to_pixel(color_pixel, &intrin, color_point);
+            u[i] = color_pixel[0];
+            v[i] = color_pixel[1];
+        }
+    }
+
+    void sampleScalar(const rs2_intrinsics& intrin, const uint8_t* color_data, const float* u, const float* v,
+                      int begin, int count, bool bilinear, uint8_t* out, size_t out_step)
+    {
+        for (int i = begin; i < count; ++i)
+        {
+            auto rgb = OUT_OF_BOUNDS_RGB;
+            if (u[i] >= 0.f && u[i] < intrin.width && v[i] >= 0.f && v[i] < intrin.height)
+            {
+                auto x0 = static_cast<int>(u[i]);
+                auto y0 = static_cast<int>(v[i]);
+                if (bilinear)
+                {
+                    auto x1 = std::min(x0 + 1, intrin.width - 1);
+                    auto y1 = std::min(y0 + 1, intrin.height - 1);
+                    rgb = bilinearRgb(loadRgb8(color_data, intrin.width, x0, y0), loadRgb8(color_data, intrin.width, x1, y0),
+                                      loadRgb8(color_data, intrin.width, x0, y1), loadRgb8(color_data, intrin.width, x1, y1),
+                                      u[i] - x0, v[i] - y0);
+                }
+                else
+                {
+                    rgb = loadRgb8(color_data, intrin.width, x0, y0);
+                }
+            }
+            storeRgb(out + i * out_step, rgb);
+        }
+    }
+
+#ifdef REALSENSE2_CAMERA_X86_KERNELS
+    // Vector projection kernels return the first point left for the scalar code
+    typedef int (*project_kernel)(const rs2_extrinsics& extrin, const rs2_intrinsics& intrin,
+                                  const float* points, int point_step, int count, float* u, float* v);
+
+    __attribute__((target("sse4.2")))
+    int projectSse42(const rs2_extrinsics& extrin, const rs2_intrinsics& intrin,
+                     const float* points, int point_step, int count, float* u, float* v)
+    {
+        __m128 rot[9], trans[3];
+        for (int k = 0; k < 9; ++k)
+            rot[k] = _mm_set1_ps(extrin.rotation[k]);
+        for (int k = 0; k < 3; ++k)
+            trans[k] = _mm_set1_ps(extrin.translation[k]);
+        const bool distorted = (RS2_DISTORTION_MODIFIED_BROWN_CONRADY == intrin.model);
+        const __m128 one = _mm_set1_ps(1.f), two = _mm_set1_ps(2.f);
+        const __m128 c0 = _mm_set1_ps(intrin.coeffs[0]), c1 = _mm_set1_ps(intrin.coeffs[1]);
+        const __m128 c2 = _mm_set1_ps(intrin.coeffs[2]), c3 = _mm_set1_ps(intrin.coeffs[3]), c4 = _mm_set1_ps(intrin.coeffs[4]);
+
+        int i = 0;
+        for (; i + 4 <= count; i += 4)
+        {
+            auto p = points + i * point_step;
+            __m128 x = _mm_loadu_ps(p), y = _mm_loadu_ps(p + point_step);
+            __m128 z = _mm_loadu_ps(p + 2 * point_step), w = _mm_loadu_ps(p + 3 * point_step);
+            _MM_TRANSPOSE4_PS(x, y, z, w);
+
+            __m128 tx = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(rot[0], x), _mm_mul_ps(rot[3], y)), _mm_mul_ps(rot[6], z)), trans[0]);
+            __m128 ty = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(rot[1], x), _mm_mul_ps(rot[4], y)), _mm_mul_ps(rot[7], z)), trans[1]);
+            __m128 tz = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(rot[2], x), _mm_mul_ps(rot[5], y)), _mm_mul_ps(rot[8], z)), trans[2]);
+
+            __m128 px = _mm_div_ps(tx, tz), py = _mm_div_ps(ty, tz);
+            if (distorted)
+            {
+                __m128 r2 = _mm_add_ps(_mm_mul_ps(px, px), _mm_mul_ps(py, py));
+                __m128 f = _mm_add_ps(_mm_add_ps(_mm_add_ps(one, _mm_mul_ps(c0, r2)), _mm_mul_ps(_mm_mul_ps(c1, r2), r2)),
+                                      _mm_mul_ps(_mm_mul_ps(_mm_mul_ps(c4, r2), r2), r2));
+                px = _mm_mul_ps(px, f);
+                py = _mm_mul_ps(py, f);
+                __m128 dx = _mm_add_ps(_mm_add_ps(px, _mm_mul_ps(_mm_mul_ps(_mm_mul_ps(two, c2), px), py)),
+                                       _mm_mul_ps(c3, _mm_add_ps(r2, _mm_mul_ps(_mm_mul_ps(two, px), px))));
+                __m128 dy = _mm_add_ps(_mm_add_ps(py, _mm_mul_ps(_mm_mul_ps(_mm_mul_ps(two, c3), px), py)),
+                                       _mm_mul_ps(c2, _mm_add_ps(r2, _mm_mul_ps(_mm_mul_ps(two, py), py))));
+                px = dx;
+                py = dy;
+            }
+            _mm_storeu_ps(u + i, _mm_add_ps(_mm_mul_ps(px, _mm_set1_ps(intrin.fx)), _mm_set1_ps(intrin.ppx)));
+            _mm_storeu_ps(v + i, _mm_add_ps(_mm_mul_ps(py, _mm_set1_ps(intrin.fy)), _mm_set1_ps(intrin.ppy)));
+        }
+        return i;
+    }
+
+    __attribute__((target("avx2")))
+    int projectAvx2(const rs2_extrinsics& extrin, const rs2_intrinsics& intrin,
+                    const float* points, int point_step, int count, float* u, float* v)
+    {
+        __m256 rot[9], trans[3];
+        for (int k = 0; k < 9; ++k)
+            rot[k] = _mm256_set1_ps(extrin.rotation[k]);
+        for (int k = 0; k < 3; ++k)
+            trans[k] = _mm256_set1_ps(extrin.translation[k]);
+        const bool distorted = (RS2_DISTORTION_MODIFIED_BROWN_CONRADY == intrin.model);
+        const __m256 one = _mm256_set1_ps(1.f), two = _mm256_set1_ps(2.f);
+        const __m256 c0 = _mm256_set1_ps(intrin.coeffs[0]), c1 = _mm256_set1_ps(intrin.coeffs[1]);
+        const __m256 c2 = _mm256_set1_ps(intrin.coeffs[2]), c3 = _mm256_set1_ps(intrin.coeffs[3]), c4 = _mm256_set1_ps(intrin.coeffs[4]);
+
+        int i = 0;
+        for (; i + 8 <= count; i += 8)
+        {
+            auto p = points + i * point_step;
+            // Two 4x4 transposes of the records are cheaper than gathering
+            __m128 a0 = _mm_loadu_ps(p), a1 = _mm_loadu_ps(p + point_step);
+            __m128 a2 = _mm_loadu_ps(p + 2 * point_step), a3 = _mm_loadu_ps(p + 3 * point_step);
+            __m128 b0 = _mm_loadu_ps(p + 4 * point_step), b1 = _mm_loadu_ps(p + 5 * point_step);
+            __m128 b2 = _mm_loadu_ps(p + 6 * point_step), b3 = _mm_loadu_ps(p + 7 * point_step);
+            _MM_TRANSPOSE4_PS(a0, a1, a2, a3);
+            _MM_TRANSPOSE4_PS(b0, b1, b2, b3);
+            __m256 x = _mm256_set_m128(b0, a0), y = _mm256_set_m128(b1, a1), z = _mm256_set_m128(b2, a2);
+
+            __m256 tx = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(rot[0], x), _mm256_mul_ps(rot[3], y)), _mm256_mul_ps(rot[6], z)), trans[0]);
+            __m256 ty = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(rot[1], x), _mm256_mul_ps(rot[4], y)), _mm256_mul_ps(rot[7], z)), trans[1]);
+            __m256 tz = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(rot[2], x), _mm256_mul_ps(rot[5], y)), _mm256_mul_ps(rot[8], z)), trans[2]);
+
+            __m256 px = _mm256_div_ps(tx, tz), py = _mm256_div_ps(ty, tz);
+            if (distorted)
+            {
+                __m256 r2 = _mm256_add_ps(_mm256_mul_ps(px, px), _mm256_mul_ps(py, py));
+                __m256 f = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(one, _mm256_mul_ps(c0, r2)), _mm256_mul_ps(_mm256_mul_ps(c1, r2), r2)),
+                                         _mm256_mul_ps(_mm256_mul_ps(_mm256_mul_ps(c4, r2), r2), r2));
+                px = _mm256_mul_ps(px, f);
+                py = _mm256_mul_ps(py, f);
+                __m256 dx = _mm256_add_ps(_mm256_add_ps(px, _mm256_mul_ps(_mm256_mul_ps(_mm256_mul_ps(two, c2), px), py)),
+                                          _mm256_mul_ps(c3, _mm256_add_ps(r2, _mm256_mul_ps(_mm256_mul_ps(two, px), px))));
+                __m256 dy = _mm256_add_ps(_mm256_add_ps(py, _mm256_mul_ps(_mm256_mul_ps(_mm256_mul_ps(two, c3), px), py)),
+                                          _mm256_mul_ps(c2, _mm256_add_ps(r2, _mm256_mul_ps(_mm256_mul_ps(two, py), py))));
+                px = dx;
+                py = dy;
+            }
+            _mm256_storeu_ps(u + i, _mm256_add_ps(_mm256_mul_ps(px, _mm256_set1_ps(intrin.fx)), _mm256_set1_ps(intrin.ppx)));
+            _mm256_storeu_ps(v + i, _mm256_add_ps(_mm256_mul_ps(py, _mm256_set1_ps(intrin.fy)), _mm256_set1_ps(intrin.ppy)));
+        }
+        return i;
+    }
+
+    // Gathers the RGB8 pixels at byte offsets 'index' as packed 0x00rrggbb, lanes outside 'mask' are 0.
+    // Each lane loads the 4 bytes ending with the pixel (starting with it for the very first pixel),
+    // so nothing is read past the end of the image.
+    __attribute__((target("avx2")))
+    inline __m256i gatherRgb8(const uint8_t* color_data, __m256i index, __m256i mask)
+    {
+        const __m256i one = _mm256_set1_epi32(1);
+        __m256i not_first = _mm256_cmpgt_epi32(index, _mm256_setzero_si256());
+        __m256i start = _mm256_sub_epi32(index, _mm256_and_si256(not_first, one));
+        __m256i shift = _mm256_and_si256(not_first, _mm256_set1_epi32(8));
+
+        __m256i bytes = _mm256_mask_i32gather_epi32(_mm256_setzero_si256(), reinterpret_cast<const int*>(color_data),
+                                                    start, mask, 1);
+        bytes = _mm256_srlv_epi32(bytes, shift);
+
+        // r, g, b bytes in memory order become b, g, r, 0
+        const __m256i swap = _mm256_setr_epi8(2, 1, 0, -128, 6, 5, 4, -128, 10, 9, 8, -128, 14, 13, 12, -128,
+                                              2, 1, 0, -128, 6, 5, 4, -128, 10, 9, 8, -128, 14, 13, 12, -128);
+        return _mm256_shuffle_epi8(bytes, swap);
+    }
+
+    __attribute__((target("avx2")))
+    inline __m256 channel(__m256i rgb, int shift)
+    {
+        return _mm256_cvtepi32_ps(_mm256_and_si256(_mm256_srli_epi32(rgb, shift), _mm256_set1_epi32(0xff)));
+    }
+
+    __attribute__((target("avx2")))
+    int sampleAvx2(const rs2_intrinsics& intrin, const uint8_t* color_data, const float* u, const float* v,
+                   int count, bool bilinear, uint8_t* out, size_t out_step)
+    {
+        const __m256 width = _mm256_set1_ps(static_cast<float>(intrin.width));
+        const __m256 height = _mm256_set1_ps(static_cast<float>(intrin.height));
+        const __m256i last_x = _mm256_set1_epi32(intrin.width - 1), last_y = _mm256_set1_epi32(intrin.height - 1);
+        const __m256i row_bytes = _mm256_set1_epi32(intrin.width * 3), three = _mm256_set1_epi32(3);
+        const __m256i one = _mm256_set1_epi32(1);
+        const __m256 zero = _mm256_setzero_ps();
+
+        int i = 0;
+        for (; i + 8 <= count; i += 8)
+        {
+            __m256 pu = _mm256_loadu_ps(u + i), pv = _mm256_loadu_ps(v + i);
+            __m256 in_bounds = _mm256_and_ps(_mm256_and_ps(_mm256_cmp_ps(pu, zero, _CMP_GE_OQ), _mm256_cmp_ps(pu, width, _CMP_LT_OQ)),
+                                             _mm256_and_ps(_mm256_cmp_ps(pv, zero, _CMP_GE_OQ), _mm256_cmp_ps(pv, height, _CMP_LT_OQ)));
+            __m256i mask = _mm256_castps_si256(in_bounds);
+            // Out of bounds lanes compute garbage indices, masked off in the gathers
+            __m256i x0 = _mm256_and_si256(_mm256_cvttps_epi32(pu), mask);
+            __m256i y0 = _mm256_and_si256(_mm256_cvttps_epi32(pv), mask);
+            __m256i row0 = _mm256_mullo_epi32(y0, row_bytes);
+            __m256i col0 = _mm256_mullo_epi32(x0, three);
+
+            __m256i rgb;
+            if (bilinear)
+            {
+                __m256i row1 = _mm256_mullo_epi32(_mm256_min_epi32(_mm256_add_epi32(y0, one), last_y), row_bytes);
+                __m256i col1 = _mm256_mullo_epi32(_mm256_min_epi32(_mm256_add_epi32(x0, one), last_x), three);
+                __m256i c00 = gatherRgb8(color_data, _mm256_add_epi32(row0, col0), mask);
+                __m256i c10 = gatherRgb8(color_data, _mm256_add_epi32(row0, col1), mask);
+                __m256i c01 = gatherRgb8(color_data, _mm256_add_epi32(row1, col0), mask);
+                __m256i c11 = gatherRgb8(color_data, _mm256_add_epi32(row1, col1), mask);
+                __m256 fx = _mm256_sub_ps(pu, _mm256_cvtepi32_ps(x0));
+                __m256 fy = _mm256_sub_ps(pv, _mm256_cvtepi32_ps(y0));
+
+                rgb = _mm256_setzero_si256();
+                for (int shift = 16; shift >= 0; shift -= 8)
+                {
+                    __m256 a = channel(c00, shift), b = channel(c10, shift), c = channel(c01, shift), d = channel(c11, shift);
+                    __m256 top = _mm256_add_ps(a, _mm256_mul_ps(_mm256_sub_ps(b, a), fx));
+                    __m256 bottom = _mm256_add_ps(c, _mm256_mul_ps(_mm256_sub_ps(d, c), fx));
+                    __m256 value = _mm256_add_ps(top, _mm256_mul_ps(_mm256_sub_ps(bottom, top), fy));
+                    rgb = _mm256_or_si256(rgb, _mm256_sll_epi32(_mm256_cvtps_epi32(value), _mm_cvtsi32_si128(shift)));
+                }
+            }
+            else
+            {
+                rgb = gatherRgb8(color_data, _mm256_add_epi32(row0, col0), mask);
+            }
+            rgb = _mm256_blendv_epi8(_mm256_set1_epi32(OUT_OF_BOUNDS_RGB), rgb, mask);
+
+            alignas(32) uint32_t lanes[8];
+            _mm256_store_si256(reinterpret_cast<__m256i*>(lanes), rgb);
+            for (int k = 0; k < 8; ++k)
+                storeRgb(out + (i + k) * out_step, lanes[k]);
+        }
+        return i;
+    }
+#endif
+
+    struct Kernels
+    {
+#ifdef REALSENSE2_CAMERA_X86_KERNELS
+        project_kernel project;
+        bool avx2;
+#endif
+    };
+
+    Kernels chooseKernels()
+    {
+        Kernels kernels;
+#ifdef REALSENSE2_CAMERA_X86_KERNELS
+        __builtin_cpu_init();
+        kernels.avx2 = __builtin_cpu_supports("avx2");
+        kernels.project = kernels.avx2 ? projectAvx2 : (__builtin_cpu_supports("sse4.2") ? projectSse42 : nullptr);
+#endif
+        return kernels;
+    }
+
+    const Kernels& kernels()
+    {
+        static const Kernels choice = chooseKernels();
+        return choice;
+    }
+}
+
+void realsense2_camera::projectToColor(const rs2_extrinsics& depth_to_color, const rs2_intrinsics& color_intrin,
+                                       const float* points, int point_step, int count, float* u, float* v)
+{
+    int i = 0;
+#ifdef REALSENSE2_CAMERA_X86_KERNELS
+    if (kernels().project && vectorProjectionSupported(color_intrin))
+        i = kernels().project(depth_to_color, color_intrin, points, point_step, count, u, v);
+#endif
+    projectScalar(depth_to_color, color_intrin, points, point_step, i, count, u, v);
+}
+
+void realsense2_camera::sampleColor(const rs2_intrinsics& color_intrin, const uint8_t* color_data,
+                                    const float* u, const float* v, int count, bool bilinear,
+                                    uint8_t* out, size_t out_step)
+{
+    int i = 0;
+#ifdef REALSENSE2_CAMERA_X86_KERNELS
+    if (kernels().avx2)
+        i = sampleAvx2(color_intrin, color_data, u, v, count, bilinear, out, out_step);
+#endif
+    sampleScalar(color_intrin, color_data, u, v, i, count, bilinear, out, out_step);
+}
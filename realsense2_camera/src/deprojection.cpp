@@ -0,0 +1,380 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2018 Intel Corporation. All Rights Reserved
+
+#include <realsense2_camera/deprojection.h>
+
+#include <algorithm>
+
+#include <librealsense2/rsutil.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define REALSENSE2_CAMERA_X86_KERNELS
+#endif
+
+using namespace realsense2_camera;
+
+namespace
+{
+    bool sameIntrinsics(const rs2_intrinsics& a, const rs2_intrinsics& b)
+    {
+        if (a.width != b.width || a.height != b.height ||
+            a.ppx != b.ppx || a.ppy != b.ppy || a.fx != b.fx || a.fy != b.fy || a.model != b.model)
+            return false;
+
+        for (int i = 0; i < 5; ++i)
+        {
+            if (a.coeffs[i] != b.coeffs[i])
+                return false;
+        }
+        return true;
+    }
+
+    bool sameExtrinsics(const rs2_extrinsics& a, const rs2_extrinsics& b)
+    {
+        return std::equal(a.rotation, a.rotation + 9, b.rotation) &&
+               std::equal(a.translation, a.translation + 3, b.translation);
+    }
+
+    // Rays of one row. z and translation are only set when the table carries a rigid transform.
+    struct RowRays
+    {
+        const float* x;
+        const float* y;
+        const float* z;
+        const float* translation;
+    };
+
+    // Vector kernels handle stride 1 only. They return the first column left for the caller,
+    // which finishes the row in scalar code, and add the points they wrote to 'written'.
+    typedef int (*row_kernel)(const RowRays& rays, int width, const uint16_t* depth_row,
+                              const DeprojectionParams& params, float* out, int point_step, int& written);
+
+    int deprojectRowScalar(const RowRays& rays, int begin, int width, const uint16_t* depth_row,
+                           const DeprojectionParams& params, float* out, int point_step)
+    {
+        int written = 0;
+        for (int x = begin; x < width; x += params.stride)
+        {
+            float depth = static_cast<float>(depth_row[x]) * params.depth_scale;
+            bool valid = validDepth(depth_row[x], params);
+            if (params.compact && !valid)
+                continue;
+
+            auto p = out + written * point_step;
+            if (valid && rays.z)
+            {
+                p[0] = depth * rays.x[x] + rays.translation[0];
+                p[1] = depth * rays.y[x] + rays.translation[1];
+                p[2] = depth * rays.z[x] + rays.translation[2];
+            }
+            else if (valid)
+            {
+                p[0] = depth * rays.x[x];
+                p[1] = depth * rays.y[x];
+                p[2] = depth;
+            }
+            else
+            {
+                p[0] = p[1] = p[2] = 0.f;
+            }
+            ++written;
+        }
+        return written;
+    }
+
+#ifdef REALSENSE2_CAMERA_X86_KERNELS
+    // Transposes 4 points held as x, y, z vectors into xyz0 records and stores them point_step floats apart
+    __attribute__((target("sse4.2")))
+    inline void storePoints(__m128 x, __m128 y, __m128 z, float* out, int point_step)
+    {
+        __m128 w = _mm_setzero_ps();
+        _MM_TRANSPOSE4_PS(x, y, z, w);
+        _mm_storeu_ps(out, x);
+        _mm_storeu_ps(out + point_step, y);
+        _mm_storeu_ps(out + 2 * point_step, z);
+        _mm_storeu_ps(out + 3 * point_step, w);
+    }
+
+    // Same, but only the points whose bit is set in valid_mask are kept, back to back.
+    // Every record is stored, so up to 3 records past the kept ones get overwritten.
+    __attribute__((target("sse4.2")))
+    inline int storeValidPoints(__m128 x, __m128 y, __m128 z, int valid_mask, float* out, int point_step)
+    {
+        __m128 w = _mm_setzero_ps();
+        _MM_TRANSPOSE4_PS(x, y, z, w);
+        int n = 0;
+        _mm_storeu_ps(out, x);
+        n += valid_mask & 1;
+        _mm_storeu_ps(out + n * point_step, y);
+        n += (valid_mask >> 1) & 1;
+        _mm_storeu_ps(out + n * point_step, z);
+        n += (valid_mask >> 2) & 1;
+        _mm_storeu_ps(out + n * point_step, w);
+        n += (valid_mask >> 3) & 1;
+        return n;
+    }
+
+    __attribute__((target("sse4.2")))
+    int deprojectRowSse42(const RowRays& rays, int width, const uint16_t* depth_row,
+                          const DeprojectionParams& params, float* out, int point_step, int& written)
+    {
+        const bool transformed = (nullptr != rays.z);
+        const __m128 tx = _mm_set1_ps(transformed ? rays.translation[0] : 0.f);
+        const __m128 ty = _mm_set1_ps(transformed ? rays.translation[1] : 0.f);
+        const __m128 tz = _mm_set1_ps(transformed ? rays.translation[2] : 0.f);
+        const __m128 scale = _mm_set1_ps(params.depth_scale);
+        const __m128 min_depth = _mm_set1_ps(params.min_z), max_depth = _mm_set1_ps(params.max_z);
+        const __m128 zero = _mm_setzero_ps();
+
+        int x = 0;
+        for (; x + 4 <= width; x += 4)
+        {
+            __m128i raw = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(depth_row + x));
+            __m128 depth = _mm_mul_ps(_mm_cvtepi32_ps(_mm_cvtepu16_epi32(raw)), scale);
+
+            __m128 valid = _mm_and_ps(_mm_and_ps(_mm_cmpgt_ps(depth, zero), _mm_cmpge_ps(depth, min_depth)),
+                                      _mm_cmple_ps(depth, max_depth));
+            __m128 px = _mm_mul_ps(depth, _mm_loadu_ps(rays.x + x));
+            __m128 py = _mm_mul_ps(depth, _mm_loadu_ps(rays.y + x));
+            __m128 pz = depth;
+            if (transformed)
+            {
+                px = _mm_add_ps(px, tx);
+                py = _mm_add_ps(py, ty);
+                pz = _mm_add_ps(_mm_mul_ps(depth, _mm_loadu_ps(rays.z + x)), tz);
+            }
+            px = _mm_and_ps(px, valid);
+            py = _mm_and_ps(py, valid);
+            pz = _mm_and_ps(pz, valid);
+
+            auto p = out + written * point_step;
+            if (params.compact)
+            {
+                written += storeValidPoints(px, py, pz, _mm_movemask_ps(valid), p, point_step);
+            }
+            else
+            {
+                storePoints(px, py, pz, p, point_step);
+                written += 4;
+            }
+        }
+        return x;
+    }
+
+    __attribute__((target("avx2")))
+    int deprojectRowAvx2(const RowRays& rays, int width, const uint16_t* depth_row,
+                         const DeprojectionParams& params, float* out, int point_step, int& written)
+    {
+        const bool transformed = (nullptr != rays.z);
+        const __m256 tx = _mm256_set1_ps(transformed ? rays.translation[0] : 0.f);
+        const __m256 ty = _mm256_set1_ps(transformed ? rays.translation[1] : 0.f);
+        const __m256 tz = _mm256_set1_ps(transformed ? rays.translation[2] : 0.f);
+        const __m256 scale = _mm256_set1_ps(params.depth_scale);
+        const __m256 min_depth = _mm256_set1_ps(params.min_z), max_depth = _mm256_set1_ps(params.max_z);
+        const __m256 zero = _mm256_setzero_ps();
+
+        int x = 0;
+        for (; x + 8 <= width; x += 8)
+        {
+            __m128i raw = _mm_loadu_si128(reinterpret_cast<const __m128i*>(depth_row + x));
+            __m256 depth = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_cvtepu16_epi32(raw)), scale);
+
+            __m256 valid = _mm256_and_ps(_mm256_and_ps(_mm256_cmp_ps(depth, zero, _CMP_GT_OQ),
+                                                       _mm256_cmp_ps(depth, min_depth, _CMP_GE_OQ)),
+                                         _mm256_cmp_ps(depth, max_depth, _CMP_LE_OQ));
+            __m256 px = _mm256_mul_ps(depth, _mm256_loadu_ps(rays.x + x));
+            __m256 py = _mm256_mul_ps(depth, _mm256_loadu_ps(rays.y + x));
+            __m256 pz = depth;
+            if (transformed)
+            {
+                px = _mm256_add_ps(px, tx);
+                py = _mm256_add_ps(py, ty);
+                pz = _mm256_add_ps(_mm256_mul_ps(depth, _mm256_loadu_ps(rays.z + x)), tz);
+            }
+            px = _mm256_and_ps(px, valid);
+            py = _mm256_and_ps(py, valid);
+            pz = _mm256_and_ps(pz, valid);
+
+            auto p = out + written * point_step;
+            if (params.compact)
+            {
+                int valid_mask = _mm256_movemask_ps(valid);
+                written += storeValidPoints(_mm256_castps256_ps128(px), _mm256_castps256_ps128(py), _mm256_castps256_ps128(pz),
+                                            valid_mask & 0xf, p, point_step);
+                p = out + written * point_step;
+                written += storeValidPoints(_mm256_extractf128_ps(px, 1), _mm256_extractf128_ps(py, 1), _mm256_extractf128_ps(pz, 1),
+                                            valid_mask >> 4, p, point_step);
+            }
+            else
+            {
+                storePoints(_mm256_castps256_ps128(px), _mm256_castps256_ps128(py), _mm256_castps256_ps128(pz),
+                            p, point_step);
+                storePoints(_mm256_extractf128_ps(px, 1), _mm256_extractf128_ps(py, 1), _mm256_extractf128_ps(pz, 1),
+                            p + 4 * point_step, point_step);
+                written += 8;
+            }
+        }
+        return x;
+    }
+#endif
+
+    struct KernelChoice
+    {
+        row_kernel kernel;
+        const char* name;
+    };
+
+    const KernelChoice SCALAR_KERNEL = {nullptr, "scalar"};
+
+    bool kernelSupported(deprojection_kernel kernel)
+    {
+#ifdef REALSENSE2_CAMERA_X86_KERNELS
+        __builtin_cpu_init();
+        if (DEPROJECTION_AVX2 == kernel)
+            return __builtin_cpu_supports("avx2");
+        if (DEPROJECTION_SSE42 == kernel)
+            return __builtin_cpu_supports("sse4.2");
+#endif
+        return DEPROJECTION_SCALAR == kernel;
+    }
+
+    KernelChoice kernelOf(deprojection_kernel kernel)
+    {
+        if (!kernelSupported(kernel))
+            return SCALAR_KERNEL;
+#ifdef REALSENSE2_CAMERA_X86_KERNELS
+        if (DEPROJECTION_AVX2 == kernel)
+            return {deprojectRowAvx2, "AVX2"};
+        if (DEPROJECTION_SSE42 == kernel)
+            return {deprojectRowSse42, "SSE4.2"};
+#endif
+        return SCALAR_KERNEL;
+    }
+
+    KernelChoice chooseKernel()
+    {
+        for (auto kernel : {DEPROJECTION_AVX2, DEPROJECTION_SSE42})
+        {
+            if (kernelSupported(kernel))
+                return kernelOf(kernel);
+        }
+        return SCALAR_KERNEL;
+    }
+
+    const KernelChoice& kernelChoice(deprojection_kernel kernel)
+    {
+        static const KernelChoice choices[] = {chooseKernel(), SCALAR_KERNEL, kernelOf(DEPROJECTION_SSE42),
+                                               kernelOf(DEPROJECTION_AVX2)};
+        return choices[kernel];
+    }
+}
+
+bool RayTable::update(const rs2_intrinsics& intrin, const rs2_extrinsics* transform)
+{
+    bool same_transform = transform ? (_transformed && sameExtrinsics(*transform, _transform)) : !_transformed;
+    if (!empty() && same_transform && sameIntrinsics(intrin, _intrin))
+        return false;
+
+    _intrin = intrin;
+    _transformed = (nullptr != transform);
+    _transform = transform ? *transform : rs2_extrinsics();
+    _ray_x.resize(intrin.width * intrin.height);
+    _ray_y.resize(intrin.width * intrin.height);
+    _ray_z.resize(_transformed ? intrin.width * intrin.height : 0);
+
+    // The translation is added per point, rays only get rotated
+    rs2_extrinsics rotation = _transform;
+    std::fill(rotation.translation, rotation.translation + 3, 0.f);
+
+    float point[3], rotated[3];
+    for (int y = 0; y < intrin.height; ++y)
+    {
+        for (int x = 0; x < intrin.width; ++x)
+        {
+            float pixel[2] = {static_cast<float>(x), static_cast<float>(y)};
+            rs2_deproject_pixel_to_point(point, &intrin, pixel, 1.f);
+            auto index = y * intrin.width + x;
+            if (_transformed)
+            {
+                rs2_transform_point_to_point(rotated, &rotation, point);
+                _ray_x[index] = rotated[0];
+                _ray_y[index] = rotated[1];
+                _ray_z[index] = rotated[2];
+            }
+            else
+            {
+                _ray_x[index] = point[0];
+                _ray_y[index] = point[1];
+            }
+        }
+    }
+    return true;
+}
+
+int realsense2_camera::deprojectDepthRow(const RayTable& rays, int y, const uint16_t* depth_row,
+                                         const DeprojectionParams& params, float* out, int point_step,
+                                         deprojection_kernel kernel)
+{
+    // Kernels see the column range as a whole row
+    auto width = params.x_end - params.x_begin;
+    RowRays row_rays = {rays.rowX(y) + params.x_begin, rays.rowY(y) + params.x_begin, nullptr, nullptr};
+    if (rays.transformed())
+    {
+        row_rays.z = rays.rowZ(y) + params.x_begin;
+        row_rays.translation = rays.transform().translation;
+    }
+    depth_row += params.x_begin;
+
+    int x = 0;
+    int written = 0;
+    auto row_kernel = kernelChoice(kernel).kernel;
+    if (row_kernel && 1 == params.stride)
+        x = row_kernel(row_rays, width, depth_row, params, out, point_step, written);
+    return written + deprojectRowScalar(row_rays, x, width, depth_row, params, out + written * point_step, point_step);
+}
+
+rs2_extrinsics realsense2_camera::inverseExtrinsics(const rs2_extrinsics& a_to_b)
+{
+    // The inverse of a rotation is its transpose, and the translation is rotated back
+    rs2_extrinsics b_to_a;
+    for (int row = 0; row < 3; ++row)
+    {
+        for (int col = 0; col < 3; ++col)
+            b_to_a.rotation[col * 3 + row] = a_to_b.rotation[row * 3 + col];
+    }
+    for (int i = 0; i < 3; ++i)
+    {
+        b_to_a.translation[i] = -(b_to_a.rotation[i] * a_to_b.translation[0] +
+                                  b_to_a.rotation[3 + i] * a_to_b.translation[1] +
+                                  b_to_a.rotation[6 + i] * a_to_b.translation[2]);
+    }
+    return b_to_a;
+}
+
+rs2_extrinsics realsense2_camera::composeExtrinsics(const rs2_extrinsics& a_to_b, const rs2_extrinsics& b_to_c)
+{
+    // Rotations are column-major, element (row, col) is at col * 3 + row
+    rs2_extrinsics a_to_c;
+    for (int row = 0; row < 3; ++row)
+    {
+        for (int col = 0; col < 3; ++col)
+        {
+            a_to_c.rotation[col * 3 + row] = b_to_c.rotation[row] * a_to_b.rotation[col * 3] +
+                                             b_to_c.rotation[3 + row] * a_to_b.rotation[col * 3 + 1] +
+                                             b_to_c.rotation[6 + row] * a_to_b.rotation[col * 3 + 2];
+        }
+    }
+    rs2_transform_point_to_point(a_to_c.translation, &b_to_c, a_to_b.translation);
+    return a_to_c;
+}
+
+bool realsense2_camera::deprojectionKernelSupported(deprojection_kernel kernel)
+{
+    return DEPROJECTION_BEST == kernel || kernelSupported(kernel);
+}
+
+const char* realsense2_camera::deprojectionKernelName(deprojection_kernel kernel)
+{
+    return kernelChoice(kernel).name;
+}
@@ -0,0 +1,639 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2018 Intel Corporation. All Rights Reserved
+
+#include <realsense2_camera/depth_alignment.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include <librealsense2/rsutil.h>
+
+#include <realsense2_camera/color_sampling.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define REALSENSE2_CAMERA_X86_KERNELS
+#endif
+
+using namespace realsense2_camera;
+
+namespace
+{
+    const int TILE_ROWS = 16;
+    const size_t MAX_TRACKED_BUFFERS = 64;
+
+    bool sameIntrinsics(const rs2_intrinsics& a, const rs2_intrinsics& b)
+    {
+        return a.width == b.width && a.height == b.height && a.ppx == b.ppx && a.ppy == b.ppy &&
+               a.fx == b.fx && a.fy == b.fy && a.model == b.model && std::equal(a.coeffs, a.coeffs + 5, b.coeffs);
+    }
+
+    // Z-buffer write, 0 is empty. Only the nearest value survives, in whatever order the writes come.
+    // Taking one off first turns empty into the largest value, so this is a branchless minimum.
+    inline void keepNearest(uint16_t* pixel, uint16_t value)
+    {
+        uint16_t current = *pixel - 1;
+        *pixel = std::min(current, static_cast<uint16_t>(value - 1)) + 1;
+    }
+
+    // Same for pixels other threads write to: a compare and swap loop, skipped when the pixel
+    // already holds a nearer value, which is the common case for covered pixels
+    inline void keepNearestAtomic(uint16_t* pixel, uint16_t value)
+    {
+        uint16_t current = __atomic_load_n(pixel, __ATOMIC_RELAXED);
+        while ((0 == current || value < current) &&
+               !__atomic_compare_exchange_n(pixel, &current, value, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        {
+        }
+    }
+
+    // Corner rays of one depth row: top-left corners of the row and bottom-right corners,
+    // which are the top-left corners of the next row shifted by one. Only x and y, z is 1.
+    struct CornerRow
+    {
+        const float* top[2];
+        const float* bottom[2];
+    };
+
+    // Where both corners of each pixel land, rounded to other pixels the way the original
+    // per-pixel code did: truncation of coordinate + 0.5
+    struct CornerPixels
+    {
+        int32_t* x0;
+        int32_t* y0;
+        int32_t* x1;
+        int32_t* y1;
+    };
+
+    void projectCornersScalar(const CornerRow& row, const uint16_t* depth_row, float depth_scale, int begin, int width,
+                              const rs2_extrinsics& extrin, const rs2_intrinsics& other, const CornerPixels& out)
+    {
+        for (int x = begin; x < width; ++x)
+        {
+            float depth = depth_scale * depth_row[x];
+            float corner[3] = {depth * row.top[0][x], depth * row.top[1][x], depth}, point[3], pixel[2];
+            rs2_transform_point_to_point(point, &extrin, corner);
+            rs2_project_point_to_pixel(pixel, &other, point);
+            out.x0[x] = static_cast<int>(pixel[0] + 0.5f);
+            out.y0[x] = static_cast<int>(pixel[1] + 0.5f);
+
+            corner[0] = depth * row.bottom[0][x];
+            corner[1] = depth * row.bottom[1][x];
+            rs2_transform_point_to_point(point, &extrin, corner);
+            rs2_project_point_to_pixel(pixel, &other, point);
+            out.x1[x] = static_cast<int>(pixel[0] + 0.5f);
+            out.y1[x] = static_cast<int>(pixel[1] + 0.5f);
+        }
+    }
+
+    // Copies the target pixel at the bottom-right corner of every kept depth pixel, zero elsewhere
+    void resampleScalar(const uint8_t* image, int image_width, int bpp, const CornerPixels& pixels,
+                        int begin, int width, uint8_t* out)
+    {
+        for (int x = begin; x < width; ++x)
+        {
+            if (pixels.x0[x] < 0)
+                std::memset(out + x * bpp, 0, bpp);
+            else
+                std::memcpy(out + x * bpp, image + (pixels.y1[x] * image_width + pixels.x1[x]) * bpp, bpp);
+        }
+    }
+
+    // Same pixels as packed point cloud rgb, out of bounds where resampleScalar writes zero
+    void packRgb8Scalar(const uint8_t* image, int image_width, const CornerPixels& pixels,
+                        int begin, int width, uint32_t* out)
+    {
+        for (int x = begin; x < width; ++x)
+        {
+            if (pixels.x0[x] < 0)
+            {
+                out[x] = OUT_OF_BOUNDS_RGB;
+                continue;
+            }
+            auto p = image + (pixels.y1[x] * image_width + pixels.x1[x]) * 3;
+            out[x] = (static_cast<uint32_t>(p[0]) << 16) | (static_cast<uint32_t>(p[1]) << 8) | p[2];
+        }
+    }
+
+#ifdef REALSENSE2_CAMERA_X86_KERNELS
+    // Vector kernels return the first column left for the scalar code
+    typedef int (*corner_kernel)(const CornerRow& row, const uint16_t* depth_row, float depth_scale, int width,
+                                 const rs2_extrinsics& extrin, const rs2_intrinsics& other, const CornerPixels& out);
+
+    // Same operations in the same order as rs2_transform_point_to_point and rs2_project_point_to_pixel,
+    // so the results are identical
+    struct Projection4
+    {
+        __m128 r[9], t[3];
+        __m128 fx, fy, ppx, ppy, c0, c1, c2, c3, c4;
+        bool distorted;
+    };
+
+    __attribute__((target("sse4.2")))
+    inline void project4(const Projection4& p, __m128 cx, __m128 cy, __m128 cz, __m128i& u, __m128i& v)
+    {
+        const __m128 one = _mm_set1_ps(1.f), two = _mm_set1_ps(2.f), half = _mm_set1_ps(0.5f);
+        __m128 x = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(p.r[0], cx), _mm_mul_ps(p.r[3], cy)),
+                                         _mm_mul_ps(p.r[6], cz)), p.t[0]);
+        __m128 y = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(p.r[1], cx), _mm_mul_ps(p.r[4], cy)),
+                                         _mm_mul_ps(p.r[7], cz)), p.t[1]);
+        __m128 z = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(p.r[2], cx), _mm_mul_ps(p.r[5], cy)),
+                                         _mm_mul_ps(p.r[8], cz)), p.t[2]);
+        __m128 px = _mm_div_ps(x, z), py = _mm_div_ps(y, z);
+        if (p.distorted)
+        {
+            __m128 r2 = _mm_add_ps(_mm_mul_ps(px, px), _mm_mul_ps(py, py));
+            __m128 f = _mm_add_ps(_mm_add_ps(_mm_add_ps(one, _mm_mul_ps(p.c0, r2)), _mm_mul_ps(_mm_mul_ps(p.c1, r2), r2)),
+                                  _mm_mul_ps(_mm_mul_ps(_mm_mul_ps(p.c4, r2), r2), r2));
+            px = _mm_mul_ps(px, f);
+            py = _mm_mul_ps(py, f);
+            __m128 dx = _mm_add_ps(_mm_add_ps(px, _mm_mul_ps(_mm_mul_ps(_mm_mul_ps(two, p.c2), px), py)),
+                                   _mm_mul_ps(p.c3, _mm_add_ps(r2, _mm_mul_ps(_mm_mul_ps(two, px), px))));
+            __m128 dy = _mm_add_ps(_mm_add_ps(py, _mm_mul_ps(_mm_mul_ps(_mm_mul_ps(two, p.c3), px), py)),
+                                   _mm_mul_ps(p.c2, _mm_add_ps(r2, _mm_mul_ps(_mm_mul_ps(two, py), py))));
+            px = dx;
+            py = dy;
+        }
+        u = _mm_cvttps_epi32(_mm_add_ps(_mm_add_ps(_mm_mul_ps(px, p.fx), p.ppx), half));
+        v = _mm_cvttps_epi32(_mm_add_ps(_mm_add_ps(_mm_mul_ps(py, p.fy), p.ppy), half));
+    }
+
+    __attribute__((target("sse4.2")))
+    int projectCornersSse42(const CornerRow& row, const uint16_t* depth_row, float depth_scale, int width,
+                            const rs2_extrinsics& extrin, const rs2_intrinsics& other, const CornerPixels& out)
+    {
+        Projection4 p = {{}, {}, _mm_set1_ps(other.fx), _mm_set1_ps(other.fy), _mm_set1_ps(other.ppx), _mm_set1_ps(other.ppy),
+                         _mm_set1_ps(other.coeffs[0]), _mm_set1_ps(other.coeffs[1]), _mm_set1_ps(other.coeffs[2]),
+                         _mm_set1_ps(other.coeffs[3]), _mm_set1_ps(other.coeffs[4]),
+                         RS2_DISTORTION_MODIFIED_BROWN_CONRADY == other.model};
+        for (int i = 0; i < 9; ++i)
+            p.r[i] = _mm_set1_ps(extrin.rotation[i]);
+        for (int i = 0; i < 3; ++i)
+            p.t[i] = _mm_set1_ps(extrin.translation[i]);
+        const __m128 scale = _mm_set1_ps(depth_scale);
+
+        int x = 0;
+        for (; x + 4 <= width; x += 4)
+        {
+            __m128i raw = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(depth_row + x));
+            __m128 depth = _mm_mul_ps(scale, _mm_cvtepi32_ps(_mm_cvtepu16_epi32(raw)));
+            __m128i u, v;
+
+            project4(p, _mm_mul_ps(depth, _mm_loadu_ps(row.top[0] + x)), _mm_mul_ps(depth, _mm_loadu_ps(row.top[1] + x)),
+                     depth, u, v);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out.x0 + x), u);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out.y0 + x), v);
+
+            project4(p, _mm_mul_ps(depth, _mm_loadu_ps(row.bottom[0] + x)), _mm_mul_ps(depth, _mm_loadu_ps(row.bottom[1] + x)),
+                     depth, u, v);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out.x1 + x), u);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out.y1 + x), v);
+        }
+        return x;
+    }
+
+    struct Projection8
+    {
+        __m256 r[9], t[3];
+        __m256 fx, fy, ppx, ppy, c0, c1, c2, c3, c4;
+        bool distorted;
+    };
+
+    __attribute__((target("avx2")))
+    inline void project8(const Projection8& p, __m256 cx, __m256 cy, __m256 cz, __m256i& u, __m256i& v)
+    {
+        const __m256 one = _mm256_set1_ps(1.f), two = _mm256_set1_ps(2.f), half = _mm256_set1_ps(0.5f);
+        __m256 x = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(p.r[0], cx), _mm256_mul_ps(p.r[3], cy)),
+                                               _mm256_mul_ps(p.r[6], cz)), p.t[0]);
+        __m256 y = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(p.r[1], cx), _mm256_mul_ps(p.r[4], cy)),
+                                               _mm256_mul_ps(p.r[7], cz)), p.t[1]);
+        __m256 z = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(p.r[2], cx), _mm256_mul_ps(p.r[5], cy)),
+                                               _mm256_mul_ps(p.r[8], cz)), p.t[2]);
+        __m256 px = _mm256_div_ps(x, z), py = _mm256_div_ps(y, z);
+        if (p.distorted)
+        {
+            __m256 r2 = _mm256_add_ps(_mm256_mul_ps(px, px), _mm256_mul_ps(py, py));
+            __m256 f = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(one, _mm256_mul_ps(p.c0, r2)), _mm256_mul_ps(_mm256_mul_ps(p.c1, r2), r2)),
+                                     _mm256_mul_ps(_mm256_mul_ps(_mm256_mul_ps(p.c4, r2), r2), r2));
+            px = _mm256_mul_ps(px, f);
+            py = _mm256_mul_ps(py, f);
+            __m256 dx = _mm256_add_ps(_mm256_add_ps(px, _mm256_mul_ps(_mm256_mul_ps(_mm256_mul_ps(two, p.c2), px), py)),
+                                      _mm256_mul_ps(p.c3, _mm256_add_ps(r2, _mm256_mul_ps(_mm256_mul_ps(two, px), px))));
+            __m256 dy = _mm256_add_ps(_mm256_add_ps(py, _mm256_mul_ps(_mm256_mul_ps(_mm256_mul_ps(two, p.c3), px), py)),
+                                      _mm256_mul_ps(p.c2, _mm256_add_ps(r2, _mm256_mul_ps(_mm256_mul_ps(two, py), py))));
+            px = dx;
+            py = dy;
+        }
+        u = _mm256_cvttps_epi32(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(px, p.fx), p.ppx), half));
+        v = _mm256_cvttps_epi32(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(py, p.fy), p.ppy), half));
+    }
+
+    __attribute__((target("avx2")))
+    int projectCornersAvx2(const CornerRow& row, const uint16_t* depth_row, float depth_scale, int width,
+                           const rs2_extrinsics& extrin, const rs2_intrinsics& other, const CornerPixels& out)
+    {
+        Projection8 p = {{}, {}, _mm256_set1_ps(other.fx), _mm256_set1_ps(other.fy), _mm256_set1_ps(other.ppx),
+                         _mm256_set1_ps(other.ppy), _mm256_set1_ps(other.coeffs[0]), _mm256_set1_ps(other.coeffs[1]),
+                         _mm256_set1_ps(other.coeffs[2]), _mm256_set1_ps(other.coeffs[3]), _mm256_set1_ps(other.coeffs[4]),
+                         RS2_DISTORTION_MODIFIED_BROWN_CONRADY == other.model};
+        for (int i = 0; i < 9; ++i)
+            p.r[i] = _mm256_set1_ps(extrin.rotation[i]);
+        for (int i = 0; i < 3; ++i)
+            p.t[i] = _mm256_set1_ps(extrin.translation[i]);
+        const __m256 scale = _mm256_set1_ps(depth_scale);
+
+        int x = 0;
+        for (; x + 8 <= width; x += 8)
+        {
+            __m128i raw = _mm_loadu_si128(reinterpret_cast<const __m128i*>(depth_row + x));
+            __m256 depth = _mm256_mul_ps(scale, _mm256_cvtepi32_ps(_mm256_cvtepu16_epi32(raw)));
+            __m256i u, v;
+
+            project8(p, _mm256_mul_ps(depth, _mm256_loadu_ps(row.top[0] + x)),
+                     _mm256_mul_ps(depth, _mm256_loadu_ps(row.top[1] + x)), depth, u, v);
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(out.x0 + x), u);
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(out.y0 + x), v);
+
+            project8(p, _mm256_mul_ps(depth, _mm256_loadu_ps(row.bottom[0] + x)),
+                     _mm256_mul_ps(depth, _mm256_loadu_ps(row.bottom[1] + x)), depth, u, v);
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(out.x1 + x), u);
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(out.y1 + x), v);
+        }
+        return x;
+    }
+
+    // Same as resampleScalar for RGB8, returns the first column left for it. Each lane gathers the
+    // 4 bytes ending with its pixel (starting with it for the very first pixel), so nothing is read
+    // past the end of the image, and 32 bytes are stored for 24, so it stops short of the row end.
+    __attribute__((target("avx2")))
+    int resampleRgb8Avx2(const uint8_t* image, int image_width, const CornerPixels& pixels, int width, uint8_t* out)
+    {
+        const __m256i one = _mm256_set1_epi32(1), three = _mm256_set1_epi32(3);
+        const __m256i row_pixels = _mm256_set1_epi32(image_width);
+        // r, g, b of each lane packed to the low 12 bytes of each half, then the halves joined
+        const __m256i pack = _mm256_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -128, -128, -128, -128,
+                                              0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -128, -128, -128, -128);
+        const __m256i join = _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 3, 7);
+
+        int x = 0;
+        for (; x + 11 <= width; x += 8)
+        {
+            __m256i x0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pixels.x0 + x));
+            __m256i mask = _mm256_cmpgt_epi32(x0, _mm256_set1_epi32(-1));
+            __m256i x1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pixels.x1 + x));
+            __m256i y1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pixels.y1 + x));
+            __m256i index = _mm256_and_si256(_mm256_mullo_epi32(_mm256_add_epi32(_mm256_mullo_epi32(y1, row_pixels), x1), three),
+                                             mask);
+
+            __m256i not_first = _mm256_cmpgt_epi32(index, _mm256_setzero_si256());
+            __m256i start = _mm256_sub_epi32(index, _mm256_and_si256(not_first, one));
+            __m256i bytes = _mm256_mask_i32gather_epi32(_mm256_setzero_si256(), reinterpret_cast<const int*>(image),
+                                                        start, mask, 1);
+            bytes = _mm256_srlv_epi32(bytes, _mm256_and_si256(not_first, _mm256_set1_epi32(8)));
+
+            bytes = _mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(bytes, pack), join);
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + x * 3), bytes);
+        }
+        return x;
+    }
+
+    // Same as packRgb8Scalar, gathering like resampleRgb8Avx2 but storing exactly 8 values
+    __attribute__((target("avx2")))
+    int packRgb8Avx2(const uint8_t* image, int image_width, const CornerPixels& pixels, int width, uint32_t* out)
+    {
+        const __m256i one = _mm256_set1_epi32(1), three = _mm256_set1_epi32(3);
+        const __m256i row_pixels = _mm256_set1_epi32(image_width);
+        const __m256i out_of_bounds = _mm256_set1_epi32(OUT_OF_BOUNDS_RGB);
+        // r, g, b in the low bytes of each lane to 0x00rrggbb
+        const __m256i pack = _mm256_setr_epi8(2, 1, 0, -128, 6, 5, 4, -128, 10, 9, 8, -128, 14, 13, 12, -128,
+                                              2, 1, 0, -128, 6, 5, 4, -128, 10, 9, 8, -128, 14, 13, 12, -128);
+
+        int x = 0;
+        for (; x + 8 <= width; x += 8)
+        {
+            __m256i x0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pixels.x0 + x));
+            __m256i mask = _mm256_cmpgt_epi32(x0, _mm256_set1_epi32(-1));
+            __m256i x1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pixels.x1 + x));
+            __m256i y1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pixels.y1 + x));
+            __m256i index = _mm256_and_si256(_mm256_mullo_epi32(_mm256_add_epi32(_mm256_mullo_epi32(y1, row_pixels), x1), three),
+                                             mask);
+
+            __m256i not_first = _mm256_cmpgt_epi32(index, _mm256_setzero_si256());
+            __m256i start = _mm256_sub_epi32(index, _mm256_and_si256(not_first, one));
+            __m256i bytes = _mm256_mask_i32gather_epi32(_mm256_setzero_si256(), reinterpret_cast<const int*>(image),
+                                                        start, mask, 1);
+            bytes = _mm256_srlv_epi32(bytes, _mm256_and_si256(not_first, _mm256_set1_epi32(8)));
+
+            bytes = _mm256_blendv_epi8(out_of_bounds, _mm256_shuffle_epi8(bytes, pack), mask);
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + x), bytes);
+        }
+        return x;
+    }
+
+    corner_kernel chooseKernel()
+    {
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2"))
+            return projectCornersAvx2;
+        if (__builtin_cpu_supports("sse4.2"))
+            return projectCornersSse42;
+        return nullptr;
+    }
+
+    corner_kernel cornerKernel(const rs2_intrinsics& other)
+    {
+        static const corner_kernel kernel = chooseKernel();
+        bool supported = (RS2_DISTORTION_NONE == other.model || RS2_DISTORTION_MODIFIED_BROWN_CONRADY == other.model);
+        return supported ? kernel : nullptr;
+    }
+
+    bool detectAvx2()
+    {
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("avx2");
+    }
+
+    bool resampleAvx2Supported()
+    {
+        static const bool supported = detectAvx2();
+        return supported;
+    }
+#endif
+}
+
+void DepthAligner::update(const rs2_intrinsics& depth_intrin)
+{
+    if (!_corner_x.empty() && sameIntrinsics(depth_intrin, _depth_intrin))
+        return;
+
+    _depth_intrin = depth_intrin;
+    auto corners = (depth_intrin.width + 1) * (depth_intrin.height + 1);
+    _corner_x.resize(corners);
+    _corner_y.resize(corners);
+    for (int y = 0; y <= depth_intrin.height; ++y)
+    {
+        for (int x = 0; x <= depth_intrin.width; ++x)
+        {
+            float pixel[2] = {x - 0.5f, y - 0.5f}, ray[3];
+            rs2_deproject_pixel_to_point(ray, &depth_intrin, pixel, 1.f);
+            auto index = y * (depth_intrin.width + 1) + x;
+            _corner_x[index] = ray[0];
+            _corner_y[index] = ray[1];
+        }
+    }
+}
+
+void DepthAligner::projectRows(int y_begin, int y_end, const uint16_t* depth, float depth_scale,
+                               const std::vector<Target>& targets, Tile& tile) const
+{
+    const int width = _depth_intrin.width;
+    const size_t size = static_cast<size_t>(y_end - y_begin) * width;
+
+    tile.resize(targets.size());
+    for (size_t k = 0; k < targets.size(); ++k)
+    {
+        tile[k].x0.resize(size);
+        tile[k].y0.resize(size);
+        tile[k].x1.resize(size);
+        tile[k].y1.resize(size);
+        tile[k].touched = {targets[k].intrinsics.height, -1};
+    }
+
+    for (int y = y_begin; y < y_end; ++y)
+    {
+        auto depth_row = depth + y * width;
+        auto top = y * (width + 1), bottom = (y + 1) * (width + 1) + 1;
+        CornerRow row = {{_corner_x.data() + top, _corner_y.data() + top},
+                         {_corner_x.data() + bottom, _corner_y.data() + bottom}};
+        auto offset = (y - y_begin) * width;
+
+        // All targets while the row and its rays are in cache
+        for (size_t k = 0; k < targets.size(); ++k)
+        {
+            const auto& other = targets[k].intrinsics;
+            const auto& extrin = targets[k].depth_to_other;
+            auto& corners = tile[k];
+            CornerPixels pixels = {corners.x0.data() + offset, corners.y0.data() + offset,
+                                   corners.x1.data() + offset, corners.y1.data() + offset};
+
+            int x = 0;
+#ifdef REALSENSE2_CAMERA_X86_KERNELS
+            auto kernel = cornerKernel(other);
+            if (kernel)
+                x = kernel(row, depth_row, depth_scale, width, extrin, other, pixels);
+#endif
+            projectCornersScalar(row, depth_row, depth_scale, x, width, extrin, other, pixels);
+
+            // Drop depth pixels with the value of zero, rectangles out of the image and inverted ones,
+            // which a strong rotation or distortion can produce and writeRows can't bound
+            for (x = 0; x < width; ++x)
+            {
+                auto x0 = pixels.x0[x], y0 = pixels.y0[x], x1 = pixels.x1[x], y1 = pixels.y1[x];
+                if (!depth_row[x] || x0 < 0 || y0 < 0 || x1 >= other.width || y1 >= other.height || x1 < x0 || y1 < y0)
+                {
+                    pixels.x0[x] = -1;
+                    continue;
+                }
+                corners.touched.first = std::min(corners.touched.first, y0);
+                corners.touched.last = std::max(corners.touched.last, y1);
+            }
+
+            if (targets[k].image_out)
+            {
+                auto bpp = targets[k].image_bpp;
+                auto image_row = targets[k].image_out->data() + static_cast<size_t>(y) * width * bpp;
+                x = 0;
+#ifdef REALSENSE2_CAMERA_X86_KERNELS
+                if (3 == bpp && resampleAvx2Supported())
+                    x = resampleRgb8Avx2(targets[k].image, other.width, pixels, width, image_row);
+#endif
+                resampleScalar(targets[k].image, other.width, bpp, pixels, x, width, image_row);
+            }
+            if (targets[k].rgb_out)
+            {
+                auto rgb_row = targets[k].rgb_out->data() + static_cast<size_t>(y) * width;
+                x = 0;
+#ifdef REALSENSE2_CAMERA_X86_KERNELS
+                if (resampleAvx2Supported())
+                    x = packRgb8Avx2(targets[k].image, other.width, pixels, width, rgb_row);
+#endif
+                packRgb8Scalar(targets[k].image, other.width, pixels, x, width, rgb_row);
+            }
+        }
+    }
+}
+
+void DepthAligner::writeRows(int y_begin, int y_end, const uint16_t* depth, float depth_scale, bool z_buffer,
+                             const std::vector<Target>& targets, const std::vector<int>* shared_rows,
+                             const Tile& tile) const
+{
+    const int width = _depth_intrin.width;
+    static const auto meter_to_mm = 0.001f;
+    const float to_mm = depth_scale / meter_to_mm;
+
+    for (size_t k = 0; k < targets.size(); ++k)
+    {
+        if (!targets[k].out)
+            continue;
+
+        const int other_width = targets[k].intrinsics.width;
+        auto out = reinterpret_cast<uint16_t*>(targets[k].out->data());
+        auto shared = shared_rows ? shared_rows[k].data() : nullptr;
+        const auto& corners = tile[k];
+
+        for (int y = y_begin; y < y_end; ++y)
+        {
+            auto depth_row = depth + y * width;
+            auto offset = (y - y_begin) * width;
+            for (int x = 0; x < width; ++x)
+            {
+                auto x0 = corners.x0[offset + x];
+                if (x0 < 0)
+                    continue;
+
+                auto x1 = corners.x1[offset + x], y0 = corners.y0[offset + x], y1 = corners.y1[offset + x];
+                uint16_t value = depth_row[x] * to_mm;
+                for (int other_y = y0; other_y <= y1; ++other_y)
+                {
+                    auto begin = out + other_y * other_width + x0, end = out + other_y * other_width + x1 + 1;
+                    if (!z_buffer)
+                        std::fill(begin, end, value);
+                    else if (!value)
+                        break;   // Depth under a millimeter reads as empty, it can never be the nearest
+                    else if (shared && shared[other_y] > 1)
+                        std::for_each(begin, end, [value](uint16_t& pixel){ keepNearestAtomic(&pixel, value); });
+                    else
+                        std::for_each(begin, end, [value](uint16_t& pixel){ keepNearest(&pixel, value); });
+                }
+            }
+        }
+    }
+}
+
+void DepthAligner::align(const rs2_intrinsics& depth_intrin, const uint16_t* depth, float depth_scale, bool z_buffer,
+                         const std::vector<Target>& targets, WorkerPool& pool)
+{
+    update(depth_intrin);
+
+    // Clear what the last image aligned into each buffer covered; unknown buffers are cleared whole
+    auto& touched = _touched;
+    touched.resize(targets.size());
+    const size_t pixels = static_cast<size_t>(_depth_intrin.width) * _depth_intrin.height;
+    for (size_t k = 0; k < targets.size(); ++k)
+    {
+        touched[k] = {targets[k].intrinsics.height, -1};
+        // Resampled images are written whole
+        if (targets[k].image_out)
+            targets[k].image_out->resize(pixels * targets[k].image_bpp);
+        if (targets[k].rgb_out)
+            targets[k].rgb_out->resize(pixels);
+        if (!targets[k].out)
+            continue;
+
+        auto& out = *targets[k].out;
+        const size_t bytes = targets[k].intrinsics.width * targets[k].intrinsics.height * sizeof(uint16_t);
+        auto dirty = _dirty_bytes.find(out.data());
+        if (out.size() != bytes || dirty == _dirty_bytes.end())
+        {
+            out.resize(bytes);
+            std::memset(out.data(), 0, bytes);
+        }
+        else
+        {
+            std::memset(out.data() + dirty->second.first, 0, dirty->second.second - dirty->second.first);
+        }
+    }
+
+    auto tiles = (_depth_intrin.height + TILE_ROWS - 1) / TILE_ROWS;
+    auto tile_begin = [](int index){ return index * TILE_ROWS; };
+    auto tile_end = [this](int index){ return std::min(_depth_intrin.height, (index + 1) * TILE_ROWS); };
+    auto add_touched = [&](const Tile& tile)
+    {
+        for (size_t k = 0; k < targets.size(); ++k)
+        {
+            touched[k].first = std::min(touched[k].first, tile[k].touched.first);
+            touched[k].last = std::max(touched[k].last, tile[k].touched.last);
+        }
+    };
+
+    if (z_buffer && pool.size() > 0)
+    {
+        // Project every tile first, so the rows more than one tile writes to are known
+        // and only those need atomics
+        if (_tiles.size() < static_cast<size_t>(tiles))
+            _tiles.resize(tiles);
+        pool.parallelFor(tiles, [&](int index)
+        {
+            projectRows(tile_begin(index), tile_end(index), depth, depth_scale, targets, _tiles[index]);
+        });
+
+        _shared_rows.resize(targets.size());
+        for (size_t k = 0; k < targets.size(); ++k)
+        {
+            auto& shared = _shared_rows[k];
+            shared.assign(targets[k].intrinsics.height + 1, 0);
+            for (int index = 0; index < tiles; ++index)
+            {
+                const auto& rows = _tiles[index][k].touched;
+                if (rows.first > rows.last)
+                    continue;
+                ++shared[rows.first];
+                --shared[rows.last + 1];
+            }
+            // Running sum of the band starts and ends: the number of tiles writing to each row
+            for (size_t y = 1; y < shared.size(); ++y)
+                shared[y] += shared[y - 1];
+        }
+        for (int index = 0; index < tiles; ++index)
+            add_touched(_tiles[index]);
+
+        pool.parallelFor(tiles, [&](int index)
+        {
+            writeRows(tile_begin(index), tile_end(index), depth, depth_scale, z_buffer, targets, _shared_rows.data(),
+                      _tiles[index]);
+        });
+    }
+    else
+    {
+        // Last writer wins only means something in row order. One tile of scratch is reused,
+        // it stays in cache between projecting and writing.
+        if (_tiles.empty())
+            _tiles.resize(1);
+        for (int index = 0; index < tiles; ++index)
+        {
+            projectRows(tile_begin(index), tile_end(index), depth, depth_scale, targets, _tiles[0]);
+            writeRows(tile_begin(index), tile_end(index), depth, depth_scale, z_buffer, targets, nullptr, _tiles[0]);
+            add_touched(_tiles[0]);
+        }
+    }
+
+    // Buffers that were freed meanwhile would pile up, start over now and then
+    if (_dirty_bytes.size() >= MAX_TRACKED_BUFFERS)
+        _dirty_bytes.clear();
+    for (size_t k = 0; k < targets.size(); ++k)
+    {
+        if (!targets[k].out)
+            continue;
+
+        const uint8_t* data = targets[k].out->data();
+        const size_t row_bytes = targets[k].intrinsics.width * sizeof(uint16_t);
+        const auto& rows = touched[k];
+        _dirty_bytes[data] = rows.first <= rows.last ?
+            std::make_pair(rows.first * row_bytes, (rows.last + 1) * row_bytes) : std::make_pair(size_t(0), size_t(0));
+    }
+}
+
+rs2_intrinsics realsense2_camera::scaleIntrinsics(const rs2_intrinsics& intrin, double scale)
+{
+    rs2_intrinsics scaled = intrin;
+    scaled.width = std::max(1, static_cast<int>(std::lround(intrin.width * scale)));
+    scaled.height = std::max(1, static_cast<int>(std::lround(intrin.height * scale)));
+    float scale_x = static_cast<float>(scaled.width) / intrin.width;
+    float scale_y = static_cast<float>(scaled.height) / intrin.height;
+    scaled.fx = intrin.fx * scale_x;
+    scaled.fy = intrin.fy * scale_y;
+    scaled.ppx = (intrin.ppx + 0.5f) * scale_x - 0.5f;
+    scaled.ppy = (intrin.ppy + 0.5f) * scale_y - 0.5f;
+    return scaled;
+}
@@ -0,0 +1,177 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2018 Intel Corporation. All Rights Reserved
+
+#include <realsense2_camera/normal_estimation.h>
+
+#include <algorithm>
+#include <cstring>
+#include <cmath>
+#include <limits>
+
+using namespace realsense2_camera;
+
+namespace
+{
+    /**
+    Eigenvector of the smallest eigenvalue of a symmetric positive semidefinite 3x3 matrix, given as
+    xx, xy, xz, yy, yz, zz, and that eigenvalue over the sum of all three (the trace).
+    The eigenvalue is the smallest root of the characteristic polynomial, found by Newton steps from 0:
+    the polynomial is decreasing and convex below that root, so the steps never overshoot, and a
+    surface has one eigenvalue far below the others, which takes few steps. The eigenvector is the
+    longest cross product of two rows of (m - lambda I), like PCL's eigen33. Closed form trig roots
+    or a general solver cost several times more, and this runs once per point.
+    Returns false when the smallest eigenvalue is not unique (isotropic or collinear points).
+    */
+    bool smallestEigenvector(const double* m, double* vector, double& curvature)
+    {
+        // Scale to avoid overflow and loss of precision
+        double scale = 0.0;
+        for (int i = 0; i < 6; ++i)
+            scale = std::max(scale, std::abs(m[i]));
+        if (scale <= 0.0)
+            return false;
+        double xx = m[0] / scale, xy = m[1] / scale, xz = m[2] / scale;
+        double yy = m[3] / scale, yz = m[4] / scale, zz = m[5] / scale;
+
+        // det(m - l I) = c0 - c1 l + c2 l^2 - l^3
+        double c2 = xx + yy + zz;
+        double c1 = xx * yy + xx * zz + yy * zz - xy * xy - xz * xz - yz * yz;
+        double c0 = xx * (yy * zz - yz * yz) - xy * (xy * zz - yz * xz) + xz * (xy * yz - yy * xz);
+        double smallest = 0.0;
+        for (int i = 0; i < 16; ++i)
+        {
+            double value = c0 + smallest * (-c1 + smallest * (c2 - smallest));
+            double slope = -c1 + smallest * (2.0 * c2 - 3.0 * smallest);
+            if (value <= 0.0 || slope >= 0.0)
+                break;
+            double step = -value / slope;
+            smallest += step;
+            if (step <= 1e-12 * c2)
+                break;
+        }
+
+        double row0[3] = {xx - smallest, xy, xz};
+        double row1[3] = {xy, yy - smallest, yz};
+        double row2[3] = {xz, yz, zz - smallest};
+        auto cross = [](const double* a, const double* b, double* c)
+        {
+            c[0] = a[1] * b[2] - a[2] * b[1];
+            c[1] = a[2] * b[0] - a[0] * b[2];
+            c[2] = a[0] * b[1] - a[1] * b[0];
+            return c[0] * c[0] + c[1] * c[1] + c[2] * c[2];
+        };
+        double c01[3], c02[3], c12[3];
+        double n01 = cross(row0, row1, c01), n02 = cross(row0, row2, c02), n12 = cross(row1, row2, c12);
+        const double* best = c01;
+        double norm = n01;
+        if (n02 > norm)
+        {
+            best = c02;
+            norm = n02;
+        }
+        if (n12 > norm)
+        {
+            best = c12;
+            norm = n12;
+        }
+        if (norm <= std::numeric_limits<double>::epsilon())
+            return false;
+
+        norm = 1.0 / std::sqrt(norm);
+        for (int i = 0; i < 3; ++i)
+            vector[i] = best[i] * norm;
+        curvature = smallest / c2;
+        return true;
+    }
+}
+
+void NormalEstimation::resize(int width, int height)
+{
+    _width = width;
+    _height = height;
+    _sums.resize((width + 1) * (height + 1));
+    std::memset(row(0), 0, (width + 1) * sizeof(Sums));
+}
+
+void NormalEstimation::addRow(int y, const float* points, int point_step)
+{
+    auto sums = row(y + 1);
+    std::memset(sums, 0, sizeof(Sums));
+    for (int x = 0; x < _width; ++x, points += point_step)
+    {
+        const auto& left = sums[x];
+        auto& s = sums[x + 1];
+        double px = points[0], py = points[1], pz = points[2];
+        bool valid = (0.0 != px || 0.0 != py || 0.0 != pz);
+        s.count = left.count + (valid ? 1.0 : 0.0);
+        s.x = left.x + px;
+        s.y = left.y + py;
+        s.z = left.z + pz;
+        s.xx = left.xx + px * px;
+        s.xy = left.xy + px * py;
+        s.xz = left.xz + px * pz;
+        s.yy = left.yy + py * py;
+        s.yz = left.yz + py * pz;
+        s.zz = left.zz + pz * pz;
+    }
+}
+
+void NormalEstimation::integrateColumns(int begin, int end)
+{
+    // Sums is all doubles, add it as an array
+    const int channels = sizeof(Sums) / sizeof(double);
+    for (int y = 1; y <= _height; ++y)
+    {
+        auto above = reinterpret_cast<const double*>(row(y - 1) + begin + 1);
+        auto sums = reinterpret_cast<double*>(row(y) + begin + 1);
+        for (int i = 0; i < (end - begin) * channels; ++i)
+            sums[i] += above[i];
+    }
+}
+
+void NormalEstimation::computeRow(int y, int half_window, const float* viewpoint, float* points, int point_step) const
+{
+    const float nan = std::numeric_limits<float>::quiet_NaN();
+    auto top = row(std::max(0, y - half_window));
+    auto bottom = row(std::min(_height, y + half_window + 1));
+
+    for (int x = 0; x < _width; ++x, points += point_step)
+    {
+        auto out = points + 4;
+        bool valid = (0.f != points[0] || 0.f != points[1] || 0.f != points[2]);
+        auto left = std::max(0, x - half_window);
+        auto right = std::min(_width, x + half_window + 1);
+        double count = bottom[right].count - bottom[left].count - top[right].count + top[left].count;
+        double normal[3], curvature;
+        if (!valid || count < 3.0)
+        {
+            out[0] = out[1] = out[2] = out[4] = nan;
+            continue;
+        }
+
+        auto sum = [&](double Sums::* channel)
+        {
+            return bottom[right].*channel - bottom[left].*channel - top[right].*channel + top[left].*channel;
+        };
+        double mean[3] = {sum(&Sums::x) / count, sum(&Sums::y) / count, sum(&Sums::z) / count};
+        double covariance[6] = {sum(&Sums::xx) / count - mean[0] * mean[0],
+                                sum(&Sums::xy) / count - mean[0] * mean[1],
+                                sum(&Sums::xz) / count - mean[0] * mean[2],
+                                sum(&Sums::yy) / count - mean[1] * mean[1],
+                                sum(&Sums::yz) / count - mean[1] * mean[2],
+                                sum(&Sums::zz) / count - mean[2] * mean[2]};
+        if (!smallestEigenvector(covariance, normal, curvature))
+        {
+            out[0] = out[1] = out[2] = out[4] = nan;
+            continue;
+        }
+
+        double facing = normal[0] * (viewpoint[0] - points[0]) + normal[1] * (viewpoint[1] - points[1]) +
+                        normal[2] * (viewpoint[2] - points[2]);
+        double sign = facing < 0.0 ? -1.0 : 1.0;
+        out[0] = static_cast<float>(sign * normal[0]);
+        out[1] = static_cast<float>(sign * normal[1]);
+        out[2] = static_cast<float>(sign * normal[2]);
+        out[4] = static_cast<float>(curvature);
+    }
+}
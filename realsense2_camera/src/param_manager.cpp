@@ -17,6 +17,15 @@ void RealSenseParamManager<Model>::setOption(RealSenseNode* node_ptr,stream_inde
     node_ptr->_sensors[sip].set_option(opt, val);
 }
 
+template<uint16_t Model>
+void RealSenseParamManager<Model>::enableFilter(RealSenseNode* node_ptr, filters type, bool enable)
+{
+    // Filters left out of the filters parameter are not in the chain, their options are still kept
+    auto filter = node_ptr->findFilter(type);
+    if (filter)
+        filter->is_enabled = enable;
+}
+
 
 template<>
 void RealSenseParamManager<SR300_PID>::setParam(RealSenseNode* node_ptr, typename ModelTraits<SR300_PID>::Config &config, Param param)
@@ -174,47 +183,78 @@ void RealSenseParamManager<RS400_PID>::setParam(RealSenseNode* node_ptr, typenam
     }
     case base_enable_depth_to_disparity_filter:
         ROS_DEBUG_STREAM("base_enable_depth_to_disparity_filter: " << config.base_enable_depth_to_disparity_filter);
-        node_ptr->filters[DEPTH_TO_DISPARITY].is_enabled = config.base_enable_depth_to_disparity_filter;
+        enableFilter(node_ptr, DEPTH_TO_DISPARITY, config.base_enable_depth_to_disparity_filter);
         break;
     case base_enable_spatial_filter:
         ROS_DEBUG_STREAM("base_enable_spatial_filter: " << config.base_enable_spatial_filter);
-        node_ptr->filters[SPATIAL].is_enabled = config.base_enable_spatial_filter;
+        enableFilter(node_ptr, SPATIAL, config.base_enable_spatial_filter);
         break;
     case base_enable_temporal_filter:
         ROS_DEBUG_STREAM("base_enable_temporal_filter: " << config.base_enable_temporal_filter);
-        node_ptr->filters[TEMPORAL].is_enabled = config.base_enable_temporal_filter;
+        enableFilter(node_ptr, TEMPORAL, config.base_enable_temporal_filter);
         break;
     case base_enable_disparity_to_depth_filter:
         ROS_DEBUG_STREAM("base_enable_disparity_to_depth_filter: " << config.base_enable_disparity_to_depth_filter);
-        node_ptr->filters[DISPARITY_TO_DEPTH].is_enabled = config.base_enable_disparity_to_depth_filter;
+        enableFilter(node_ptr, DISPARITY_TO_DEPTH, config.base_enable_disparity_to_depth_filter);
         break;
     case base_spatial_filter_magnitude:
         ROS_DEBUG_STREAM("base_spatial_filter_magnitude: " << config.base_spatial_filter_magnitude);
-        node_ptr->filters[SPATIAL].filter.set_option(RS2_OPTION_FILTER_MAGNITUDE, config.base_spatial_filter_magnitude);
+        node_ptr->spat_filter.set_option(RS2_OPTION_FILTER_MAGNITUDE, config.base_spatial_filter_magnitude);
         break;
     case base_spatial_filter_smooth_alpha:
         ROS_DEBUG_STREAM("base_spatial_filter_smooth_alpha: " << config.base_spatial_filter_smooth_alpha);
-        node_ptr->filters[SPATIAL].filter.set_option(RS2_OPTION_FILTER_SMOOTH_ALPHA, config.base_spatial_filter_smooth_alpha);
+        node_ptr->spat_filter.set_option(RS2_OPTION_FILTER_SMOOTH_ALPHA, config.base_spatial_filter_smooth_alpha);
         break;
     case base_spatial_filter_smooth_delta:
         ROS_DEBUG_STREAM("base_spatial_filter_smooth_delta: " << config.base_spatial_filter_smooth_delta);
-        node_ptr->filters[SPATIAL].filter.set_option(RS2_OPTION_FILTER_SMOOTH_DELTA, config.base_spatial_filter_smooth_delta);
+        node_ptr->spat_filter.set_option(RS2_OPTION_FILTER_SMOOTH_DELTA, config.base_spatial_filter_smooth_delta);
         break;
     case base_spatial_filter_holes_fill:
         ROS_DEBUG_STREAM("base_spatial_filter_holes_fill: " << config.base_spatial_filter_holes_fill);
-        node_ptr->filters[SPATIAL].filter.set_option(RS2_OPTION_HOLES_FILL, config.base_spatial_filter_holes_fill);
+        node_ptr->spat_filter.set_option(RS2_OPTION_HOLES_FILL, config.base_spatial_filter_holes_fill);
         break;
     case base_temporal_filter_smooth_alpha:
         ROS_DEBUG_STREAM("base_temporal_filter_smooth_alpha: " << config.base_temporal_filter_smooth_alpha);
-        node_ptr->filters[TEMPORAL].filter.set_option(RS2_OPTION_FILTER_SMOOTH_ALPHA, config.base_temporal_filter_smooth_alpha);
+        node_ptr->temp_filter.set_option(RS2_OPTION_FILTER_SMOOTH_ALPHA, config.base_temporal_filter_smooth_alpha);
         break;
     case base_temporal_filter_smooth_delta:
         ROS_DEBUG_STREAM("base_temporal_filter_smooth_delta: " << config.base_temporal_filter_smooth_delta);
-        node_ptr->filters[TEMPORAL].filter.set_option(RS2_OPTION_FILTER_SMOOTH_DELTA, config.base_temporal_filter_smooth_delta);
+        node_ptr->temp_filter.set_option(RS2_OPTION_FILTER_SMOOTH_DELTA, config.base_temporal_filter_smooth_delta);
         break;
     case base_temporal_filter_holes_fill:
         ROS_DEBUG_STREAM("base_temporal_filter_holes_fill: " << config.base_temporal_filter_holes_fill);
-        node_ptr->filters[TEMPORAL].filter.set_option(RS2_OPTION_HOLES_FILL, config.base_temporal_filter_holes_fill);
+        node_ptr->temp_filter.set_option(RS2_OPTION_HOLES_FILL, config.base_temporal_filter_holes_fill);
+        break;
+    case base_enable_decimation_filter:
+        ROS_DEBUG_STREAM("base_enable_decimation_filter: " << config.base_enable_decimation_filter);
+        enableFilter(node_ptr, DECIMATION, config.base_enable_decimation_filter);
+        break;
+    case base_decimation_filter_magnitude:
+        ROS_DEBUG_STREAM("base_decimation_filter_magnitude: " << config.base_decimation_filter_magnitude);
+        node_ptr->dec_filter.set_option(RS2_OPTION_FILTER_MAGNITUDE, config.base_decimation_filter_magnitude);
+        break;
+    case base_enable_threshold_filter:
+        ROS_DEBUG_STREAM("base_enable_threshold_filter: " << config.base_enable_threshold_filter);
+        enableFilter(node_ptr, THRESHOLD, config.base_enable_threshold_filter);
+        break;
+    case base_threshold_filter_min_distance:
+        ROS_DEBUG_STREAM("base_threshold_filter_min_distance: " << config.base_threshold_filter_min_distance);
+        node_ptr->thresh_filter.set_option(RS2_OPTION_MIN_DISTANCE, config.base_threshold_filter_min_distance);
+        break;
+    case base_threshold_filter_max_distance:
+        ROS_DEBUG_STREAM("base_threshold_filter_max_distance: " << config.base_threshold_filter_max_distance);
+        // 0 is no limit, the farthest the filter takes
+        node_ptr->thresh_filter.set_option(RS2_OPTION_MAX_DISTANCE, (0 == config.base_threshold_filter_max_distance) ?
+                                           node_ptr->thresh_filter.get_option_range(RS2_OPTION_MAX_DISTANCE).max :
+                                           config.base_threshold_filter_max_distance);
+        break;
+    case base_enable_hole_filling_filter:
+        ROS_DEBUG_STREAM("base_enable_hole_filling_filter: " << config.base_enable_hole_filling_filter);
+        enableFilter(node_ptr, HOLE_FILLING, config.base_enable_hole_filling_filter);
+        break;
+    case base_hole_filling_filter_mode:
+        ROS_DEBUG_STREAM("base_hole_filling_filter_mode: " << config.base_hole_filling_filter_mode);
+        node_ptr->hole_filling_filter.set_option(RS2_OPTION_HOLES_FILL, config.base_hole_filling_filter_mode);
         break;
     default:
         ROS_WARN_STREAM("Unrecognized D400 param (" << param << ")");
@@ -284,47 +324,47 @@ void RealSenseParamManager<RS435_RGB_PID>::setParam(RealSenseNode* node_ptr, typ
     }
     case base_enable_depth_to_disparity_filter:
         ROS_DEBUG_STREAM("base_enable_depth_to_disparity_filter: " << config.rs435_enable_depth_to_disparity_filter);
-        node_ptr->filters[DEPTH_TO_DISPARITY].is_enabled = config.rs435_enable_depth_to_disparity_filter;
+        enableFilter(node_ptr, DEPTH_TO_DISPARITY, config.rs435_enable_depth_to_disparity_filter);
         break;
     case base_enable_spatial_filter:
         ROS_DEBUG_STREAM("base_enable_spatial_filter: " << config.rs435_enable_spatial_filter);
-        node_ptr->filters[SPATIAL].is_enabled = config.rs435_enable_spatial_filter;
+        enableFilter(node_ptr, SPATIAL, config.rs435_enable_spatial_filter);
         break;
     case base_enable_temporal_filter:
         ROS_DEBUG_STREAM("base_enable_temporal_filter: " << config.rs435_enable_temporal_filter);
-        node_ptr->filters[TEMPORAL].is_enabled = config.rs435_enable_temporal_filter;
+        enableFilter(node_ptr, TEMPORAL, config.rs435_enable_temporal_filter);
         break;
     case base_enable_disparity_to_depth_filter:
         ROS_DEBUG_STREAM("base_enable_disparity_to_depth_filter: " << config.rs435_enable_disparity_to_depth_filter);
-        node_ptr->filters[DISPARITY_TO_DEPTH].is_enabled = config.rs435_enable_disparity_to_depth_filter;
+        enableFilter(node_ptr, DISPARITY_TO_DEPTH, config.rs435_enable_disparity_to_depth_filter);
         break;
     case base_spatial_filter_magnitude:
         ROS_DEBUG_STREAM("base_spatial_filter_magnitude: " << config.rs435_spatial_filter_magnitude);
-        node_ptr->filters[SPATIAL].filter.set_option(RS2_OPTION_FILTER_MAGNITUDE, config.rs435_spatial_filter_magnitude);
+        node_ptr->spat_filter.set_option(RS2_OPTION_FILTER_MAGNITUDE, config.rs435_spatial_filter_magnitude);
         break;
     case base_spatial_filter_smooth_alpha:
         ROS_DEBUG_STREAM("base_spatial_filter_smooth_alpha: " << config.rs435_spatial_filter_smooth_alpha);
-        node_ptr->filters[SPATIAL].filter.set_option(RS2_OPTION_FILTER_SMOOTH_ALPHA, config.rs435_spatial_filter_smooth_alpha);
+        node_ptr->spat_filter.set_option(RS2_OPTION_FILTER_SMOOTH_ALPHA, config.rs435_spatial_filter_smooth_alpha);
         break;
     case base_spatial_filter_smooth_delta:
         ROS_DEBUG_STREAM("base_spatial_filter_smooth_delta: " << config.rs435_spatial_filter_smooth_delta);
-        node_ptr->filters[SPATIAL].filter.set_option(RS2_OPTION_FILTER_SMOOTH_DELTA, config.rs435_spatial_filter_smooth_delta);
+        node_ptr->spat_filter.set_option(RS2_OPTION_FILTER_SMOOTH_DELTA, config.rs435_spatial_filter_smooth_delta);
         break;
     case base_spatial_filter_holes_fill:
         ROS_DEBUG_STREAM("base_spatial_filter_holes_fill: " << config.rs435_spatial_filter_holes_fill);
-        node_ptr->filters[SPATIAL].filter.set_option(RS2_OPTION_HOLES_FILL, config.rs435_spatial_filter_holes_fill);
+        node_ptr->spat_filter.set_option(RS2_OPTION_HOLES_FILL, config.rs435_spatial_filter_holes_fill);
         break;
     case base_temporal_filter_smooth_alpha:
         ROS_DEBUG_STREAM("base_temporal_filter_smooth_alpha: " << config.rs435_temporal_filter_smooth_alpha);
-        node_ptr->filters[TEMPORAL].filter.set_option(RS2_OPTION_FILTER_SMOOTH_ALPHA, config.rs435_temporal_filter_smooth_alpha);
+        node_ptr->temp_filter.set_option(RS2_OPTION_FILTER_SMOOTH_ALPHA, config.rs435_temporal_filter_smooth_alpha);
         break;
     case base_temporal_filter_smooth_delta:
         ROS_DEBUG_STREAM("base_temporal_filter_smooth_delta: " << config.rs435_temporal_filter_smooth_delta);
-        node_ptr->filters[TEMPORAL].filter.set_option(RS2_OPTION_FILTER_SMOOTH_DELTA, config.rs435_temporal_filter_smooth_delta);
+        node_ptr->temp_filter.set_option(RS2_OPTION_FILTER_SMOOTH_DELTA, config.rs435_temporal_filter_smooth_delta);
         break;
     case base_temporal_filter_holes_fill:
         ROS_DEBUG_STREAM("base_temporal_filter_holes_fill: " << config.rs435_temporal_filter_holes_fill);
-        node_ptr->filters[TEMPORAL].filter.set_option(RS2_OPTION_HOLES_FILL, config.rs435_temporal_filter_holes_fill);
+        node_ptr->temp_filter.set_option(RS2_OPTION_HOLES_FILL, config.rs435_temporal_filter_holes_fill);
         break;
     }
     case rs435_color_backlight_compensation:
@@ -426,6 +466,13 @@ void RealSenseParamManager<RS435_RGB_PID>::setParam(RealSenseNode* node_ptr, typ
         base_config.base_temporal_filter_smooth_alpha = config.rs435_temporal_filter_smooth_alpha;
         base_config.base_temporal_filter_smooth_delta = config.rs435_temporal_filter_smooth_delta;
         base_config.base_temporal_filter_holes_fill = config.rs435_temporal_filter_holes_fill;
+        base_config.base_enable_decimation_filter = config.rs435_enable_decimation_filter;
+        base_config.base_decimation_filter_magnitude = config.rs435_decimation_filter_magnitude;
+        base_config.base_enable_threshold_filter = config.rs435_enable_threshold_filter;
+        base_config.base_threshold_filter_min_distance = config.rs435_threshold_filter_min_distance;
+        base_config.base_threshold_filter_max_distance = config.rs435_threshold_filter_max_distance;
+        base_config.base_enable_hole_filling_filter = config.rs435_enable_hole_filling_filter;
+        base_config.base_hole_filling_filter_mode = config.rs435_hole_filling_filter_mode;
         RealSenseParamManager<RS400_PID> d400_param;
         d400_param.setParam(node_ptr, base_config, static_cast<typename RealSenseParamManager<RS400_PID>::Param>(param));
         break;
@@ -547,6 +594,13 @@ void RealSenseParamManager<RS415_PID>::setParam(RealSenseNode* node_ptr, typenam
         base_config.base_temporal_filter_smooth_alpha = config.rs415_temporal_filter_smooth_alpha;
         base_config.base_temporal_filter_smooth_delta = config.rs415_temporal_filter_smooth_delta;
         base_config.base_temporal_filter_holes_fill = config.rs415_temporal_filter_holes_fill;
+        base_config.base_enable_decimation_filter = config.rs415_enable_decimation_filter;
+        base_config.base_decimation_filter_magnitude = config.rs415_decimation_filter_magnitude;
+        base_config.base_enable_threshold_filter = config.rs415_enable_threshold_filter;
+        base_config.base_threshold_filter_min_distance = config.rs415_threshold_filter_min_distance;
+        base_config.base_threshold_filter_max_distance = config.rs415_threshold_filter_max_distance;
+        base_config.base_enable_hole_filling_filter = config.rs415_enable_hole_filling_filter;
+        base_config.base_hole_filling_filter_mode = config.rs415_hole_filling_filter_mode;
         RealSenseParamManager<RS400_PID> d400_param;
         d400_param.setParam(node_ptr, base_config, static_cast<typename RealSenseParamManager<RS400_PID>::Param>(param));
         break;
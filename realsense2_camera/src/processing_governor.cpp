@@ -0,0 +1,91 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2018 Intel Corporation. All Rights Reserved
+
+#include <realsense2_camera/processing_governor.h>
+
+#include <algorithm>
+
+using namespace realsense2_camera;
+
+namespace
+{
+    const double LOAD_SMOOTHING = 0.1;  // Weight of the newest frame in the average
+    const int SETTLE_FRAMES = 20;       // For the average to forget the previous level, 88% at 0.1
+    const int RESTORE_FRAMES = 60;      // Of low load before a step is given back
+
+    const char* STEP_NAMES[GOVERNOR_STEP_COUNT] = {"temporal", "spatial", "pointcloud_stride", "align_every_other"};
+}
+
+ProcessingGovernor::ProcessingGovernor() :
+    _frame_period(0.0),
+    _high_load(1.0),
+    _low_load(0.0),
+    _load(0.0),
+    _level(0),
+    _frames(0),
+    _low_frames(0)
+{
+}
+
+void ProcessingGovernor::configure(const std::vector<governor_step>& ladder, double frame_period,
+                                   double high_load, double low_load)
+{
+    _ladder = ladder;
+    _frame_period = frame_period;
+    _high_load = high_load;
+    _low_load = low_load;
+    _load = 0.0;
+    _level = 0;
+    _frames = 0;
+    _low_frames = 0;
+}
+
+void ProcessingGovernor::update(double busy_seconds)
+{
+    if (_frame_period <= 0.0)
+        return;
+
+    double load = _load + LOAD_SMOOTHING * (busy_seconds / _frame_period - _load);
+    _load = load;
+    _low_frames = (load < _low_load) ? std::min(_low_frames + 1, RESTORE_FRAMES) : 0;
+    if (_frames < SETTLE_FRAMES)
+    {
+        ++_frames;
+        return;
+    }
+
+    int level = _level;
+    if (load > _high_load && level < static_cast<int>(_ladder.size()))
+    {
+        _level = level + 1;
+        _frames = 0;
+        _low_frames = 0;
+    }
+    else if (RESTORE_FRAMES == _low_frames && level > 0)
+    {
+        _level = level - 1;
+        _frames = 0;
+        _low_frames = 0;
+    }
+}
+
+bool ProcessingGovernor::isDegraded(governor_step step) const
+{
+    auto end = _ladder.begin() + std::min<size_t>(_level, _ladder.size());
+    return std::find(_ladder.begin(), end, step) != end;
+}
+
+const char* ProcessingGovernor::stepName(governor_step step)
+{
+    return (step < GOVERNOR_STEP_COUNT) ? STEP_NAMES[step] : "unknown";
+}
+
+governor_step ProcessingGovernor::parseStep(const std::string& name)
+{
+    for (int step = 0; step < GOVERNOR_STEP_COUNT; ++step)
+    {
+        if (name == STEP_NAMES[step])
+            return static_cast<governor_step>(step);
+    }
+    return GOVERNOR_STEP_COUNT;
+}
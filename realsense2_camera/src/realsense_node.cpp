@@ -26,82 +26,70 @@ RealSenseNode::RealSenseNode(const ros::NodeHandle &nodeHandle,
     _json_file_path(""),
     _base_frame_id(""),
     _intialize_time_base(false),
+    _pointcloud_xyz_pool(MESSAGE_POOL_SIZE),
+    _pointcloud_xyzrgb_pool(MESSAGE_POOL_SIZE),
+    _pointcloud_normals_pool(MESSAGE_POOL_SIZE),
+    _pointcloud_intensity_pool(MESSAGE_POOL_SIZE),
+    _filtered_depth_profile_id(-1),
+    _filtered_depth_intrinsics(),
+    _pipeline_drop_policy(DROP_OLDEST),
+    _align_frames(0),
+    _publish_running(false),
+    _publish_pending(false),
+    _publish_sleeping(false),
     _namespace(getNamespaceStr())
 {
      getParameters();
      getDevice();
 
     // Types for depth stream
-    _is_frame_arrived[DEPTH] = false;
     _format[DEPTH] = RS2_FORMAT_Z16;   // libRS type
-    _image_format[DEPTH] = CV_16UC1;    // CVBridge type
-    _encoding[DEPTH] = sensor_msgs::image_encodings::TYPE_16UC1; // ROS message type
+    streamState(DEPTH).encoding = sensor_msgs::image_encodings::TYPE_16UC1; // ROS message type
     _unit_step_size[DEPTH] = sizeof(uint16_t); // sensor_msgs::ImagePtr row step size
     _stream_name[DEPTH] = "depth";
-    _depth_aligned_encoding[DEPTH] = sensor_msgs::image_encodings::TYPE_16UC1;
+    _depth_aligned_streams[streamId(DEPTH)].encoding = sensor_msgs::image_encodings::TYPE_16UC1;
 
     // Infrared stream - Left
-    _is_frame_arrived[INFRA1] = false;
     _format[INFRA1] = RS2_FORMAT_Y8;   // libRS type
-    _image_format[INFRA1] = CV_8UC1;    // CVBridge type
-    _encoding[INFRA1] = sensor_msgs::image_encodings::TYPE_8UC1; // ROS message type
+    streamState(INFRA1).encoding = sensor_msgs::image_encodings::TYPE_8UC1; // ROS message type
     _unit_step_size[INFRA1] = sizeof(uint8_t); // sensor_msgs::ImagePtr row step size
     _stream_name[INFRA1] = "infra1";
-    _depth_aligned_encoding[INFRA1] = sensor_msgs::image_encodings::TYPE_16UC1;
+    _depth_aligned_streams[streamId(INFRA1)].encoding = sensor_msgs::image_encodings::TYPE_16UC1;
 
     // Infrared stream - Right
-    _is_frame_arrived[INFRA2] = false;
     _format[INFRA2] = RS2_FORMAT_Y8;   // libRS type
-    _image_format[INFRA2] = CV_8UC1;    // CVBridge type
-    _encoding[INFRA2] = sensor_msgs::image_encodings::TYPE_8UC1; // ROS message type
+    streamState(INFRA2).encoding = sensor_msgs::image_encodings::TYPE_8UC1; // ROS message type
     _unit_step_size[INFRA2] = sizeof(uint8_t); // sensor_msgs::ImagePtr row step size
     _stream_name[INFRA2] = "infra2";
-    _depth_aligned_encoding[INFRA2] = sensor_msgs::image_encodings::TYPE_16UC1;
+    _depth_aligned_streams[streamId(INFRA2)].encoding = sensor_msgs::image_encodings::TYPE_16UC1;
 
     // Types for color stream
-    _is_frame_arrived[COLOR] = false;
     _format[COLOR] = RS2_FORMAT_RGB8;   // libRS type
-    _image_format[COLOR] = CV_8UC3;    // CVBridge type
-    _encoding[COLOR] = sensor_msgs::image_encodings::RGB8; // ROS message type
+    streamState(COLOR).encoding = sensor_msgs::image_encodings::RGB8; // ROS message type
     _unit_step_size[COLOR] = 3; // sensor_msgs::ImagePtr row step size
     _stream_name[COLOR] = "color";
-    _depth_aligned_encoding[COLOR] = sensor_msgs::image_encodings::TYPE_16UC1;
+    _depth_aligned_streams[streamId(COLOR)].encoding = sensor_msgs::image_encodings::TYPE_16UC1;
 
     // Types for fisheye stream
-    _is_frame_arrived[FISHEYE] = false;
     _format[FISHEYE] = RS2_FORMAT_RAW8;   // libRS type
-    _image_format[FISHEYE] = CV_8UC1;    // CVBridge type
-    _encoding[FISHEYE] = sensor_msgs::image_encodings::TYPE_8UC1; // ROS message type
+    streamState(FISHEYE).encoding = sensor_msgs::image_encodings::TYPE_8UC1; // ROS message type
     _unit_step_size[FISHEYE] = sizeof(uint8_t); // sensor_msgs::ImagePtr row step size
     _stream_name[FISHEYE] = "fisheye";
-    _depth_aligned_encoding[FISHEYE] = sensor_msgs::image_encodings::TYPE_16UC1;
+    _depth_aligned_streams[streamId(FISHEYE)].encoding = sensor_msgs::image_encodings::TYPE_16UC1;
 
     // Types for Motion-Module streams
-    _is_frame_arrived[GYRO] = false;
     _format[GYRO] = RS2_FORMAT_MOTION_XYZ32F;   // libRS type
-    _image_format[GYRO] = CV_8UC1;    // CVBridge type
-    _encoding[GYRO] = sensor_msgs::image_encodings::TYPE_8UC1; // ROS message type
+    streamState(GYRO).encoding = sensor_msgs::image_encodings::TYPE_8UC1; // ROS message type
     _unit_step_size[GYRO] = sizeof(uint8_t); // sensor_msgs::ImagePtr row step size
     _stream_name[GYRO] = "gyro";
 
-    _is_frame_arrived[ACCEL] = false;
     _format[ACCEL] = RS2_FORMAT_MOTION_XYZ32F;   // libRS type
-    _image_format[ACCEL] = CV_8UC1;    // CVBridge type
-    _encoding[ACCEL] = sensor_msgs::image_encodings::TYPE_8UC1; // ROS message type
+    streamState(ACCEL).encoding = sensor_msgs::image_encodings::TYPE_8UC1; // ROS message type
     _unit_step_size[ACCEL] = sizeof(uint8_t); // sensor_msgs::ImagePtr row step size
     _stream_name[ACCEL] = "accel";
 
-    // TODO: Improve the pipeline to accept decimation filter
     // TODO: Provide disparity map if requested
-    filters.emplace_back("Depth_to_Disparity", depth_to_disparity);
-    filters.emplace_back("Spatial", spat_filter);
-    filters.emplace_back("Temporal", temp_filter);
-    filters.emplace_back("Disparity_to_Depth", disparity_to_depth);
-
-    filters[0].is_enabled = false;
-    filters[1].is_enabled = false;
-    filters[2].is_enabled = false;
-    filters[3].is_enabled = false;
+    setupFilters();
 
     _prev_camera_time_stamp = 0;
 
@@ -114,6 +102,41 @@ RealSenseNode::RealSenseNode(const ros::NodeHandle &nodeHandle,
     }
 }
 
+RealSenseNode::~RealSenseNode()
+{
+    // Sensors and the syncer call back into this node, silence them before the stages go away.
+    // Streams that share a sensor list it more than once, so stop and close may throw here.
+    for (auto& elem : _sensors)
+    {
+        auto& sens = elem.second;
+        if (!sens)
+            continue;
+        try
+        {
+            sens.stop();
+        }
+        catch (const rs2::error&) {}
+        try
+        {
+            sens.close();
+        }
+        catch (const rs2::error&) {}
+    }
+    // Releasing the syncer joins its dispatcher, which may still deliver a queued frameset
+    _syncer = rs2::asynchronous_syncer();
+    depth_callback_timer_.stop();
+
+    _pipeline.stop();
+
+    {
+        std::lock_guard<std::mutex> lock(_publish_mutex);
+        _publish_running = false;
+    }
+    _publish_cv.notify_all();
+    if (_publish_thread.joinable())
+        _publish_thread.join();
+}
+
 void RealSenseNode::createParamsManager() {
     auto pid_str = _dev.get_info(RS2_CAMERA_INFO_PRODUCT_ID);
     uint16_t pid;
@@ -268,9 +291,82 @@ void RealSenseNode::getParameters()
     ROS_INFO("getParameters...");
 
     _pnh.param("align_depth", _align_depth, ALIGN_DEPTH);
+    _pnh.param("align_depth_zbuffer", _align_depth_zbuffer, ALIGN_DEPTH_ZBUFFER);
+    _pnh.param("align_depth_output_scale", _align_depth_output_scale, ALIGN_DEPTH_OUTPUT_SCALE);
+    if (_align_depth_output_scale <= 0.0)
+    {
+        ROS_WARN_STREAM("align_depth_output_scale must be positive, using 1 instead of " << _align_depth_output_scale);
+        _align_depth_output_scale = 1.0;
+    }
+    _pnh.param("filters", _filter_list, FILTERS);
     _pnh.param("enable_pointcloud", _pointcloud, POINTCLOUD);
+    _pnh.param("pointcloud_organized", _pointcloud_organized, POINTCLOUD_ORGANIZED);
+    _pnh.param("pointcloud_stride", _pointcloud_stride, POINTCLOUD_STRIDE);
+    _pnh.param("pointcloud_voxel_leaf", _pointcloud_voxel_leaf, POINTCLOUD_VOXEL_LEAF);
+    _pnh.param("pointcloud_min_z", _pointcloud_min_z, POINTCLOUD_MIN_Z);
+    _pnh.param("pointcloud_max_z", _pointcloud_max_z, POINTCLOUD_MAX_Z);
+    _pnh.param("pointcloud_roi_x", _pointcloud_roi_x, POINTCLOUD_ROI_X);
+    _pnh.param("pointcloud_roi_y", _pointcloud_roi_y, POINTCLOUD_ROI_Y);
+    _pnh.param("pointcloud_roi_width", _pointcloud_roi_width, POINTCLOUD_ROI_WIDTH);
+    _pnh.param("pointcloud_roi_height", _pointcloud_roi_height, POINTCLOUD_ROI_HEIGHT);
+    _pnh.param("pointcloud_bilinear_color", _pointcloud_bilinear_color, POINTCLOUD_BILINEAR_COLOR);
+    _pnh.param("pointcloud_normals", _pointcloud_normals, POINTCLOUD_NORMALS);
+    _pnh.param("pointcloud_normals_window", _pointcloud_normals_window, POINTCLOUD_NORMALS_WINDOW);
+    _pnh.param("pointcloud_intensity", _pointcloud_intensity, POINTCLOUD_INTENSITY);
+    _pnh.param("pointcloud_tile_rows", _pointcloud_tile_rows, POINTCLOUD_TILE_ROWS);
+    _pnh.param("worker_threads", _worker_threads, WORKER_THREADS);
+    if (_pointcloud_stride < 1)
+    {
+        ROS_WARN_STREAM("pointcloud_stride must be at least 1, using 1 instead of " << _pointcloud_stride);
+        _pointcloud_stride = 1;
+    }
+    if (_pointcloud_normals_window < 3 || 0 == _pointcloud_normals_window % 2)
+    {
+        ROS_WARN_STREAM("pointcloud_normals_window must be odd and at least 3, using " << POINTCLOUD_NORMALS_WINDOW
+                        << " instead of " << _pointcloud_normals_window);
+        _pointcloud_normals_window = POINTCLOUD_NORMALS_WINDOW;
+    }
+    if (_pointcloud_tile_rows < 1)
+    {
+        ROS_WARN_STREAM("pointcloud_tile_rows must be at least 1, using " << POINTCLOUD_TILE_ROWS
+                        << " instead of " << _pointcloud_tile_rows);
+        _pointcloud_tile_rows = POINTCLOUD_TILE_ROWS;
+    }
     _pnh.param("enable_sync", _sync_frames, SYNC_FRAMES);
     _pnh.param("enable_ros_time", _use_ros_time, USE_ROS_TIME);
+    _pnh.param("pipeline_queue_size", _pipeline_queue_size, PIPELINE_QUEUE_SIZE);
+    _pnh.param("publish_ring_size", _publish_ring_size, PUBLISH_RING_SIZE);
+    _pnh.param("message_pool_size", _message_pool_size, MESSAGE_POOL_SIZE);
+    if (_message_pool_size < 0)
+    {
+        ROS_WARN_STREAM("message_pool_size can't be negative, using " << MESSAGE_POOL_SIZE
+                        << " instead of " << _message_pool_size);
+        _message_pool_size = MESSAGE_POOL_SIZE;
+    }
+    setMessagePoolSize(_message_pool_size);
+    _pnh.param("governor", _governor_enabled, GOVERNOR);
+    _pnh.param("governor_ladder", _governor_ladder, GOVERNOR_LADDER);
+    _pnh.param("governor_high_load", _governor_high_load, GOVERNOR_HIGH_LOAD);
+    _pnh.param("governor_low_load", _governor_low_load, GOVERNOR_LOW_LOAD);
+    if (_governor_low_load <= 0.0 || _governor_low_load >= _governor_high_load)
+    {
+        ROS_WARN_STREAM("governor_low_load must be positive and below governor_high_load, using "
+                        << GOVERNOR_LOW_LOAD << " and " << GOVERNOR_HIGH_LOAD << " instead of "
+                        << _governor_low_load << " and " << _governor_high_load);
+        _governor_low_load = GOVERNOR_LOW_LOAD;
+        _governor_high_load = GOVERNOR_HIGH_LOAD;
+    }
+
+    _pnh.param("depth_drop_policy", _drop_policy_name[DEPTH], DEFAULT_DROP_POLICY);
+    _pnh.param("infra1_drop_policy", _drop_policy_name[INFRA1], DEFAULT_DROP_POLICY);
+    _pnh.param("infra2_drop_policy", _drop_policy_name[INFRA2], DEFAULT_DROP_POLICY);
+    _pnh.param("color_drop_policy", _drop_policy_name[COLOR], DEFAULT_DROP_POLICY);
+    _pnh.param("fisheye_drop_policy", _drop_policy_name[FISHEYE], DEFAULT_DROP_POLICY);
+    _pnh.param("depth_drop_timeout", _drop_timeout_ms[DEPTH], DEFAULT_DROP_TIMEOUT_MS);
+    _pnh.param("infra1_drop_timeout", _drop_timeout_ms[INFRA1], DEFAULT_DROP_TIMEOUT_MS);
+    _pnh.param("infra2_drop_timeout", _drop_timeout_ms[INFRA2], DEFAULT_DROP_TIMEOUT_MS);
+    _pnh.param("color_drop_timeout", _drop_timeout_ms[COLOR], DEFAULT_DROP_TIMEOUT_MS);
+    _pnh.param("fisheye_drop_timeout", _drop_timeout_ms[FISHEYE], DEFAULT_DROP_TIMEOUT_MS);
     if (_pointcloud || _align_depth)
         _sync_frames = true;
     if (_sync_frames)
@@ -283,31 +379,26 @@ void RealSenseNode::getParameters()
     _pnh.param("depth_fps", _fps[DEPTH], DEPTH_FPS);
 
     _pnh.param("enable_depth", _enable[DEPTH], ENABLE_DEPTH);
-    _aligned_depth_images[DEPTH].resize(_width[DEPTH] * _height[DEPTH] * _unit_step_size[DEPTH]);
 
     _pnh.param("infra1_width", _width[INFRA1], INFRA1_WIDTH);
     _pnh.param("infra1_height", _height[INFRA1], INFRA1_HEIGHT);
     _pnh.param("infra1_fps", _fps[INFRA1], INFRA1_FPS);
     _pnh.param("enable_infra1", _enable[INFRA1], ENABLE_INFRA1);
-    _aligned_depth_images[INFRA1].resize(_width[DEPTH] * _height[DEPTH] * _unit_step_size[DEPTH]);
 
     _pnh.param("infra2_width", _width[INFRA2], INFRA2_WIDTH);
     _pnh.param("infra2_height", _height[INFRA2], INFRA2_HEIGHT);
     _pnh.param("infra2_fps", _fps[INFRA2], INFRA2_FPS);
     _pnh.param("enable_infra2", _enable[INFRA2], ENABLE_INFRA2);
-    _aligned_depth_images[INFRA2].resize(_width[DEPTH] * _height[DEPTH] * _unit_step_size[DEPTH]);
 
     _pnh.param("color_width", _width[COLOR], COLOR_WIDTH);
     _pnh.param("color_height", _height[COLOR], COLOR_HEIGHT);
     _pnh.param("color_fps", _fps[COLOR], COLOR_FPS);
     _pnh.param("enable_color", _enable[COLOR], ENABLE_COLOR);
-    _aligned_depth_images[COLOR].resize(_width[DEPTH] * _height[DEPTH] * _unit_step_size[DEPTH]);
 
     _pnh.param("fisheye_width", _width[FISHEYE], FISHEYE_WIDTH);
     _pnh.param("fisheye_height", _height[FISHEYE], FISHEYE_HEIGHT);
     _pnh.param("fisheye_fps", _fps[FISHEYE], FISHEYE_FPS);
     _pnh.param("enable_fisheye", _enable[FISHEYE], ENABLE_FISHEYE);
-    _aligned_depth_images[FISHEYE].resize(_width[DEPTH] * _height[DEPTH] * _unit_step_size[DEPTH]);
 
     _pnh.param("gyro_fps", _fps[GYRO], GYRO_FPS);
     _pnh.param("accel_fps", _fps[ACCEL], ACCEL_FPS);
@@ -323,13 +414,13 @@ void RealSenseNode::getParameters()
     _pnh.param("imu_gyro_frame_id", _frame_id[GYRO], DEFAULT_IMU_FRAME_ID);
     _pnh.param("imu_accel_frame_id", _frame_id[ACCEL], DEFAULT_IMU_FRAME_ID);
 
-    _pnh.param("depth_optical_frame_id", _optical_frame_id[DEPTH], DEFAULT_DEPTH_OPTICAL_FRAME_ID);
-    _pnh.param("infra1_optical_frame_id", _optical_frame_id[INFRA1], DEFAULT_INFRA1_OPTICAL_FRAME_ID);
-    _pnh.param("infra2_optical_frame_id", _optical_frame_id[INFRA2], DEFAULT_INFRA2_OPTICAL_FRAME_ID);
-    _pnh.param("color_optical_frame_id", _optical_frame_id[COLOR], DEFAULT_COLOR_OPTICAL_FRAME_ID);
-    _pnh.param("fisheye_optical_frame_id", _optical_frame_id[FISHEYE], DEFAULT_FISHEYE_OPTICAL_FRAME_ID);
-    _pnh.param("gyro_optical_frame_id", _optical_frame_id[GYRO], DEFAULT_GYRO_OPTICAL_FRAME_ID);
-    _pnh.param("accel_optical_frame_id", _optical_frame_id[ACCEL], DEFAULT_ACCEL_OPTICAL_FRAME_ID);
+    _pnh.param("depth_optical_frame_id", streamState(DEPTH).optical_frame_id, DEFAULT_DEPTH_OPTICAL_FRAME_ID);
+    _pnh.param("infra1_optical_frame_id", streamState(INFRA1).optical_frame_id, DEFAULT_INFRA1_OPTICAL_FRAME_ID);
+    _pnh.param("infra2_optical_frame_id", streamState(INFRA2).optical_frame_id, DEFAULT_INFRA2_OPTICAL_FRAME_ID);
+    _pnh.param("color_optical_frame_id", streamState(COLOR).optical_frame_id, DEFAULT_COLOR_OPTICAL_FRAME_ID);
+    _pnh.param("fisheye_optical_frame_id", streamState(FISHEYE).optical_frame_id, DEFAULT_FISHEYE_OPTICAL_FRAME_ID);
+    _pnh.param("gyro_optical_frame_id", streamState(GYRO).optical_frame_id, DEFAULT_GYRO_OPTICAL_FRAME_ID);
+    _pnh.param("accel_optical_frame_id", streamState(ACCEL).optical_frame_id, DEFAULT_ACCEL_OPTICAL_FRAME_ID);
 
     _pnh.param("aligned_depth_to_color_frame_id",   _depth_aligned_frame_id[COLOR],   DEFAULT_ALIGNED_DEPTH_TO_COLOR_FRAME_ID);
     _pnh.param("aligned_depth_to_infra1_frame_id",  _depth_aligned_frame_id[INFRA1],  DEFAULT_ALIGNED_DEPTH_TO_INFRA1_FRAME_ID);
@@ -343,6 +434,22 @@ void RealSenseNode::getParameters()
     depth_callback_timeout_ = ros::Duration(depth_callback_timeout);
 
     _pnh.param("serial_no", _serial_no, _serial_no);
+
+    setupPointCloudFrame();
+}
+
+void RealSenseNode::setMessagePoolSize(size_t size)
+{
+    for (auto& state : _streams)
+        state.setPoolCapacity(size);
+    for (auto& state : _depth_aligned_streams)
+        state.setPoolCapacity(size);
+    _color_aligned_to_depth.setPoolCapacity(size);
+    _filtered_depth.setPoolCapacity(size);
+    _pointcloud_xyz_pool.setCapacity(size);
+    _pointcloud_xyzrgb_pool.setCapacity(size);
+    _pointcloud_normals_pool.setCapacity(size);
+    _pointcloud_intensity_pool.setCapacity(size);
 }
 
 void RealSenseNode::setupDevice()
@@ -387,6 +494,8 @@ void RealSenseNode::setupDevice()
         ROS_INFO_STREAM("Device Product ID: 0x" << pid);
 
         ROS_INFO_STREAM("Enable PointCloud: " << ((_pointcloud)?"On":"Off"));
+        if (_pointcloud)
+            ROS_INFO_STREAM("PointCloud deprojection kernel: " << deprojectionKernelName());
         ROS_INFO_STREAM("Align Depth: " << ((_align_depth)?"On":"Off"));
         ROS_INFO_STREAM("Sync Mode: " << ((_sync_frames)?"On":"Off"));
 
@@ -525,8 +634,9 @@ void RealSenseNode::setupPublishers()
            
 
             std::shared_ptr<FrequencyDiagnostics> frequency_diagnostics(new FrequencyDiagnostics(_fps[stream], _stream_name[stream], _serial_no));
-            _image_publishers[stream] = {image_transport.advertise(image_raw.str(), 1), frequency_diagnostics};
-            _info_publisher[stream] = _node_handle.advertise<sensor_msgs::CameraInfo>(camera_info.str(), 1);
+            auto& state = streamState(stream);
+            state.image_publisher = {image_transport.advertise(image_raw.str(), 1), frequency_diagnostics};
+            state.info_publisher = _node_handle.advertise<sensor_msgs::CameraInfo>(camera_info.str(), 1);
 
             if (_align_depth && (stream != DEPTH))
             {
@@ -536,14 +646,43 @@ void RealSenseNode::setupPublishers()
 
                 std::string aligned_stream_name = "aligned_depth_to_" + _stream_name[stream];
                 std::shared_ptr<FrequencyDiagnostics> frequency_diagnostics(new FrequencyDiagnostics(_fps[stream], aligned_stream_name, _serial_no));
-                _depth_aligned_image_publishers[stream] = {image_transport.advertise(aligned_image_raw.str(), 1), frequency_diagnostics};
-                _depth_aligned_info_publisher[stream] = _node_handle.advertise<sensor_msgs::CameraInfo>(aligned_camera_info.str(), 1);
+                auto& aligned_state = _depth_aligned_streams[streamId(stream)];
+                aligned_state.image_publisher = {image_transport.advertise(aligned_image_raw.str(), 1), frequency_diagnostics};
+                aligned_state.info_publisher = _node_handle.advertise<sensor_msgs::CameraInfo>(aligned_camera_info.str(), 1);
+                aligned_state.optical_frame_id = state.optical_frame_id;
+
+                if (stream == COLOR)
+                {
+                    // The other way round: color on the depth pixel grid, in the depth optical frame
+                    std::shared_ptr<FrequencyDiagnostics> frequency_diagnostics(new FrequencyDiagnostics(_fps[DEPTH], "aligned_color_to_depth", _serial_no));
+                    _color_aligned_to_depth.image_publisher = {image_transport.advertise("aligned_color_to_depth/image_raw", 1), frequency_diagnostics};
+                    _color_aligned_to_depth.info_publisher = _node_handle.advertise<sensor_msgs::CameraInfo>("aligned_color_to_depth/camera_info", 1);
+                    _color_aligned_to_depth.optical_frame_id = streamState(DEPTH).optical_frame_id;
+                    _color_aligned_to_depth.encoding = state.encoding;
+                }
+            }
+
+            if (stream == DEPTH && !filters.empty())
+            {
+                std::shared_ptr<FrequencyDiagnostics> frequency_diagnostics(new FrequencyDiagnostics(_fps[DEPTH], "depth_filtered", _serial_no));
+                _filtered_depth.image_publisher = {image_transport.advertise("depth_filtered/image_rect_raw", 1), frequency_diagnostics};
+                _filtered_depth.info_publisher = _node_handle.advertise<sensor_msgs::CameraInfo>("depth_filtered/camera_info", 1);
+                _filtered_depth.optical_frame_id = state.optical_frame_id;
+                _filtered_depth.encoding = state.encoding;
             }
 
             if (stream == DEPTH && _pointcloud)
             {
                 _pointcloud_xyz_publisher = _node_handle.advertise<sensor_msgs::PointCloud2>("depth/points", 1);
                 _pointcloud_xyzrgb_publisher = _node_handle.advertise<sensor_msgs::PointCloud2>("depth/color/points", 1);
+                if (_pointcloud_normals)
+                    _pointcloud_normals_publisher = _node_handle.advertise<sensor_msgs::PointCloud2>("depth/points_normals", 1);
+                if (_pointcloud_intensity)
+                {
+                    if (!_enable[INFRA1])
+                        ROS_WARN("pointcloud_intensity needs enable_infra1, depth/points_intensity will stay silent");
+                    _pointcloud_intensity_publisher = _node_handle.advertise<sensor_msgs::PointCloud2>("depth/points_intensity", 1);
+                }
             }
         }
     }
@@ -574,132 +713,647 @@ void RealSenseNode::setupPublishers()
 
     if (_enable[GYRO])
     {
-        _imu_publishers[GYRO] = _node_handle.advertise<sensor_msgs::Imu>("gyro/sample", 100);
-        _info_publisher[GYRO] = _node_handle.advertise<IMUInfo>("gyro/imu_info", 1, true);
+        streamState(GYRO).imu_publisher = _node_handle.advertise<sensor_msgs::Imu>("gyro/sample", 100);
+        streamState(GYRO).info_publisher = _node_handle.advertise<IMUInfo>("gyro/imu_info", 1, true);
     }
 
     if (_enable[ACCEL])
     {
-        _imu_publishers[ACCEL] = _node_handle.advertise<sensor_msgs::Imu>("accel/sample", 100);
-        _info_publisher[ACCEL] = _node_handle.advertise<IMUInfo>("accel/imu_info", 1, true);
+        streamState(ACCEL).imu_publisher = _node_handle.advertise<sensor_msgs::Imu>("accel/sample", 100);
+        streamState(ACCEL).info_publisher = _node_handle.advertise<IMUInfo>("accel/imu_info", 1, true);
+    }
+}
+
+void RealSenseNode::updateIsFrameArrived(std::bitset<STREAM_COUNT>& is_frame_arrived,
+                                             rs2_stream stream_type, int stream_index)
+{
+    auto id = streamId(stream_type, stream_index);
+    if (INVALID_STREAM_ID == id)
+    {
+        ROS_ERROR_STREAM("Stream type is not supported! (" << stream_type << ", " << stream_index << ")");
+        return;
+    }
+    is_frame_arrived.set(id);
+}
+
+void RealSenseNode::alignDepthToOthers(FrameJob& job)
+{
+    auto& targets = _align_targets;
+    targets.clear();
+    for (auto&& other_frame : job.frames)
+    {
+        auto stream_type = other_frame.get_profile().stream_type();
+        if (RS2_STREAM_DEPTH == stream_type)
+            continue;
+
+        auto stream_index = other_frame.get_profile().stream_index();
+        auto id = streamId(stream_type, stream_index);
+        if (INVALID_STREAM_ID == id)
+            continue;
+
+        // Aligned depth goes to the scaled geometry of the stream, resampling reads the stream itself
+        auto& other = _streams[id];
+        auto& aligned_state = _depth_aligned_streams[id];
+        DepthAligner::Target target = {aligned_state.intrinsics, other.depth_to_other, nullptr, nullptr, 0, nullptr, nullptr};
+        DepthAligner::Target resample = {other.intrinsics, other.depth_to_other, nullptr, nullptr, 0, nullptr, nullptr};
+        if(0 != aligned_state.info_publisher.getNumSubscribers() ||
+           0 != aligned_state.image_publisher.first.getNumSubscribers())
+        {
+            // Align directly into the message that gets published
+            auto& img = job.aligned_depth_images[id];
+            img = aligned_state.image_pool.acquire();
+            target.out = &img->data;
+            job.is_depth_aligned.set(id);
+        }
+        bool is_color = (COLOR == stream_index_pair{stream_type, stream_index});
+        if (is_color &&
+            (0 != _color_aligned_to_depth.info_publisher.getNumSubscribers() ||
+             0 != _color_aligned_to_depth.image_publisher.first.getNumSubscribers()))
+        {
+            job.aligned_color_image = _color_aligned_to_depth.image_pool.acquire();
+            resample.image = reinterpret_cast<const uint8_t*>(other_frame.get_data());
+            resample.image_bpp = other_frame.as<rs2::video_frame>().get_bytes_per_pixel();
+            resample.image_out = &job.aligned_color_image->data;
+        }
+        // The colored cloud takes the color of each depth pixel from the corners projected here anyway,
+        // instead of projecting its points again. Only worth it when color is being projected already;
+        // bilinear colors still need the projection.
+        if (is_color && !_pointcloud_bilinear_color &&
+            0 != _pointcloud_xyzrgb_publisher.getNumSubscribers() &&
+            (resample.image || (target.out && 1.0 == _align_depth_output_scale)))
+        {
+            resample.image = reinterpret_cast<const uint8_t*>(other_frame.get_data());
+            resample.image_bpp = other_frame.as<rs2::video_frame>().get_bytes_per_pixel();
+            resample.rgb_out = &job.depth_pixel_rgb;
+            job.has_depth_pixel_rgb = true;
+        }
+
+        // At full scale both share one target, so color is gathered from the corners the aligned
+        // depth is projected with
+        if (target.out && resample.image && 1.0 == _align_depth_output_scale)
+        {
+            target.image = resample.image;
+            target.image_bpp = resample.image_bpp;
+            target.image_out = resample.image_out;
+            target.rgb_out = resample.rgb_out;
+            resample.image = nullptr;
+        }
+        if (target.out)
+            targets.push_back(target);
+        if (resample.image)
+            targets.push_back(resample);
+    }
+
+    // One pass over the depth image for all targets
+    if (!targets.empty())
+    {
+        _depth_aligner.align(job.depth_intrinsics, reinterpret_cast<const uint16_t*>(job.depth_frame.get_data()),
+                             _depth_scale_meters, _align_depth_zbuffer, targets, *_worker_pool);
+    }
+}
+
+void RealSenseNode::publishAlignedDepthToOthers(const FrameJob& job)
+{
+    for (int id = 0; id < STREAM_COUNT; ++id)
+    {
+        if (!job.is_depth_aligned.test(id))
+            continue;
+
+        publishFrame(job.depth_frame, job.t, _depth_aligned_streams[id], job.aligned_depth_images[id]);
+    }
+}
+
+void RealSenseNode::setupFilters()
+{
+    // Listed filters start as the dynamic reconfigure defaults, which the param manager applies next
+    struct KnownFilter
+    {
+        const char* name;
+        realsense2_camera::filters type;
+        const char* filter_name;
+        rs2::process_interface& filter;
+        bool is_enabled;
+    };
+    const KnownFilter known[] = {{"decimation", DECIMATION, "Decimation", dec_filter, true},
+                                 {"threshold", THRESHOLD, "Threshold", thresh_filter, true},
+                                 {"spatial", SPATIAL, "Spatial", spat_filter, false},
+                                 {"temporal", TEMPORAL, "Temporal", temp_filter, false},
+                                 {"hole_filling", HOLE_FILLING, "Hole_Filling", hole_filling_filter, true}};
+
+    std::vector<std::string> names;
+    std::stringstream list(_filter_list);
+    std::string name;
+    while (std::getline(list, name, ','))
+    {
+        name.erase(std::remove_if(name.begin(), name.end(), ::isspace), name.end());
+        if (!name.empty())
+            names.push_back(name);
+    }
+
+    // Filters keep state between frames, so each can only be in the chain once
+    auto add = [&](const std::string& name)
+    {
+        auto it = std::find_if(std::begin(known), std::end(known),
+                               [&](const KnownFilter& filter){ return name == filter.name; });
+        if (std::end(known) == it)
+            ROS_WARN_STREAM("Unknown filter \"" << name << "\" in filters, known are decimation, threshold, "
+                            "disparity, spatial, temporal and hole_filling");
+        else if (findFilter(it->type))
+            ROS_WARN_STREAM("Filter \"" << name << "\" is listed more than once in filters, using the first");
+        else
+            filters.emplace_back(it->type, it->filter_name, it->filter, it->is_enabled);
+    };
+    for (size_t i = 0; i < names.size(); ++i)
+    {
+        if ("disparity" != names[i])
+        {
+            add(names[i]);
+            continue;
+        }
+        if (findFilter(DEPTH_TO_DISPARITY))
+        {
+            ROS_WARN_STREAM("Filter \"disparity\" is listed more than once in filters, using the first");
+            continue;
+        }
+
+        // The spatial and temporal filters right after it run on disparity, depth comes back after them
+        filters.emplace_back(DEPTH_TO_DISPARITY, "Depth_to_Disparity", depth_to_disparity, false);
+        while (i + 1 < names.size() && ("spatial" == names[i + 1] || "temporal" == names[i + 1]))
+            add(names[++i]);
+        filters.emplace_back(DISPARITY_TO_DEPTH, "Disparity_to_Depth", disparity_to_depth, false);
+    }
+
+    // librealsense drops depth past 4 m by default, only a configured max distance should
+    thresh_filter.set_option(RS2_OPTION_MAX_DISTANCE, thresh_filter.get_option_range(RS2_OPTION_MAX_DISTANCE).max);
+
+    std::string chain;
+    for (auto&& filter : filters)
+        chain += (chain.empty() ? "" : ", ") + filter.filter_name;
+    ROS_INFO_STREAM("Depth filters: " << (chain.empty() ? "none" : chain));
+}
+
+filter_options* RealSenseNode::findFilter(realsense2_camera::filters type)
+{
+    for (auto&& filter : filters)
+    {
+        if (type == filter.type)
+            return &filter;
+    }
+    return nullptr;
+}
+
+void RealSenseNode::filterFrame(rs2::frame& frame)
+{
+    for (auto&& filter : filters)
+    {
+        if (filter.is_enabled &&
+            !(TEMPORAL == filter.type && _governor.isDegraded(GOVERNOR_TEMPORAL_FILTER)) &&
+            !(SPATIAL == filter.type && _governor.isDegraded(GOVERNOR_SPATIAL_FILTER)))
+        {
+            frame = filter.filter.process(frame);
+        }
+    }
+}
+
+const rs2_intrinsics& RealSenseNode::filteredDepthIntrinsics(const rs2::frame& depth_frame)
+{
+    // Decimation hands out frames of a smaller profile of its own; intrinsics are only queried
+    // when the profile changes
+    auto profile = depth_frame.get_profile();
+    if (profile.unique_id() != _filtered_depth_profile_id)
+    {
+        _filtered_depth_intrinsics = profile.as<rs2::video_stream_profile>().get_intrinsics();
+        _filtered_depth_profile_id = profile.unique_id();
+    }
+    return _filtered_depth_intrinsics;
+}
+
+void RealSenseNode::setupPipeline()
+{
+    // Stages run on their own workers so the librealsense callback thread only stamps and enqueues.
+    // Align and pointcloud stages are only instantiated when their outputs are enabled.
+    // Each job keeps the time of its slowest stage, which bounds the rate the pipeline sustains.
+    auto timed = [this](void (RealSenseNode::*stage)(FrameJob&))
+    {
+        return [this, stage](FrameJob& job)
+        {
+            auto start = std::chrono::steady_clock::now();
+            (this->*stage)(job);
+            std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+            job.busiest_stage = std::max(job.busiest_stage, elapsed.count());
+        };
+    };
+    _pipeline.addStage(timed(&RealSenseNode::filterStage));
+    if (_align_depth)
+        _pipeline.addStage(timed(&RealSenseNode::alignStage));
+    if (_pointcloud)
+        _pipeline.addStage(timed(&RealSenseNode::pointcloudStage));
+    auto publish = timed(&RealSenseNode::publishStage);
+    _pipeline.addStage([this, publish](FrameJob& job)
+    {
+        publish(job);
+        if (_governor_enabled)
+            _governor.update(job.busiest_stage);
+    });
+    setupGovernor();
+
+    // The stage calling into the pool works too, so it gets one thread less
+    auto worker_threads = (_worker_threads > 0) ? _worker_threads : std::max(1u, std::thread::hardware_concurrency());
+    _worker_pool.reset(new WorkerPool(worker_threads - 1));
+    ROS_INFO_STREAM("Worker threads: " << worker_threads);
+
+    _pipeline.start(_pipeline_queue_size);
+}
+
+void RealSenseNode::setupGovernor()
+{
+    if (!_governor_enabled)
+        return;
+
+    std::vector<governor_step> ladder;
+    std::stringstream list(_governor_ladder);
+    std::string name;
+    while (std::getline(list, name, ','))
+    {
+        name.erase(std::remove_if(name.begin(), name.end(), ::isspace), name.end());
+        if (name.empty())
+            continue;
+        auto step = ProcessingGovernor::parseStep(name);
+        if (GOVERNOR_STEP_COUNT == step)
+            ROS_WARN_STREAM("Unknown step \"" << name << "\" in governor_ladder, known are temporal, spatial, "
+                            "pointcloud_stride and align_every_other");
+        else if (ladder.end() != std::find(ladder.begin(), ladder.end(), step))
+            ROS_WARN_STREAM("Step \"" << name << "\" is listed more than once in governor_ladder, using the first");
+        else
+            ladder.push_back(step);
+    }
+
+    // Framesets come at the depth rate
+    _governor.configure(ladder, 1.0 / _fps[DEPTH], _governor_high_load, _governor_low_load);
+    ROS_INFO_STREAM("Processing governor: " << ladder.size() << " steps, taken above "
+                    << _governor_high_load << " and given back below " << _governor_low_load << " of the frame period");
+    if (streamState(DEPTH).image_publisher.second)
+    {
+        streamState(DEPTH).image_publisher.second->diagnostic_updater_.add("Processing governor",
+            [this](diagnostic_updater::DiagnosticStatusWrapper& stat){ governorStatusUpdate(stat); });
     }
 }
 
-void RealSenseNode::alignFrame(const rs2_intrinsics& from_intrin,
-                                   const rs2_intrinsics& other_intrin,
-                                   rs2::frame from_image,
-                                   uint32_t output_image_bytes_per_pixel,
-                                   const rs2_extrinsics& from_to_other,
-                                   std::vector<uint8_t>& out_vec)
+void RealSenseNode::governorStatusUpdate(diagnostic_updater::DiagnosticStatusWrapper& stat)
 {
-    static const auto meter_to_mm = 0.001f;
-    uint8_t* p_out_frame = out_vec.data();
+    auto level = _governor.level();
+    std::string steps;
+    for (int i = 0; i < level; ++i)
+        steps += (steps.empty() ? "" : ", ") + std::string(ProcessingGovernor::stepName(_governor.ladder()[i]));
 
-    static const auto blank_color = 0x00;
-    memset(p_out_frame, blank_color, other_intrin.height * other_intrin.width * output_image_bytes_per_pixel);
+    if (0 == level)
+        stat.summary(diagnostic_msgs::DiagnosticStatus::OK, "Full processing");
+    else
+        stat.summaryf(diagnostic_msgs::DiagnosticStatus::WARN, "Degraded to level %d of %d", level,
+                      static_cast<int>(_governor.ladder().size()));
+    stat.add("Level", level);
+    stat.add("Load", _governor.load());
+    stat.add("Steps taken", steps.empty() ? "none" : steps);
+}
+
+drop_policy RealSenseNode::parseDropPolicy(const std::string& name, const stream_index_pair& stream) const
+{
+    if ("latest_only" == name)
+        return LATEST_ONLY;
+    if ("drop_oldest" == name)
+        return DROP_OLDEST;
+    if ("block" == name)
+        return BLOCK_WITH_TIMEOUT;
+
+    ROS_WARN_STREAM("Unknown drop policy \"" << name << "\" for " << rs2_stream_to_string(stream.first)
+                    << " stream (expected latest_only, drop_oldest or block) - using drop_oldest");
+    return DROP_OLDEST;
+}
+
+void RealSenseNode::dropStatsUpdate(diagnostic_updater::DiagnosticStatusWrapper& stat, const stream_index_pair& stream)
+{
+    static const char* policy_names[DROP_POLICY_COUNT] = {"latest_only", "drop_oldest", "block"};
+    auto& ring = streamState(stream).publish_ring;
+    stat.summary(diagnostic_msgs::DiagnosticStatus::OK, "OK");
+    stat.add("Drop policy", policy_names[ring->policy()]);
+    stat.add("Dropped frames", ring->overwritten());
+    if (BLOCK_WITH_TIMEOUT == ring->policy())
+        stat.add("Timed out waits", ring->timedOut());
+    if (DEPTH == stream)
+        stat.add("Dropped framesets (processing)", _pipeline.dropped());
+}
 
-    auto p_from_frame = reinterpret_cast<const uint8_t*>(from_image.get_data());
-    auto from_stream_type = from_image.get_profile().stream_type();
-    float depth_units = ((from_stream_type == RS2_STREAM_DEPTH)?_depth_scale_meters:1.f);
-#pragma omp parallel for schedule(dynamic)
-    for (int from_y = 0; from_y < from_intrin.height; ++from_y)
+double RealSenseNode::dropTimeoutMs(const stream_index_pair& stream, drop_policy policy) const
+{
+    // The wait holds up the librealsense callback and every stream it delivers, so by default it
+    // stays within part of a frame period: a blocked frame is late, not a frame behind
+    auto max_timeout_ms = MAX_DROP_TIMEOUT_PERIODS * 1000.0 / std::max(1, _fps.at(stream));
+    auto timeout_ms = _drop_timeout_ms.at(stream);
+    if (timeout_ms <= 0.0)
+        return max_timeout_ms;
+    if (BLOCK_WITH_TIMEOUT == policy && timeout_ms > max_timeout_ms)
+    {
+        ROS_WARN_STREAM("Drop timeout of " << timeout_ms << " ms for " << rs2_stream_to_string(stream.first)
+                        << " stream is over " << MAX_DROP_TIMEOUT_PERIODS << " frame periods ("
+                        << max_timeout_ms << " ms), a slow consumer will hold up the other streams");
+    }
+    return timeout_ms;
+}
+
+void RealSenseNode::setupPublishRings()
+{
+    for (auto& streams : IMAGE_STREAMS)
     {
-        int from_pixel_index = from_y * from_intrin.width;
-        for (int from_x = 0; from_x < from_intrin.width; ++from_x, ++from_pixel_index)
+        for (auto& elem : streams)
         {
-            // Skip over depth pixels with the value of zero
-            float depth = (from_stream_type == RS2_STREAM_DEPTH)?(depth_units * ((const uint16_t*)p_from_frame)[from_pixel_index]): 1.f;
-            if (depth)
+            if (!_enable[elem])
+                continue;
+
+            auto policy = parseDropPolicy(_drop_policy_name[elem], elem);
+            auto timeout = std::chrono::microseconds(static_cast<int64_t>(dropTimeoutMs(elem, policy) * 1000));
+            auto& state = streamState(elem);
+            state.publish_ring = std::unique_ptr<FrameRingBuffer>(new FrameRingBuffer(_publish_ring_size, policy, timeout));
+            state.image_publisher.second->diagnostic_updater_.add("Frame drops",
+                [this, elem](diagnostic_updater::DiagnosticStatusWrapper& stat){ dropStatsUpdate(stat, elem); });
+
+            // Framesets entering the processing pipeline, and the filtered depth they give, follow
+            // the depth stream's policy
+            if (DEPTH == elem)
             {
-                // Map the top-left corner of the depth pixel onto the other image
-                float from_pixel[2] = { from_x - 0.5f, from_y - 0.5f }, from_point[3], other_point[3], other_pixel[2];
-                rs2_deproject_pixel_to_point(from_point, &from_intrin, from_pixel, depth);
-                rs2_transform_point_to_point(other_point, &from_to_other, from_point);
-                rs2_project_point_to_pixel(other_pixel, &other_intrin, other_point);
-                const int other_x0 = static_cast<int>(other_pixel[0] + 0.5f);
-                const int other_y0 = static_cast<int>(other_pixel[1] + 0.5f);
-
-                // Map the bottom-right corner of the depth pixel onto the other image
-                from_pixel[0] = from_x + 0.5f; from_pixel[1] = from_y + 0.5f;
-                rs2_deproject_pixel_to_point(from_point, &from_intrin, from_pixel, depth);
-                rs2_transform_point_to_point(other_point, &from_to_other, from_point);
-                rs2_project_point_to_pixel(other_pixel, &other_intrin, other_point);
-                const int other_x1 = static_cast<int>(other_pixel[0] + 0.5f);
-                const int other_y1 = static_cast<int>(other_pixel[1] + 0.5f);
-
-                if (other_x0 < 0 || other_y0 < 0 || other_x1 >= other_intrin.width || other_y1 >= other_intrin.height)
-                    continue;
+                _pipeline_drop_policy = policy;
+                _pipeline_drop_timeout = timeout;
+                if (_filtered_depth.image_publisher.second)
+                    _filtered_depth.publish_ring = std::unique_ptr<FrameRingBuffer>(new FrameRingBuffer(_publish_ring_size, policy, timeout));
+            }
+        }
+    }
+
+    _publish_running = true;
+    _publish_thread = std::thread(&RealSenseNode::publishRingsLoop, this);
+}
+
+void RealSenseNode::pushToPublishRing(const rs2::frame& f, const ros::Time& t)
+{
+    auto profile = f.get_profile();
+    auto id = streamId(profile.stream_type(), profile.stream_index());
+    if (INVALID_STREAM_ID == id)
+        return;
+
+    pushToPublishRing(_streams[id], f, t);
+}
+
+void RealSenseNode::pushToPublishRing(StreamState& state, const rs2::frame& f, const ros::Time& t)
+{
+    if (!state.publish_ring)
+        return;
+
+    // Each ring has a single producer: the sensor (or syncer) callback thread,
+    // or the filter stage for filtered depth
+    state.publish_ring->push(f, t.toNSec());
+    // Sequentially consistent with the flags the publishing thread sets and checks before it waits:
+    // either it sees this frame, or this sees it sleeping. The lock is only taken to wake it up.
+    _publish_pending = true;
+    if (_publish_sleeping)
+    {
+        std::lock_guard<std::mutex> lock(_publish_mutex);
+        _publish_cv.notify_one();
+    }
+}
+
+void RealSenseNode::publishRingsLoop()
+{
+    while (_publish_running)
+    {
+        bool published = false;
+        auto drain = [&](StreamState& state)
+        {
+            if (!state.publish_ring)
+                return;
 
-                for (int y = other_y0; y <= other_y1; ++y)
+            rs2::frame f;
+            uint64_t stamp;
+            while (state.publish_ring->pop(f, stamp))
+            {
+                try{
+                    publishFrame(f, ros::Time().fromNSec(stamp), state);
+                }
+                catch(const std::exception& ex)
                 {
-                    for (int x = other_x0; x <= other_x1; ++x)
-                    {
-                        int out_pixel_index = y * other_intrin.width + x;
-                        uint16_t* p_from_depth_frame = (uint16_t*)p_from_frame;
-                        uint16_t* p_out_depth_frame = (uint16_t*)p_out_frame;
-                        p_out_depth_frame[out_pixel_index] = p_from_depth_frame[from_pixel_index] * (depth_units / meter_to_mm);
-                    }
+                    ROS_ERROR_STREAM("An error has occurred during frame publishing: " << ex.what());
                 }
+                published = true;
             }
+        };
+        for (auto& state : _streams)
+            drain(state);
+        drain(_filtered_depth);
+
+        if (!published)
+        {
+            std::unique_lock<std::mutex> lock(_publish_mutex);
+            _publish_sleeping = true;
+            _publish_cv.wait(lock, [this]{ return _publish_pending.exchange(false) || !_publish_running; });
+            _publish_sleeping = false;
         }
     }
 }
 
-void RealSenseNode::updateIsFrameArrived(std::map<stream_index_pair, bool>& is_frame_arrived,
-                                             rs2_stream stream_type, int stream_index)
+void RealSenseNode::ingestFrame(rs2::frame frame)
 {
-    try
-    {
-        is_frame_arrived.at({stream_type, stream_index}) = true;
+    try{
+        depth_callback_timer_.setPeriod(depth_callback_timeout_, true);
+        // We compute a ROS timestamp which is based on an initial ROS time at point of first frame,
+        // and the incremental timestamp from the camera.
+        // In sync mode the timestamp is based on ROS time
+        if ((false == _intialize_time_base) || (_prev_camera_time_stamp > frame.get_timestamp()))
+        {
+            if (RS2_TIMESTAMP_DOMAIN_SYSTEM_TIME == frame.get_frame_timestamp_domain())
+                ROS_WARN("Frame metadata isn't available! (frame_timestamp_domain = RS2_TIMESTAMP_DOMAIN_SYSTEM_TIME)");
+
+            _intialize_time_base = true;
+            _ros_time_base = ros::Time::now();
+            _camera_time_base = frame.get_timestamp();
+        }
+        _prev_camera_time_stamp = frame.get_timestamp();
+
+        ros::Time t;
+        if (_use_ros_time)
+            t = ros::Time::now();
+        else
+            t = ros::Time(_ros_time_base.toSec()+ (/*ms*/ frame.get_timestamp() - /*ms*/ _camera_time_base) / /*ms to seconds*/ 1000);
+
+        // Every stream is published raw straight from capture, depth_filtered follows from the filter stage
+        bool has_depth;
+        if (frame.is<rs2::frameset>())
+        {
+            auto frameset = frame.as<rs2::frameset>();
+            for (auto it = frameset.begin(); it != frameset.end(); ++it)
+                pushToPublishRing(*it, t);
+            has_depth = static_cast<bool>(frameset.first_or_default(RS2_STREAM_DEPTH));
+        }
+        else
+        {
+            pushToPublishRing(frame, t);
+            has_depth = (RS2_STREAM_DEPTH == frame.get_profile().stream_type());
+        }
+
+        // Every stage works on depth, frames without it are done once published and must not
+        // take the place of depth jobs in the queue
+        if (!has_depth)
+            return;
+
+        auto job = _pipeline.acquire();
+        job.t = t;
+        job.frame = frame;
+        if (!_pipeline.enqueue(std::move(job), _pipeline_drop_policy, _pipeline_drop_timeout))
+        {
+            ROS_WARN_THROTTLE(1, "Processing is falling behind, dropped a pending frame (%llu dropped so far)", _pipeline.dropped());
+        }
     }
-    catch (std::out_of_range)
+    catch(const std::exception& ex)
     {
-        ROS_ERROR_STREAM("Stream type is not supported! (" << stream_type << ", " << stream_index << ")");
+        ROS_ERROR_STREAM("An error has occurred during frame callback: " << ex.what());
     }
 }
 
-void RealSenseNode::publishAlignedDepthToOthers(rs2::frame depth_frame, const std::vector<rs2::frame>& frames, const ros::Time& t)
+void RealSenseNode::filterStage(FrameJob& job)
 {
-    for (auto&& other_frame : frames)
+    try{
+        auto& frame = job.frame;
+        if (frame.is<rs2::frameset>())
+        {
+            ROS_DEBUG("Frameset arrived.");
+            auto frameset = frame.as<rs2::frameset>();
+            for (auto it = frameset.begin(); it != frameset.end(); ++it)
+            {
+                auto f = (*it);
+                auto stream_type = f.get_profile().stream_type();
+                auto stream_index = f.get_profile().stream_index();
+                updateIsFrameArrived(job.is_frame_arrived, stream_type, stream_index);
+
+                ROS_DEBUG("Frameset contain (%s, %d) frame. frame_number: %llu ; frame_TS: %f ; ros_TS(NSec): %lu",
+                          rs2_stream_to_string(stream_type), stream_index, frame.get_frame_number(), frame.get_timestamp(), job.t.toNSec());
+
+                if (stream_type == RS2_STREAM_DEPTH)
+                {
+                    filterFrame(f);
+                    pushToPublishRing(_filtered_depth, f, job.t);
+                    job.depth_frame = f;
+                    job.depth_intrinsics = filteredDepthIntrinsics(f);
+                }
+                else if (stream_type == RS2_STREAM_COLOR)
+                {
+                    job.color_frame = f;
+                }
+                else if (INFRA1 == stream_index_pair{stream_type, stream_index})
+                {
+                    job.infra1_frame = f;
+                }
+                job.frames.push_back(f);
+            }
+        }
+        else
+        {
+            auto stream_type = frame.get_profile().stream_type();
+            auto stream_index = frame.get_profile().stream_index();
+            updateIsFrameArrived(job.is_frame_arrived, stream_type, stream_index);
+            ROS_DEBUG("Single video frame arrived (%s, %d). frame_number: %llu ; frame_TS: %f ; ros_TS(NSec): %lu",
+                      rs2_stream_to_string(stream_type), stream_index, frame.get_frame_number(), frame.get_timestamp(), job.t.toNSec());
+
+            auto f = frame;
+            if (stream_type == RS2_STREAM_DEPTH)
+            {
+                filterFrame(f);
+                pushToPublishRing(_filtered_depth, f, job.t);
+                job.depth_frame = f;
+                job.depth_intrinsics = filteredDepthIntrinsics(f);
+            }
+            else if (stream_type == RS2_STREAM_COLOR)
+            {
+                job.color_frame = f;
+            }
+            else if (INFRA1 == stream_index_pair{stream_type, stream_index})
+            {
+                job.infra1_frame = f;
+            }
+            job.frames.push_back(f);
+        }
+    }
+    catch(const std::exception& ex)
     {
-        auto stream_type = other_frame.get_profile().stream_type();
-        if (RS2_STREAM_DEPTH == stream_type)
-            continue;
+        ROS_ERROR_STREAM("An error has occurred during frame filtering: " << ex.what());
+    }
+}
 
-        auto stream_index = other_frame.get_profile().stream_index();
-        stream_index_pair sip{stream_type, stream_index};
-        auto& info_publisher = _depth_aligned_info_publisher.at(sip);
-        auto& image_publisher = _depth_aligned_image_publishers.at(sip);
-        if(0 != info_publisher.getNumSubscribers() ||
-           0 != image_publisher.first.getNumSubscribers())
+void RealSenseNode::alignStage(FrameJob& job)
+{
+    try{
+        bool skip = _governor.isDegraded(GOVERNOR_ALIGN_EVERY_OTHER) && (++_align_frames % 2);
+        if (job.depth_frame && job.frame.is<rs2::frameset>() && !skip)
         {
-            auto from_image_frame = depth_frame.as<rs2::video_frame>();
-            auto& out_vec = _aligned_depth_images[sip];
-            alignFrame(_stream_intrinsics[DEPTH], _stream_intrinsics[sip],
-                       depth_frame, from_image_frame.get_bytes_per_pixel(),
-                       _depth_to_other_extrinsics[sip], out_vec);
-
-            auto& from_image = _depth_aligned_image[sip];
-            from_image.data = out_vec.data();
-
-            publishFrame(depth_frame, t, sip,
-                         _depth_aligned_image,
-                         _depth_aligned_info_publisher,
-                         _depth_aligned_image_publishers, _depth_aligned_seq,
-                         _depth_aligned_camera_info, _optical_frame_id,
-                         _depth_aligned_encoding, false);
+            ROS_DEBUG("alignDepthToOthers(...)");
+            alignDepthToOthers(job);
         }
     }
+    catch(const std::exception& ex)
+    {
+        ROS_ERROR_STREAM("An error has occurred during depth alignment: " << ex.what());
+    }
 }
 
-void RealSenseNode::filterFrame(rs2::frame& frame)
+void RealSenseNode::pointcloudStage(FrameJob& job)
 {
-    for (auto&& filter : filters)
+    try{
+        if(0 != _pointcloud_xyzrgb_publisher.getNumSubscribers())
+        {
+            ROS_DEBUG("createRgbToDepthPCMsg(...)");
+            job.pointcloud_xyzrgb = createRgbToDepthPCMsg(job);
+        }
+        if(0 != _pointcloud_xyz_publisher.getNumSubscribers())
+        {
+            ROS_DEBUG("createDepthPCMsg(...)");
+            job.pointcloud_xyz = createDepthPCMsg(job);
+        }
+        if(0 != _pointcloud_normals_publisher.getNumSubscribers())
+        {
+            ROS_DEBUG("createNormalsPCMsg(...)");
+            job.pointcloud_normals = createNormalsPCMsg(job);
+        }
+        if(0 != _pointcloud_intensity_publisher.getNumSubscribers())
+        {
+            ROS_DEBUG("createIntensityPCMsg(...)");
+            job.pointcloud_intensity = createIntensityPCMsg(job);
+        }
+    }
+    catch(const std::exception& ex)
     {
-        if (filter.is_enabled)
+        ROS_ERROR_STREAM("An error has occurred during pointcloud generation: " << ex.what());
+    }
+}
+
+void RealSenseNode::publishStage(FrameJob& job)
+{
+    try{
+        if (job.is_depth_aligned.any())
         {
-            frame = filter.filter.process(frame);
+            ROS_DEBUG("publishAlignedDepthToOthers(...)");
+            publishAlignedDepthToOthers(job);
         }
+        if (job.aligned_color_image)
+            publishFrame(job.color_frame, job.t, _color_aligned_to_depth, job.aligned_color_image, job.depth_frame);
+
+        if (job.pointcloud_xyzrgb)
+            _pointcloud_xyzrgb_publisher.publish(job.pointcloud_xyzrgb);
+        if (job.pointcloud_xyz)
+            _pointcloud_xyz_publisher.publish(job.pointcloud_xyz);
+        if (job.pointcloud_normals)
+            _pointcloud_normals_publisher.publish(job.pointcloud_normals);
+        if (job.pointcloud_intensity)
+            _pointcloud_intensity_publisher.publish(job.pointcloud_intensity);
+    }
+    catch(const std::exception& ex)
+    {
+        ROS_ERROR_STREAM("An error has occurred during frame publishing: " << ex.what());
     }
 }
 
@@ -734,7 +1388,6 @@ void RealSenseNode::enable_devices()
 
 						_enabled_profiles[elem].push_back(profile);
 
-						_image[elem] = cv::Mat(_width[elem], _height[elem], _image_format[elem], cv::Scalar(0, 0, 0));
 
 						ROS_INFO_STREAM(_stream_name[elem] << " stream is enabled - width: " << _width[elem] << ", height: " << _height[elem] << ", fps: " << _fps[elem]);
 						break;
@@ -754,13 +1407,6 @@ void RealSenseNode::enable_devices()
 			}
 		}
 	}
-	if (_align_depth)
-	{
-		for (auto& profiles : _enabled_profiles)
-		{
-			_depth_aligned_image[profiles.first] = cv::Mat(_width[DEPTH], _height[DEPTH], _image_format[DEPTH], cv::Scalar(0, 0, 0));
-		}
-	}
 }
 
 void RealSenseNode::setupStreams()
@@ -778,117 +1424,11 @@ void RealSenseNode::setupStreams()
             }
         }
 
+        setupPublishRings();
+        setupPipeline();
         _frame_callback = [this](rs2::frame frame)
         {
-            try{
-                depth_callback_timer_.setPeriod(depth_callback_timeout_, true);
-                // We compute a ROS timestamp which is based on an initial ROS time at point of first frame,
-                // and the incremental timestamp from the camera.
-                // In sync mode the timestamp is based on ROS time
-                if ((false == _intialize_time_base) || (_prev_camera_time_stamp > frame.get_timestamp()))
-                {
-                    if (RS2_TIMESTAMP_DOMAIN_SYSTEM_TIME == frame.get_frame_timestamp_domain())
-                        ROS_WARN("Frame metadata isn't available! (frame_timestamp_domain = RS2_TIMESTAMP_DOMAIN_SYSTEM_TIME)");
-
-                    _intialize_time_base = true;
-                    _ros_time_base = ros::Time::now();
-                    _camera_time_base = frame.get_timestamp();
-                }
-                _prev_camera_time_stamp = frame.get_timestamp();
-
-                ros::Time t;
-                if (_use_ros_time)
-                    t = ros::Time::now();
-                else
-                    t = ros::Time(_ros_time_base.toSec()+ (/*ms*/ frame.get_timestamp() - /*ms*/ _camera_time_base) / /*ms to seconds*/ 1000);
-
-
-                std::map<stream_index_pair, bool> is_frame_arrived(_is_frame_arrived);
-                std::vector<rs2::frame> frames;
-                if (frame.is<rs2::frameset>())
-                {
-                    ROS_DEBUG("Frameset arrived.");
-                    bool is_depth_arrived = false;
-                    rs2::frame depth_frame;
-                    auto frameset = frame.as<rs2::frameset>();
-                    for (auto it = frameset.begin(); it != frameset.end(); ++it)
-                    {
-                        auto f = (*it);
-                        auto stream_type = f.get_profile().stream_type();
-                        auto stream_index = f.get_profile().stream_index();
-                        updateIsFrameArrived(is_frame_arrived, stream_type, stream_index);
-
-                        ROS_DEBUG("Frameset contain (%s, %d) frame. frame_number: %llu ; frame_TS: %f ; ros_TS(NSec): %lu",
-                                  rs2_stream_to_string(stream_type), stream_index, frame.get_frame_number(), frame.get_timestamp(), t.toNSec());
-
-                        if (stream_type == RS2_STREAM_DEPTH)
-                        {
-                            filterFrame(f);
-                        }
-
-                        stream_index_pair sip{stream_type,stream_index};
-                        publishFrame(f, t,
-                                     sip,
-                                     _image,
-                                     _info_publisher,
-                                     _image_publishers, _seq,
-                                     _camera_info, _optical_frame_id,
-                                     _encoding);
-                        if (_align_depth && stream_type != RS2_STREAM_DEPTH)
-                        {
-                            frames.push_back(f);
-                        }
-                        else
-                        {
-                            depth_frame = f;
-                            is_depth_arrived = true;
-                        }
-                    }
-
-                    if (_align_depth && is_depth_arrived)
-                    {
-                        ROS_DEBUG("publishAlignedDepthToOthers(...)");
-                        publishAlignedDepthToOthers(depth_frame, frames, t);
-                    }
-                }
-                else
-                {
-                    auto stream_type = frame.get_profile().stream_type();
-                    auto stream_index = frame.get_profile().stream_index();
-                    updateIsFrameArrived(is_frame_arrived, stream_type, stream_index);
-                    ROS_DEBUG("Single video frame arrived (%s, %d). frame_number: %llu ; frame_TS: %f ; ros_TS(NSec): %lu",
-                              rs2_stream_to_string(stream_type), stream_index, frame.get_frame_number(), frame.get_timestamp(), t.toNSec());
-
-                    if (stream_type == RS2_STREAM_DEPTH)
-                    {
-                        filterFrame(frame);
-                    }
-
-                    stream_index_pair sip{stream_type,stream_index};
-                    publishFrame(frame, t,
-                                 sip,
-                                 _image,
-                                 _info_publisher,
-                                 _image_publishers, _seq,
-                                 _camera_info, _optical_frame_id,
-                                 _encoding);
-                }
-
-                if(_pointcloud && (0 != _pointcloud_xyzrgb_publisher.getNumSubscribers()))
-                {
-                    ROS_DEBUG("publishRgbToDepthPCTopic(...)");
-                    publishRgbToDepthPCTopic(t, is_frame_arrived);
-                }
-                if(_pointcloud && (0 != _pointcloud_xyz_publisher.getNumSubscribers()))
-                {
-                    ROS_DEBUG("publishDepthPCTopic(...)");
-                    publishDepthPCTopic(t, is_frame_arrived);
-                }
-            }
-            catch(const std::exception& ex)
-            {
-                ROS_ERROR_STREAM("An error has occurred during frame callback: " << ex.what());
-            }
+            ingestFrame(frame);
         }; // _frame_callback
 
         // Streaming IMAGES
@@ -979,14 +1519,15 @@ void RealSenseNode::setupStreams()
                           rs2_timestamp_domain_to_string(frame.get_frame_timestamp_domain()));
 
                 auto stream_index = (stream == GYRO.first)?GYRO:ACCEL;
-                if (0 != _info_publisher[stream_index].getNumSubscribers() ||
-                    0 != _imu_publishers[stream_index].getNumSubscribers())
+                auto& state = _streams[(stream == GYRO.first)?GYRO_ID:ACCEL_ID];
+                if (0 != state.info_publisher.getNumSubscribers() ||
+                    0 != state.imu_publisher.getNumSubscribers())
                 {
                     double elapsed_camera_ms = (/*ms*/ frame.get_timestamp() - /*ms*/ _camera_time_base) / /*ms to seconds*/ 1000;
                     ros::Time t(_ros_time_base.toSec() + elapsed_camera_ms);
 
                     auto imu_msg = sensor_msgs::Imu();
-                    imu_msg.header.frame_id = _optical_frame_id[stream_index];
+                    imu_msg.header.frame_id = state.optical_frame_id;
                     imu_msg.orientation.x = 0.0;
                     imu_msg.orientation.y = 0.0;
                     imu_msg.orientation.z = 0.0;
@@ -1006,10 +1547,10 @@ void RealSenseNode::setupStreams()
                         imu_msg.linear_acceleration.y = axes.y;
                         imu_msg.linear_acceleration.z = axes.z;
                     }
-                    _seq[stream_index] += 1;
-                    imu_msg.header.seq = _seq[stream_index];
+                    state.seq += 1;
+                    imu_msg.header.seq = state.seq;
                     imu_msg.header.stamp = t;
-                    _imu_publishers[stream_index].publish(imu_msg);
+                    state.imu_publisher.publish(imu_msg);
                     ROS_DEBUG("Publish %s stream", rs2_stream_to_string(frame.get_profile().stream_type()));
                 }
             });
@@ -1018,14 +1559,14 @@ void RealSenseNode::setupStreams()
             {
                 ROS_INFO_STREAM(_stream_name[GYRO] << " stream is enabled - " << "fps: " << _fps[GYRO]);
                 auto gyroInfo = getImuInfo(GYRO);
-                _info_publisher[GYRO].publish(gyroInfo);
+                streamState(GYRO).info_publisher.publish(gyroInfo);
             }
 
             if (_enable[ACCEL])
             {
                 ROS_INFO_STREAM(_stream_name[ACCEL] << " stream is enabled - " << "fps: " << _fps[ACCEL]);
                 auto accelInfo = getImuInfo(ACCEL);
-                _info_publisher[ACCEL].publish(accelInfo);
+                streamState(ACCEL).info_publisher.publish(accelInfo);
             }
         }
 
@@ -1034,7 +1575,7 @@ void RealSenseNode::setupStreams()
         {
             static const char* frame_id = "depth_to_fisheye_extrinsics";
             auto ex = getRsExtrinsics(DEPTH, FISHEYE);
-            _depth_to_other_extrinsics[FISHEYE] = ex;
+            streamState(FISHEYE).depth_to_other = ex;
             _depth_to_other_extrinsics_publishers[FISHEYE].publish(rsExtrinsicsToMsg(ex, frame_id));
         }
 
@@ -1043,7 +1584,7 @@ void RealSenseNode::setupStreams()
         {
             static const char* frame_id = "depth_to_color_extrinsics";
             auto ex = getRsExtrinsics(DEPTH, COLOR);
-            _depth_to_other_extrinsics[COLOR] = ex;
+            streamState(COLOR).depth_to_other = ex;
             _depth_to_other_extrinsics_publishers[COLOR].publish(rsExtrinsicsToMsg(ex, frame_id));
         }
 
@@ -1052,7 +1593,7 @@ void RealSenseNode::setupStreams()
         {
             static const char* frame_id = "depth_to_infra1_extrinsics";
             auto ex = getRsExtrinsics(DEPTH, INFRA1);
-            _depth_to_other_extrinsics[INFRA1] = ex;
+            streamState(INFRA1).depth_to_other = ex;
             _depth_to_other_extrinsics_publishers[INFRA1].publish(rsExtrinsicsToMsg(ex, frame_id));
         }
 
@@ -1061,7 +1602,7 @@ void RealSenseNode::setupStreams()
         {
             static const char* frame_id = "depth_to_infra2_extrinsics";
             auto ex = getRsExtrinsics(DEPTH, INFRA2);
-            _depth_to_other_extrinsics[INFRA2] = ex;
+            streamState(INFRA2).depth_to_other = ex;
             _depth_to_other_extrinsics_publishers[INFRA2].publish(rsExtrinsicsToMsg(ex, frame_id));
         }
     }
@@ -1081,29 +1622,25 @@ void RealSenseNode::updateStreamCalibData(const rs2::video_stream_profile& video
 {
     stream_index_pair stream_index{video_profile.stream_type(), video_profile.stream_index()};
     auto intrinsic = video_profile.get_intrinsics();
-    _stream_intrinsics[stream_index] = intrinsic;
-    _camera_info[stream_index].width = intrinsic.width;
-    _camera_info[stream_index].height = intrinsic.height;
-    _camera_info[stream_index].header.frame_id = _optical_frame_id[stream_index];
-
-    _camera_info[stream_index].K.at(0) = intrinsic.fx;
-    _camera_info[stream_index].K.at(2) = intrinsic.ppx;
-    _camera_info[stream_index].K.at(4) = intrinsic.fy;
-    _camera_info[stream_index].K.at(5) = intrinsic.ppy;
-    _camera_info[stream_index].K.at(8) = 1;
-
-    _camera_info[stream_index].P.at(0) = _camera_info[stream_index].K.at(0);
-    _camera_info[stream_index].P.at(1) = 0;
-    _camera_info[stream_index].P.at(2) = _camera_info[stream_index].K.at(2);
-    _camera_info[stream_index].P.at(3) = 0;
-    _camera_info[stream_index].P.at(4) = 0;
-    _camera_info[stream_index].P.at(5) = _camera_info[stream_index].K.at(4);
-    _camera_info[stream_index].P.at(6) = _camera_info[stream_index].K.at(5);
-    _camera_info[stream_index].P.at(7) = 0;
-    _camera_info[stream_index].P.at(8) = 0;
-    _camera_info[stream_index].P.at(9) = 0;
-    _camera_info[stream_index].P.at(10) = 1;
-    _camera_info[stream_index].P.at(11) = 0;
+    auto& state = streamState(stream_index);
+    auto& camera_info = state.camera_info;
+    state.intrinsics = intrinsic;
+    state.profile_info_id = -1;
+    if (DEPTH == stream_index)
+        state.rays.update(intrinsic, pointCloudTransform());
+    camera_info.header.frame_id = state.optical_frame_id;
+
+    setCameraInfoGeometry(intrinsic, camera_info);
+    camera_info.K.at(8) = 1;
+
+    camera_info.P.at(1) = 0;
+    camera_info.P.at(3) = 0;
+    camera_info.P.at(4) = 0;
+    camera_info.P.at(7) = 0;
+    camera_info.P.at(8) = 0;
+    camera_info.P.at(9) = 0;
+    camera_info.P.at(10) = 1;
+    camera_info.P.at(11) = 0;
 
     rs2::stream_profile depth_profile;
     if (!getEnabledProfile(DEPTH, depth_profile))
@@ -1114,44 +1651,62 @@ void RealSenseNode::updateStreamCalibData(const rs2::video_stream_profile& video
     }
 
 
-    _camera_info[stream_index].distortion_model = "plumb_bob";
+    camera_info.distortion_model = "plumb_bob";
 
     // set R (rotation matrix) values to identity matrix
-    _camera_info[stream_index].R.at(0) = 1.0;
-    _camera_info[stream_index].R.at(1) = 0.0;
-    _camera_info[stream_index].R.at(2) = 0.0;
-    _camera_info[stream_index].R.at(3) = 0.0;
-    _camera_info[stream_index].R.at(4) = 1.0;
-    _camera_info[stream_index].R.at(5) = 0.0;
-    _camera_info[stream_index].R.at(6) = 0.0;
-    _camera_info[stream_index].R.at(7) = 0.0;
-    _camera_info[stream_index].R.at(8) = 1.0;
+    camera_info.R.at(0) = 1.0;
+    camera_info.R.at(1) = 0.0;
+    camera_info.R.at(2) = 0.0;
+    camera_info.R.at(3) = 0.0;
+    camera_info.R.at(4) = 1.0;
+    camera_info.R.at(5) = 0.0;
+    camera_info.R.at(6) = 0.0;
+    camera_info.R.at(7) = 0.0;
+    camera_info.R.at(8) = 1.0;
 
     for (int i = 0; i < 5; i++)
     {
-        _camera_info[stream_index].D.push_back(intrinsic.coeffs[i]);
+        camera_info.D.push_back(intrinsic.coeffs[i]);
     }
 
     if (stream_index == DEPTH && _enable[DEPTH] && _enable[COLOR])
     {
-        _camera_info[stream_index].P.at(3) = 0;     // Tx
-        _camera_info[stream_index].P.at(7) = 0;     // Ty
+        camera_info.P.at(3) = 0;     // Tx
+        camera_info.P.at(7) = 0;     // Ty
     }
 
-    if (_align_depth)
+    if (DEPTH == stream_index)
     {
-        for (auto& profiles : _enabled_profiles)
-        {
-            for (auto& profile : profiles.second)
-            {
-                auto video_profile = profile.as<rs2::video_stream_profile>();
-                stream_index_pair stream_index{video_profile.stream_type(), video_profile.stream_index()};
-                _depth_aligned_camera_info[stream_index] = _camera_info[stream_index];
-            }
-        }
+        _filtered_depth.camera_info = camera_info;
+        _filtered_depth.profile_info_id = -1;
+    }
+
+    if (_align_depth && DEPTH == stream_index)
+    {
+        _color_aligned_to_depth.camera_info = camera_info;
+        _color_aligned_to_depth.profile_info_id = -1;
+    }
+    else if (_align_depth)
+    {
+        // Depth aligned to this stream has its geometry, scaled by align_depth_output_scale
+        auto& aligned_state = _depth_aligned_streams[streamId(stream_index)];
+        aligned_state.intrinsics = scaleIntrinsics(intrinsic, _align_depth_output_scale);
+        auto& aligned_info = aligned_state.camera_info;
+        aligned_info = camera_info;
+        setCameraInfoGeometry(aligned_state.intrinsics, aligned_info);
     }
 }
 
+void RealSenseNode::setCameraInfoGeometry(const rs2_intrinsics& intrinsics, sensor_msgs::CameraInfo& camera_info)
+{
+    camera_info.width = intrinsics.width;
+    camera_info.height = intrinsics.height;
+    camera_info.K.at(0) = camera_info.P.at(0) = intrinsics.fx;
+    camera_info.K.at(2) = camera_info.P.at(2) = intrinsics.ppx;
+    camera_info.K.at(4) = camera_info.P.at(5) = intrinsics.fy;
+    camera_info.K.at(5) = camera_info.P.at(6) = intrinsics.ppy;
+}
+
 tf::Quaternion RealSenseNode::rotationMatrixToQuaternion(const float rotation[9]) const
 {
     Eigen::Matrix3f m;
@@ -1202,7 +1757,7 @@ void RealSenseNode::publishStaticTransforms()
 
     // Transform depth frame to depth optical frame
     quaternion q{quaternion_optical.getX(), quaternion_optical.getY(), quaternion_optical.getZ(), quaternion_optical.getW()};
-    publish_static_tf(transform_ts_, zero_trans, q, _frame_id[DEPTH], _optical_frame_id[DEPTH]);
+    publish_static_tf(transform_ts_, zero_trans, q, _frame_id[DEPTH], streamState(DEPTH).optical_frame_id);
 
     rs2::stream_profile depth_profile;
     if (!getEnabledProfile(DEPTH, depth_profile))
@@ -1226,12 +1781,12 @@ void RealSenseNode::publishStaticTransforms()
 
         // Transform color frame to color optical frame
         quaternion q2{quaternion_optical.getX(), quaternion_optical.getY(), quaternion_optical.getZ(), quaternion_optical.getW()};
-        publish_static_tf(transform_ts_, zero_trans, q2, _frame_id[COLOR], _optical_frame_id[COLOR]);
+        publish_static_tf(transform_ts_, zero_trans, q2, _frame_id[COLOR], streamState(COLOR).optical_frame_id);
 
         if (_align_depth)
         {
             publish_static_tf(transform_ts_, trans, q1, _base_frame_id, _depth_aligned_frame_id[COLOR]);
-            publish_static_tf(transform_ts_, zero_trans, q2, _depth_aligned_frame_id[COLOR], _optical_frame_id[COLOR]);
+            publish_static_tf(transform_ts_, zero_trans, q2, _depth_aligned_frame_id[COLOR], streamState(COLOR).optical_frame_id);
         }
     }
 
@@ -1248,12 +1803,12 @@ void RealSenseNode::publishStaticTransforms()
 
         // Transform infra1 frame to infra1 optical frame
         quaternion q2{quaternion_optical.getX(), quaternion_optical.getY(), quaternion_optical.getZ(), quaternion_optical.getW()};
-        publish_static_tf(transform_ts_, zero_trans, q2, _frame_id[INFRA1], _optical_frame_id[INFRA1]);
+        publish_static_tf(transform_ts_, zero_trans, q2, _frame_id[INFRA1], streamState(INFRA1).optical_frame_id);
 
         if (_align_depth)
         {
             publish_static_tf(transform_ts_, trans, q1, _base_frame_id, _depth_aligned_frame_id[INFRA1]);
-            publish_static_tf(transform_ts_, zero_trans, q2, _depth_aligned_frame_id[INFRA1], _optical_frame_id[INFRA1]);
+            publish_static_tf(transform_ts_, zero_trans, q2, _depth_aligned_frame_id[INFRA1], streamState(INFRA1).optical_frame_id);
         }
     }
 
@@ -1270,12 +1825,12 @@ void RealSenseNode::publishStaticTransforms()
 
         // Transform infra2 frame to infra1 optical frame
         quaternion q2{quaternion_optical.getX(), quaternion_optical.getY(), quaternion_optical.getZ(), quaternion_optical.getW()};
-        publish_static_tf(transform_ts_, zero_trans, q2, _frame_id[INFRA2], _optical_frame_id[INFRA2]);
+        publish_static_tf(transform_ts_, zero_trans, q2, _frame_id[INFRA2], streamState(INFRA2).optical_frame_id);
 
         if (_align_depth)
         {
             publish_static_tf(transform_ts_, trans, q1, _base_frame_id, _depth_aligned_frame_id[INFRA2]);
-            publish_static_tf(transform_ts_, zero_trans, q2, _depth_aligned_frame_id[INFRA2], _optical_frame_id[INFRA2]);
+            publish_static_tf(transform_ts_, zero_trans, q2, _depth_aligned_frame_id[INFRA2], streamState(INFRA2).optical_frame_id);
         }
     }
 
@@ -1292,40 +1847,84 @@ void RealSenseNode::publishStaticTransforms()
 
         // Transform infra2 frame to infra1 optical frame
         quaternion q2{quaternion_optical.getX(), quaternion_optical.getY(), quaternion_optical.getZ(), quaternion_optical.getW()};
-        publish_static_tf(transform_ts_, zero_trans, q2, _frame_id[FISHEYE], _optical_frame_id[FISHEYE]);
+        publish_static_tf(transform_ts_, zero_trans, q2, _frame_id[FISHEYE], streamState(FISHEYE).optical_frame_id);
 
         if (_align_depth)
         {
             publish_static_tf(transform_ts_, trans, q1, _base_frame_id, _depth_aligned_frame_id[FISHEYE]);
-            publish_static_tf(transform_ts_, zero_trans, q2, _depth_aligned_frame_id[FISHEYE], _optical_frame_id[FISHEYE]);
+            publish_static_tf(transform_ts_, zero_trans, q2, _depth_aligned_frame_id[FISHEYE], streamState(FISHEYE).optical_frame_id);
         }
     }
 }
 
-void RealSenseNode::publishDepthPCTopic(const ros::Time& t, const std::map<stream_index_pair, bool>& is_frame_arrived)
+void RealSenseNode::setupPointCloudFrame()
 {
-    try
+    _pnh.param("pointcloud_frame_id", _pointcloud_frame_id, POINTCLOUD_FRAME_ID);
+    _pointcloud_transformed = false;
+    if (_pointcloud_frame_id.empty() || _pointcloud_frame_id == streamState(DEPTH).optical_frame_id)
     {
-        if (!is_frame_arrived.at(DEPTH))
+        _pointcloud_frame_id = streamState(DEPTH).optical_frame_id;
+        return;
+    }
+
+    tf::Quaternion rotation(0, 0, 0, 1);
+    double translation[3] = {0, 0, 0};
+    if (_pointcloud_frame_id == _base_frame_id || _pointcloud_frame_id == _frame_id[DEPTH])
+    {
+        // Same as the static transforms: the depth frame is the base link,
+        // and only the optical rotation separates it from the depth optical frame
+        rotation.setRPY(-M_PI / 2, 0.0, -M_PI / 2);
+    }
+    else
+    {
+        // Pose of the depth optical frame in the requested frame: [x, y, z, qx, qy, qz, qw]
+        std::vector<double> pose;
+        if (!_pnh.getParam("pointcloud_transform", pose) || pose.size() != 7)
         {
-            ROS_DEBUG("Skipping publish PC topic! Depth frame didn't arrive.");
+            ROS_WARN_STREAM("pointcloud_frame_id " << _pointcloud_frame_id << " needs pointcloud_transform as "
+                            "[x, y, z, qx, qy, qz, qw], publishing the point clouds in "
+                            << streamState(DEPTH).optical_frame_id << " instead");
+            _pointcloud_frame_id = streamState(DEPTH).optical_frame_id;
             return;
         }
+        std::copy(pose.begin(), pose.begin() + 3, translation);
+        rotation = tf::Quaternion(pose[3], pose[4], pose[5], pose[6]);
     }
-    catch (std::out_of_range)
+
+    // rs2 rotations are column-major
+    Eigen::Matrix3d m = Eigen::Quaterniond(rotation.getW(), rotation.getX(), rotation.getY(), rotation.getZ())
+                            .normalized().toRotationMatrix();
+    for (int row = 0; row < 3; ++row)
     {
-        ROS_DEBUG("Skipping publish PC topic! Depth frame didn't configure.");
-        return;
+        for (int col = 0; col < 3; ++col)
+            _pointcloud_transform.rotation[col * 3 + row] = m(row, col);
+        _pointcloud_transform.translation[row] = translation[row];
+    }
+    _pointcloud_transformed = true;
+    ROS_INFO_STREAM("Point clouds are published in " << _pointcloud_frame_id);
+}
+
+const rs2_extrinsics* RealSenseNode::pointCloudTransform() const
+{
+    return _pointcloud_transformed ? &_pointcloud_transform : nullptr;
+}
+
+sensor_msgs::PointCloud2Ptr RealSenseNode::createDepthPCMsg(const FrameJob& job)
+{
+    if (!job.is_frame_arrived.test(DEPTH_ID))
+    {
+        ROS_DEBUG("Skipping publish PC topic! Depth frame didn't arrive.");
+        return nullptr;
     }
 
 
-    auto image_depth16 = reinterpret_cast<const uint16_t*>(_image[DEPTH].data);
-    auto depth_intrinsics = _stream_intrinsics[DEPTH];
-    sensor_msgs::PointCloud2 msg_pointcloud;
-    msg_pointcloud.header.stamp = t;
-    msg_pointcloud.header.frame_id = _optical_frame_id[DEPTH];
-    msg_pointcloud.width = depth_intrinsics.width;
-    msg_pointcloud.height = depth_intrinsics.height;
+    auto depth_intrinsics = job.depth_intrinsics;
+    sensor_msgs::PointCloud2Ptr msg_pointcloud_ptr = _pointcloud_xyz_pool.acquire();
+    auto& msg_pointcloud = *msg_pointcloud_ptr;
+    msg_pointcloud.header.stamp = job.t;
+    msg_pointcloud.header.frame_id = _pointcloud_frame_id;
+    auto params = pointCloudParams(depth_intrinsics);
+    setPointCloudSize(msg_pointcloud, params);
     msg_pointcloud.is_dense = true;
 
     sensor_msgs::PointCloud2Modifier modifier(msg_pointcloud);
@@ -1336,66 +1935,25 @@ void RealSenseNode::publishDepthPCTopic(const ros::Time& t, const std::map<strea
                                   "z", 1, sensor_msgs::PointField::FLOAT32);
     modifier.setPointCloud2FieldsByString(1, "xyz");
 
-    sensor_msgs::PointCloud2Iterator<float>iter_x(msg_pointcloud, "x");
-    sensor_msgs::PointCloud2Iterator<float>iter_y(msg_pointcloud, "y");
-    sensor_msgs::PointCloud2Iterator<float>iter_z(msg_pointcloud, "z");
-
-    float depth_point[3], scaled_depth;
-
-
-    // Fill the PointCloud2 fields
-    for (int y = 0; y < depth_intrinsics.height; ++y)
-    {
-        for (int x = 0; x < depth_intrinsics.width; ++x)
-        {
-            scaled_depth = static_cast<float>(*image_depth16) * _depth_scale_meters;
-            float depth_pixel[2] = {static_cast<float>(x), static_cast<float>(y)};
-            rs2_deproject_pixel_to_point(depth_point, &depth_intrinsics, depth_pixel, scaled_depth);
-
-            if (depth_point[2] <= 0.f)
-            {
-                depth_point[0] = 0.f;
-                depth_point[1] = 0.f;
-                depth_point[2] = 0.f;
-            }
-
-            *iter_x = depth_point[0];
-            *iter_y = depth_point[1];
-            *iter_z = depth_point[2];
-
-            ++image_depth16;
-            ++iter_x; ++iter_y; ++iter_z;
-        }
-    }
-
-    _pointcloud_xyz_publisher.publish(msg_pointcloud);
+    fillPointCloud(job, params, false, msg_pointcloud);
+    return msg_pointcloud_ptr;
 }
 
-void RealSenseNode::publishRgbToDepthPCTopic(const ros::Time& t, const std::map<stream_index_pair, bool>& is_frame_arrived)
+sensor_msgs::PointCloud2Ptr RealSenseNode::createRgbToDepthPCMsg(const FrameJob& job)
 {
-    try
-    {
-        if (!is_frame_arrived.at(COLOR) || !is_frame_arrived.at(DEPTH))
-        {
-            ROS_DEBUG("Skipping publish PC topic! Color or Depth frame didn't arrive.");
-            return;
-        }
-    }
-    catch (std::out_of_range)
+    if (!job.is_frame_arrived.test(COLOR_ID) || !job.is_frame_arrived.test(DEPTH_ID))
     {
-        ROS_DEBUG("Skipping publish PC topic! Color or Depth frame didn't configure.");
-        return;
+        ROS_DEBUG("Skipping publish PC topic! Color or Depth frame didn't arrive.");
+        return nullptr;
     }
 
-    auto& depth2color_extrinsics = _depth_to_other_extrinsics[COLOR];
-    auto color_intrinsics = _stream_intrinsics[COLOR];
-    auto image_depth16 = reinterpret_cast<const uint16_t*>(_image[DEPTH].data);
-    auto depth_intrinsics = _stream_intrinsics[DEPTH];
-    sensor_msgs::PointCloud2 msg_pointcloud;
-    msg_pointcloud.header.stamp = t;
-    msg_pointcloud.header.frame_id = _optical_frame_id[DEPTH];
-    msg_pointcloud.width = depth_intrinsics.width;
-    msg_pointcloud.height = depth_intrinsics.height;
+    auto depth_intrinsics = job.depth_intrinsics;
+    sensor_msgs::PointCloud2Ptr msg_pointcloud_ptr = _pointcloud_xyzrgb_pool.acquire();
+    auto& msg_pointcloud = *msg_pointcloud_ptr;
+    msg_pointcloud.header.stamp = job.t;
+    msg_pointcloud.header.frame_id = _pointcloud_frame_id;
+    auto params = pointCloudParams(depth_intrinsics);
+    setPointCloudSize(msg_pointcloud, params);
     msg_pointcloud.is_dense = true;
 
     sensor_msgs::PointCloud2Modifier modifier(msg_pointcloud);
@@ -1407,67 +1965,388 @@ void RealSenseNode::publishRgbToDepthPCTopic(const ros::Time& t, const std::map<
                                   "rgb", 1, sensor_msgs::PointField::FLOAT32);
     modifier.setPointCloud2FieldsByString(2, "xyz", "rgb");
 
-    sensor_msgs::PointCloud2Iterator<float>iter_x(msg_pointcloud, "x");
-    sensor_msgs::PointCloud2Iterator<float>iter_y(msg_pointcloud, "y");
-    sensor_msgs::PointCloud2Iterator<float>iter_z(msg_pointcloud, "z");
+    fillPointCloud(job, params, true, msg_pointcloud);
+    return msg_pointcloud_ptr;
+}
+
+sensor_msgs::PointCloud2Ptr RealSenseNode::createNormalsPCMsg(const FrameJob& job)
+{
+    if (!job.is_frame_arrived.test(DEPTH_ID))
+    {
+        ROS_DEBUG("Skipping publish PC topic! Depth frame didn't arrive.");
+        return nullptr;
+    }
+
+    // Integral images need the pixel grid, so this cloud is always organized and never downsampled
+    auto depth_intrinsics = job.depth_intrinsics;
+    auto params = pointCloudParams(depth_intrinsics);
+    params.compact = false;
+    auto width = (params.x_end - params.x_begin + params.stride - 1) / params.stride;
+    auto height = (params.y_end - params.y_begin + params.stride - 1) / params.stride;
+
+    sensor_msgs::PointCloud2Ptr msg_pointcloud_ptr = _pointcloud_normals_pool.acquire();
+    auto& msg = *msg_pointcloud_ptr;
+    msg.header.stamp = job.t;
+    msg.header.frame_id = _pointcloud_frame_id;
+    msg.height = height;
+    msg.width = width;
+    msg.is_dense = false;   // Normals of invalid points are NaN
+    msg.is_bigendian = false;
+
+    // Same layout as pcl::PointNormal, so PCL converts it with a plain copy
+    msg.fields.clear();
+    auto add_field = [&msg](const std::string& name, uint32_t offset)
+    {
+        sensor_msgs::PointField field;
+        field.name = name;
+        field.offset = offset;
+        field.datatype = sensor_msgs::PointField::FLOAT32;
+        field.count = 1;
+        msg.fields.push_back(field);
+    };
+    add_field("x", 0);
+    add_field("y", 4);
+    add_field("z", 8);
+    add_field("normal_x", 16);
+    add_field("normal_y", 20);
+    add_field("normal_z", 24);
+    add_field("curvature", 32);
+    msg.point_step = 48;
+    msg.row_step = width * msg.point_step;
+    msg.data.resize(height * msg.row_step);
+
+    auto image_depth16 = reinterpret_cast<const uint16_t*>(job.depth_frame.get_data());
+    auto& depth_rays = streamState(DEPTH).rays;
+    depth_rays.update(depth_intrinsics, pointCloudTransform());
+    auto point_step = msg.point_step / sizeof(float);
+    auto points = reinterpret_cast<float*>(msg.data.data());
+    auto tiles = (height + _pointcloud_tile_rows - 1) / _pointcloud_tile_rows;
+    auto tile_end = [this, height](int tile){ return std::min(height, (tile + 1) * _pointcloud_tile_rows); };
+
+    // Rows are summed right after they are deprojected, while they are still in cache
+    _normal_estimation.resize(width, height);
+    _worker_pool->parallelFor(tiles, [&](int index)
+    {
+        for (int r = index * _pointcloud_tile_rows; r < tile_end(index); ++r)
+        {
+            auto y = params.y_begin + r * params.stride;
+            auto row_points = points + r * width * point_step;
+            deprojectDepthRow(depth_rays, y, image_depth16 + y * depth_intrinsics.width, params, row_points, point_step);
+            _normal_estimation.addRow(r, row_points, point_step);
+        }
+    });
+
+    const int column_block = 64;
+    _worker_pool->parallelFor((width + column_block - 1) / column_block, [&](int index)
+    {
+        _normal_estimation.integrateColumns(index * column_block, std::min(width, (index + 1) * column_block));
+    });
+
+    // Normals face the camera, which is at the origin of the optical frame
+    float viewpoint[3] = {0.f, 0.f, 0.f};
+    if (_pointcloud_transformed)
+        std::copy(_pointcloud_transform.translation, _pointcloud_transform.translation + 3, viewpoint);
+    auto half_window = _pointcloud_normals_window / 2;
+    _worker_pool->parallelFor(tiles, [&](int index)
+    {
+        for (int r = index * _pointcloud_tile_rows; r < tile_end(index); ++r)
+            _normal_estimation.computeRow(r, half_window, viewpoint, points + r * width * point_step, point_step);
+    });
+    return msg_pointcloud_ptr;
+}
 
-    sensor_msgs::PointCloud2Iterator<uint8_t>iter_r(msg_pointcloud, "r");
-    sensor_msgs::PointCloud2Iterator<uint8_t>iter_g(msg_pointcloud, "g");
-    sensor_msgs::PointCloud2Iterator<uint8_t>iter_b(msg_pointcloud, "b");
+sensor_msgs::PointCloud2Ptr RealSenseNode::createIntensityPCMsg(const FrameJob& job)
+{
+    if (!job.infra1_frame || !job.is_frame_arrived.test(DEPTH_ID))
+    {
+        ROS_DEBUG("Skipping publish PC topic! Infra1 or Depth frame didn't arrive.");
+        return nullptr;
+    }
 
-    float depth_point[3], color_point[3], color_pixel[2], scaled_depth;
-    unsigned char* color_data = _image[COLOR].data;
+    // INFRA1 is the depth reference camera, its pixels are the depth pixels as long as nothing resized depth
+    auto depth_intrinsics = job.depth_intrinsics;
+    auto infra1 = job.infra1_frame.as<rs2::video_frame>();
+    if (infra1.get_width() != depth_intrinsics.width || infra1.get_height() != depth_intrinsics.height)
+    {
+        ROS_WARN_STREAM_THROTTLE(10, "depth/points_intensity needs the same infra1 and depth resolution, got "
+                                 << infra1.get_width() << "x" << infra1.get_height() << " and "
+                                 << depth_intrinsics.width << "x" << depth_intrinsics.height);
+        return nullptr;
+    }
 
-    // Fill the PointCloud2 fields
-    for (int y = 0; y < depth_intrinsics.height; ++y)
+    // Follows pointcloud_organized, but is never voxel-downsampled
+    auto params = pointCloudParams(depth_intrinsics);
+    params.compact = !_pointcloud_organized;
+    auto width = (params.x_end - params.x_begin + params.stride - 1) / params.stride;
+    auto height = (params.y_end - params.y_begin + params.stride - 1) / params.stride;
+
+    sensor_msgs::PointCloud2Ptr msg_pointcloud_ptr = _pointcloud_intensity_pool.acquire();
+    auto& msg = *msg_pointcloud_ptr;
+    msg.header.stamp = job.t;
+    msg.header.frame_id = _pointcloud_frame_id;
+    msg.height = params.compact ? 1 : height;
+    msg.width = params.compact ? width * height : width;
+    msg.is_dense = true;
+    msg.is_bigendian = false;
+
+    // Same layout as pcl::PointXYZI
+    msg.fields.clear();
+    auto add_field = [&msg](const std::string& name, uint32_t offset)
     {
-        for (int x = 0; x < depth_intrinsics.width; ++x)
+        sensor_msgs::PointField field;
+        field.name = name;
+        field.offset = offset;
+        field.datatype = sensor_msgs::PointField::FLOAT32;
+        field.count = 1;
+        msg.fields.push_back(field);
+    };
+    add_field("x", 0);
+    add_field("y", 4);
+    add_field("z", 8);
+    add_field("intensity", 16);
+    msg.point_step = 32;
+    msg.row_step = msg.width * msg.point_step;
+    msg.data.resize(msg.height * msg.row_step);
+
+    auto image_depth16 = reinterpret_cast<const uint16_t*>(job.depth_frame.get_data());
+    auto infra1_data = reinterpret_cast<const uint8_t*>(infra1.get_data());
+    auto infra1_bpp = infra1.get_bytes_per_pixel();
+    auto& depth_rays = streamState(DEPTH).rays;
+    depth_rays.update(depth_intrinsics, pointCloudTransform());
+    auto point_step = msg.point_step / sizeof(float);
+    auto points = reinterpret_cast<float*>(msg.data.data());
+    auto tiles = (height + _pointcloud_tile_rows - 1) / _pointcloud_tile_rows;
+    if (_pointcloud_tiles.size() < static_cast<size_t>(tiles))
+        _pointcloud_tiles.resize(tiles);
+
+    // Rows are deprojected whole, then the intensities go in while the row is in cache, dropping
+    // invalid points on the way when compacting. Tiles start at their organized offset and are
+    // packed together afterwards, as in fillPointCloud.
+    _worker_pool->parallelFor(tiles, [&](int index)
+    {
+        auto& tile = _pointcloud_tiles[index];
+        auto organized = params;
+        organized.compact = false;
+        tile.count = 0;
+        auto last = std::min(height, (index + 1) * _pointcloud_tile_rows);
+        for (int r = index * _pointcloud_tile_rows; r < last; ++r)
         {
-            scaled_depth = static_cast<float>(*image_depth16) * _depth_scale_meters;
-            float depth_pixel[2] = {static_cast<float>(x), static_cast<float>(y)};
-            rs2_deproject_pixel_to_point(depth_point, &depth_intrinsics, depth_pixel, scaled_depth);
+            auto y = params.y_begin + r * params.stride;
+            auto row = points + (static_cast<size_t>(index) * _pointcloud_tile_rows * width + tile.count) * point_step;
+            deprojectDepthRow(depth_rays, y, image_depth16 + y * depth_intrinsics.width, organized, row, point_step);
 
-            if (depth_point[2] <= 0.f || depth_point[2] > 5.f)
+            auto infra1_row = infra1_data + (y * depth_intrinsics.width + params.x_begin) * infra1_bpp;
+            size_t kept = 0;
+            for (int i = 0; i < width; ++i)
             {
-                depth_point[0] = 0.f;
-                depth_point[1] = 0.f;
-                depth_point[2] = 0.f;
-            }
+                auto point = row + i * point_step;
+                if (params.compact && 0.f == point[0] && 0.f == point[1] && 0.f == point[2])
+                    continue;
 
-            *iter_x = depth_point[0];
-            *iter_y = depth_point[1];
-            *iter_z = depth_point[2];
+                auto pixel = infra1_row + i * params.stride * infra1_bpp;
+                float intensity = (2 == infra1_bpp) ? *reinterpret_cast<const uint16_t*>(pixel) : *pixel;
+                auto out = row + kept * point_step;
+                if (out != point)
+                    std::copy(point, point + 3, out);
+                out[4] = intensity;
+                ++kept;
+            }
+            tile.count += kept;
+        }
+    });
 
-            rs2_transform_point_to_point(color_point, &depth2color_extrinsics, depth_point);
-            rs2_project_point_to_pixel(color_pixel, &color_intrinsics, color_point);
+    if (params.compact)
+    {
+        auto data = msg.data.data();
+        size_t count = 0;
+        for (int index = 0; index < tiles; ++index)
+        {
+            size_t first = static_cast<size_t>(index) * _pointcloud_tile_rows * width;
+            auto tile_count = _pointcloud_tiles[index].count;
+            if (count != first)
+                std::memmove(data + count * msg.point_step, data + first * msg.point_step, tile_count * msg.point_step);
+            count += tile_count;
+        }
+        sensor_msgs::PointCloud2Modifier modifier(msg);
+        modifier.resize(count);
+    }
+    return msg_pointcloud_ptr;
+}
 
-            if (color_pixel[1] < 0.f || color_pixel[1] >= color_intrinsics.height
-                || color_pixel[0] < 0.f || color_pixel[0] >= color_intrinsics.width)
+void RealSenseNode::fillPointCloud(const FrameJob& job, const DeprojectionParams& params, bool with_color,
+                                   sensor_msgs::PointCloud2& msg)
+{
+    auto image_depth16 = reinterpret_cast<const uint16_t*>(job.depth_frame.get_data());
+    auto depth_width = job.depth_intrinsics.width;
+    auto& depth_rays = streamState(DEPTH).rays;
+    depth_rays.update(job.depth_intrinsics, pointCloudTransform());
+
+    auto rgb_offset = with_color ? static_cast<int>(msg.fields.back().offset) : -1;
+    auto row_points = (params.x_end - params.x_begin + params.stride - 1) / params.stride;
+    auto rows = (params.y_end - params.y_begin + params.stride - 1) / params.stride;
+    auto tiles = (rows + _pointcloud_tile_rows - 1) / _pointcloud_tile_rows;
+    if (_pointcloud_tiles.size() < static_cast<size_t>(tiles))
+        _pointcloud_tiles.resize(tiles);
+
+    // Colors the points of one row while they are still in cache
+    auto& color_state = streamState(COLOR);
+    auto color_data = with_color ? reinterpret_cast<const uint8_t*>(job.color_frame.get_data()) : nullptr;
+    // Points come out of the kernel in the point cloud frame, take them back to the depth optical frame first
+    auto to_color = color_state.depth_to_other;
+    if (with_color && _pointcloud_transformed)
+        to_color = composeExtrinsics(inverseExtrinsics(_pointcloud_transform), to_color);
+    // When depth was aligned to color the aligner already picked the color of every depth pixel,
+    // the points of the row take theirs, walking the pixels as deprojectDepthRow does
+    auto color_row = [&](PointCloudTile& tile, int y, const float* points, int point_step, int count,
+                         uint8_t* rgb_out, size_t rgb_step)
+    {
+        if (job.has_depth_pixel_rgb)
+        {
+            auto depth_row = image_depth16 + y * depth_width;
+            auto rgb_row = job.depth_pixel_rgb.data() + y * depth_width;
+            for (int x = params.x_begin; x < params.x_end; x += params.stride)
             {
-                // For out of bounds color data, default to a shade of blue in order to visually distinguish holes.
-                // This color value is same as the librealsense out of bounds color value.
-                *iter_r = static_cast<uint8_t>(96);
-                *iter_g = static_cast<uint8_t>(157);
-                *iter_b = static_cast<uint8_t>(198);
+                if (params.compact && !validDepth(depth_row[x], params))
+                    continue;
+                std::memcpy(rgb_out, rgb_row + x, sizeof(uint32_t));
+                rgb_out += rgb_step;
             }
-            else
-            {
-                auto i = static_cast<int>(color_pixel[0]);
-                auto j = static_cast<int>(color_pixel[1]);
+            return;
+        }
+        projectToColor(to_color, color_state.intrinsics, points, point_step, count,
+                       tile.u.data(), tile.v.data());
+        sampleColor(color_state.intrinsics, color_data, tile.u.data(), tile.v.data(), count,
+                    _pointcloud_bilinear_color, rgb_out, rgb_step);
+    };
+
+    // Tiles are fixed blocks of rows whatever the number of workers, so the output never depends on it
+    auto tile_end = [this, rows](int tile){ return std::min(rows, (tile + 1) * _pointcloud_tile_rows); };
+    auto prepare_tile = [&](PointCloudTile& tile)
+    {
+        tile.u.resize(row_points);
+        tile.v.resize(row_points);
+    };
 
-                auto offset = i * 3 + j * color_intrinsics.width * 3;
-                *iter_r = static_cast<uint8_t>(color_data[offset]);
-                *iter_g = static_cast<uint8_t>(color_data[offset + 1]);
-                *iter_b = static_cast<uint8_t>(color_data[offset + 2]);
+    if (useVoxelGrid())
+    {
+        // Each tile feeds its own grid, one row at a time through a small scratch buffer,
+        // and the grids are merged in tile order
+        _worker_pool->parallelFor(tiles, [&](int index)
+        {
+            auto& tile = _pointcloud_tiles[index];
+            prepare_tile(tile);
+            tile.points.resize(row_points * 4);
+            tile.rgb.assign(row_points, 0);
+            tile.grid.reset(_pointcloud_voxel_leaf);
+            for (int r = index * _pointcloud_tile_rows; r < tile_end(index); ++r)
+            {
+                auto y = params.y_begin + r * params.stride;
+                auto count = deprojectDepthRow(depth_rays, y, image_depth16 + y * depth_width, params, tile.points.data(), 4);
+                if (with_color)
+                {
+                    color_row(tile, y, tile.points.data(), 4, count,
+                              reinterpret_cast<uint8_t*>(tile.rgb.data()), sizeof(uint32_t));
+                }
+                for (int i = 0; i < count; ++i)
+                    tile.grid.add(&tile.points[i * 4], tile.rgb[i]);
             }
+        });
+
+        _voxel_grid.reset(_pointcloud_voxel_leaf);
+        for (int index = 0; index < tiles; ++index)
+            _voxel_grid.merge(_pointcloud_tiles[index].grid);
+
+        sensor_msgs::PointCloud2Modifier modifier(msg);
+        modifier.resize(_voxel_grid.size());
+        _voxel_grid.write(msg.data.data(), msg.point_step, rgb_offset);
+        return;
+    }
 
-            ++image_depth16;
-            ++iter_x; ++iter_y; ++iter_z;
-            ++iter_r; ++iter_g; ++iter_b;
+    // Every tile starts where it would in an organized cloud; when compacting it writes fewer
+    // points there and the tiles are packed together afterwards
+    auto data = msg.data.data();
+    auto point_step = msg.point_step;
+    _worker_pool->parallelFor(tiles, [&](int index)
+    {
+        auto& tile = _pointcloud_tiles[index];
+        prepare_tile(tile);
+        size_t first = static_cast<size_t>(index) * _pointcloud_tile_rows * row_points;
+        tile.count = 0;
+        for (int r = index * _pointcloud_tile_rows; r < tile_end(index); ++r)
+        {
+            auto y = params.y_begin + r * params.stride;
+            auto out = data + (first + tile.count) * point_step;
+            auto points = reinterpret_cast<float*>(out);
+            auto count = deprojectDepthRow(depth_rays, y, image_depth16 + y * depth_width, params, points, point_step / sizeof(float));
+            if (with_color)
+                color_row(tile, y, points, point_step / sizeof(float), count, out + rgb_offset, point_step);
+            tile.count += count;
+        }
+    });
+
+    if (params.compact)
+    {
+        size_t count = 0;
+        for (int index = 0; index < tiles; ++index)
+        {
+            size_t first = static_cast<size_t>(index) * _pointcloud_tile_rows * row_points;
+            auto tile_count = _pointcloud_tiles[index].count;
+            if (count != first)
+                std::memmove(data + count * point_step, data + first * point_step, tile_count * point_step);
+            count += tile_count;
         }
+        sensor_msgs::PointCloud2Modifier modifier(msg);
+        modifier.resize(count);
     }
+}
+
+bool RealSenseNode::useVoxelGrid() const
+{
+    return _pointcloud_voxel_leaf > 0.0;
+}
+
+DeprojectionParams RealSenseNode::pointCloudParams(const rs2_intrinsics& depth_intrinsics) const
+{
+    DeprojectionParams params;
+    params.depth_scale = _depth_scale_meters;
+    params.min_z = static_cast<float>(_pointcloud_min_z);
+    params.max_z = (_pointcloud_max_z > 0.0) ? static_cast<float>(_pointcloud_max_z) : std::numeric_limits<float>::infinity();
+
+    // The ROI is clamped to the current depth resolution, a zero or negative size means up to the image edge
+    auto clamp = [](int value, int low, int high) { return std::max(low, std::min(value, high)); };
+    params.x_begin = clamp(_pointcloud_roi_x, 0, depth_intrinsics.width);
+    params.y_begin = clamp(_pointcloud_roi_y, 0, depth_intrinsics.height);
+    params.x_end = (_pointcloud_roi_width > 0) ? clamp(params.x_begin + _pointcloud_roi_width, params.x_begin, depth_intrinsics.width)
+                                               : depth_intrinsics.width;
+    params.y_end = (_pointcloud_roi_height > 0) ? clamp(params.y_begin + _pointcloud_roi_height, params.y_begin, depth_intrinsics.height)
+                                                : depth_intrinsics.height;
+
+    params.stride = _pointcloud_stride * (_governor.isDegraded(GOVERNOR_POINTCLOUD_STRIDE) ? 2 : 1);
+    params.compact = !_pointcloud_organized || useVoxelGrid();
+    return params;
+}
 
-    _pointcloud_xyzrgb_publisher.publish(msg_pointcloud);
+void RealSenseNode::setPointCloudSize(sensor_msgs::PointCloud2& msg, const DeprojectionParams& params) const
+{
+    auto width = (params.x_end - params.x_begin + params.stride - 1) / params.stride;
+    auto height = (params.y_end - params.y_begin + params.stride - 1) / params.stride;
+    if (useVoxelGrid())
+    {
+        // Sized once the voxels are known
+        msg.width = 0;
+        msg.height = 1;
+    }
+    else if (_pointcloud_organized)
+    {
+        msg.width = width;
+        msg.height = height;
+    }
+    else
+    {
+        // Room for every sampled pixel, trimmed to the valid points once they are written
+        msg.width = width * height;
+        msg.height = 1;
+    }
 }
 
 Extrinsics RealSenseNode::rsExtrinsicsToMsg(const rs2_extrinsics& extrinsics, const std::string& frame_id) const
@@ -1519,63 +2398,88 @@ IMUInfo RealSenseNode::getImuInfo(const stream_index_pair& stream_index)
     return info;
 }
 
-void RealSenseNode::publishFrame(rs2::frame f, const ros::Time& t,
-                                     const stream_index_pair& stream,
-                                     std::map<stream_index_pair, cv::Mat>& images,
-                                     const std::map<stream_index_pair, ros::Publisher>& info_publishers,
-                                     const std::map<stream_index_pair, ImagePublisherWithFrequencyDiagnostics>& image_publishers,
-                                     std::map<stream_index_pair, int>& seq,
-                                     std::map<stream_index_pair, sensor_msgs::CameraInfo>& camera_info,
-                                     const std::map<stream_index_pair, std::string>& optical_frame_id,
-                                     const std::map<stream_index_pair, std::string>& encoding,
-                                     bool copy_data_from_frame)
+const sensor_msgs::CameraInfo& RealSenseNode::profileCameraInfo(StreamState& state, const rs2::stream_profile& profile)
 {
-    ROS_DEBUG("publishFrame(...)");
-    auto& image = images[stream];
-
-    if (copy_data_from_frame) {
-        if (stream != DEPTH) {
-            image.data = (uint8_t*)f.get_data();
-        } else {
-            auto depth_data = (uint16_t*)f.get_data();
-            auto& image_data = reinterpret_cast<uint16_t*&>(image.data);
-            image_data = depth_data;
+    // Filters hand out frames of profiles of their own (decimation), whose calibration comes with
+    // the profile; it is only queried when the profile changes
+    if (profile.unique_id() != state.profile_info_id)
+    {
+        auto intrinsics = profile.as<rs2::video_stream_profile>().get_intrinsics();
+        state.profile_info = state.camera_info;
+        if (static_cast<uint32_t>(intrinsics.width) != state.camera_info.width ||
+            static_cast<uint32_t>(intrinsics.height) != state.camera_info.height)
+        {
+            setCameraInfoGeometry(intrinsics, state.profile_info);
         }
+        state.profile_info_id = profile.unique_id();
     }
+    return state.profile_info;
+}
 
-    ++(seq[stream]);
-    auto& info_publisher = info_publishers.at(stream);
-    auto& image_publisher = image_publishers.at(stream);
-    if(0 != info_publisher.getNumSubscribers() ||
-       0 != image_publisher.first.getNumSubscribers())
+void RealSenseNode::publishFrame(rs2::frame f, const ros::Time& t,
+                                     StreamState& state,
+                                     sensor_msgs::ImagePtr img,
+                                     rs2::frame geometry)
+{
+    ROS_DEBUG("publishFrame(...)");
+    ++(state.seq);
+    auto& info_publisher = state.info_publisher;
+    auto& image_publisher = state.image_publisher;
+    bool publish_image = (0 != image_publisher.first.getNumSubscribers());
+    if(0 != info_publisher.getNumSubscribers() || publish_image)
     {
-        auto width = 0;
-        auto height = 0;
-        auto bpp = 1;
-        if (f.is<rs2::video_frame>())
+        // Images computed from the frame have the geometry of the frame given for it, or of the
+        // stream as set up; frames published as they are have their own
+        if (!img)
+            geometry = f;
+        auto info_msg = state.info_pool.acquire();
+        if (geometry && geometry.is<rs2::video_frame>())
+            *info_msg = profileCameraInfo(state, geometry.get_profile());
+        else
+            *info_msg = state.camera_info;
+        info_msg->header.stamp = t;
+        info_msg->header.seq = state.seq;
+        info_publisher.publish(info_msg);
+
+        if (publish_image)
         {
-            auto image = f.as<rs2::video_frame>();
-            width = image.get_width();
-            height = image.get_height();
-            bpp = image.get_bytes_per_pixel();
-        }
+            auto width = 0;
+            auto height = 0;
+            auto bpp = 1;
+            if (f.is<rs2::video_frame>())
+            {
+                auto image = f.as<rs2::video_frame>();
+                width = image.get_width();
+                height = image.get_height();
+                bpp = image.get_bytes_per_pixel();
+            }
 
-        sensor_msgs::ImagePtr img;
-        img = cv_bridge::CvImage(std_msgs::Header(), encoding.at(stream), image).toImageMsg();
-        img->width = width;
-        img->height = height;
-        img->is_bigendian = false;
-        img->step = width * bpp;
-        img->header.frame_id = optical_frame_id.at(stream);
-        img->header.stamp = t;
-        img->header.seq = seq[stream];
-
-        auto& cam_info = camera_info.at(stream);
-        cam_info.header.stamp = t;
-        cam_info.header.seq = seq[stream];
-        info_publisher.publish(cam_info);
-
-        image_publisher.first.publish(img);
+            if (img)
+            {
+                // Image computed from the frame (e.g. aligned depth) - it has the geometry of the target stream
+                width = info_msg->width;
+                height = info_msg->height;
+            }
+            else
+            {
+                // sensor_msgs::Image owns its pixels, so this is the one copy out of the librealsense buffer
+                img = state.image_pool.acquire();
+                auto data = reinterpret_cast<const uint8_t*>(f.get_data());
+                img->data.assign(data, data + width * bpp * height);
+            }
+
+            img->width = width;
+            img->height = height;
+            img->encoding = state.encoding;
+            img->is_bigendian = false;
+            img->step = width * bpp;
+            img->header.frame_id = state.optical_frame_id;
+            img->header.stamp = t;
+            img->header.seq = state.seq;
+
+            // Published as a shared pointer - nodelet subscribers in the same process get it without a copy
+            image_publisher.first.publish(img);
+        }
         image_publisher.second->update();
         ROS_DEBUG("%s stream published", rs2_stream_to_string(f.get_profile().stream_type()));
     }
@@ -1611,12 +2515,14 @@ bool RealSenseNode::getEnabledProfile(const stream_index_pair& stream_index, rs2
 /**
 Constructor for filter_options, takes a name and a filter.
 */
-filter_options::filter_options(const std::string name, rs2::process_interface& filter) :
+filter_options::filter_options(filters type, const std::string name, rs2::process_interface& filter, bool is_enabled) :
+    type(type),
     filter_name(name),
     filter(filter),
-    is_enabled(true) {}
+    is_enabled(is_enabled) {}
 
 filter_options::filter_options(filter_options&& other) :
+    type(other.type),
     filter_name(std::move(other.filter_name)),
     filter(other.filter),
     is_enabled(other.is_enabled.load()) {}
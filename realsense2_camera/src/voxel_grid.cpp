@@ -0,0 +1,118 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2018 Intel Corporation. All Rights Reserved
+
+#include <realsense2_camera/voxel_grid.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+using namespace realsense2_camera;
+
+namespace
+{
+    const size_t MIN_SLOTS = 1024;
+
+    // 21 bits per axis covers +-1 km at 1 mm leaves, far beyond the depth range
+    uint64_t voxelKey(float x, float y, float z, float inv_leaf)
+    {
+        auto axis = [inv_leaf](float v)
+        {
+            auto i = static_cast<int64_t>(std::floor(v * inv_leaf)) + (1 << 20);
+            return static_cast<uint64_t>(i) & 0x1fffff;
+        };
+        return (axis(x) << 42) | (axis(y) << 21) | axis(z);
+    }
+
+    size_t slotOf(uint64_t key, size_t mask)
+    {
+        return static_cast<size_t>((key * 0x9e3779b97f4a7c15ull) >> 32) & mask;
+    }
+}
+
+void VoxelGrid::reset(float leaf_size)
+{
+    _inv_leaf = 1.f / leaf_size;
+    _voxels.clear();
+    if (_slots.empty())
+        rehash(MIN_SLOTS);
+    else
+        std::fill(_slots.begin(), _slots.end(), -1);
+}
+
+VoxelGrid::Voxel& VoxelGrid::voxelAt(uint64_t key)
+{
+    auto slot = slotOf(key, _slot_mask);
+    while (_slots[slot] >= 0 && _voxels[_slots[slot]].key != key)
+        slot = (slot + 1) & _slot_mask;
+
+    if (_slots[slot] >= 0)
+        return _voxels[_slots[slot]];
+
+    _slots[slot] = static_cast<int32_t>(_voxels.size());
+    _voxels.push_back({key, 0.f, 0.f, 0.f, 0, 0, 0, 0});
+    // Keep the load factor under one half so probe chains stay short
+    if (2 * _voxels.size() > _slots.size())
+        rehash(2 * _slots.size());
+    return _voxels.back();
+}
+
+void VoxelGrid::add(const float* point, uint32_t rgb)
+{
+    auto& voxel = voxelAt(voxelKey(point[0], point[1], point[2], _inv_leaf));
+    voxel.x += point[0];
+    voxel.y += point[1];
+    voxel.z += point[2];
+    voxel.r += (rgb >> 16) & 0xff;
+    voxel.g += (rgb >> 8) & 0xff;
+    voxel.b += rgb & 0xff;
+    ++voxel.count;
+}
+
+void VoxelGrid::merge(const VoxelGrid& other)
+{
+    for (const auto& from : other._voxels)
+    {
+        auto& voxel = voxelAt(from.key);
+        voxel.x += from.x;
+        voxel.y += from.y;
+        voxel.z += from.z;
+        voxel.r += from.r;
+        voxel.g += from.g;
+        voxel.b += from.b;
+        voxel.count += from.count;
+    }
+}
+
+void VoxelGrid::rehash(size_t slot_count)
+{
+    _slots.assign(slot_count, -1);
+    _slot_mask = slot_count - 1;
+    for (size_t i = 0; i < _voxels.size(); ++i)
+    {
+        auto slot = slotOf(_voxels[i].key, _slot_mask);
+        while (_slots[slot] >= 0)
+            slot = (slot + 1) & _slot_mask;
+        _slots[slot] = static_cast<int32_t>(i);
+    }
+}
+
+void VoxelGrid::write(uint8_t* out, size_t point_step, int rgb_offset) const
+{
+    for (const auto& voxel : _voxels)
+    {
+        float inv_count = 1.f / voxel.count;
+        float xyz[3] = {voxel.x * inv_count, voxel.y * inv_count, voxel.z * inv_count};
+        std::memcpy(out, xyz, sizeof(xyz));
+
+        if (rgb_offset >= 0)
+        {
+            auto half = voxel.count / 2;
+            uint32_t rgb = (((voxel.r + half) / voxel.count) << 16) |
+                           (((voxel.g + half) / voxel.count) << 8) |
+                           ((voxel.b + half) / voxel.count);
+            std::memcpy(out + rgb_offset, &rgb, sizeof(rgb));
+        }
+        out += point_step;
+    }
+}
@@ -0,0 +1,200 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2018 Intel Corporation. All Rights Reserved
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include <vector>
+
+#include <gtest/gtest.h>
+#include <sensor_msgs/Image.h>
+
+#include <realsense2_camera/color_sampling.h>
+#include <realsense2_camera/deprojection.h>
+#include <realsense2_camera/depth_alignment.h>
+#include <realsense2_camera/message_pool.h>
+#include <realsense2_camera/normal_estimation.h>
+#include <realsense2_camera/processing_governor.h>
+#include <realsense2_camera/voxel_grid.h>
+#include <realsense2_camera/worker_pool.h>
+
+using namespace realsense2_camera;
+
+// Every heap allocation of the process goes through here, from any thread
+static std::atomic<size_t> allocations(0);
+
+void* operator new(size_t size)
+{
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(size ? size : 1))
+        return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept
+{
+    std::free(p);
+}
+
+void* operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+void operator delete[](void* p) noexcept
+{
+    operator delete(p);
+}
+
+namespace
+{
+    const int WARMUP_FRAMES = 5;
+    const int STEADY_FRAMES = 20;
+
+    rs2_intrinsics depthIntrinsics()
+    {
+        rs2_intrinsics intrin = {};
+        intrin.width = 640;
+        intrin.height = 480;
+        intrin.fx = intrin.fy = 385.f;
+        intrin.ppx = 320.f;
+        intrin.ppy = 240.f;
+        intrin.model = RS2_DISTORTION_BROWN_CONRADY;
+        return intrin;
+    }
+
+    rs2_intrinsics colorIntrinsics()
+    {
+        rs2_intrinsics intrin = {};
+        intrin.width = 1280;
+        intrin.height = 720;
+        intrin.fx = intrin.fy = 920.f;
+        intrin.ppx = 640.f;
+        intrin.ppy = 360.f;
+        intrin.model = RS2_DISTORTION_INVERSE_BROWN_CONRADY;
+        return intrin;
+    }
+
+    rs2_extrinsics depthToColor()
+    {
+        rs2_extrinsics extrin = {{1, 0, 0, 0, 1, 0, 0, 0, 1}, {0.015f, 0.f, 0.f}};
+        return extrin;
+    }
+
+    std::vector<uint16_t> depthImage(const rs2_intrinsics& intrin)
+    {
+        std::vector<uint16_t> depth(intrin.width * intrin.height);
+        for (int y = 0; y < intrin.height; ++y)
+        {
+            for (int x = 0; x < intrin.width; ++x)
+                depth[y * intrin.width + x] = ((x * 7 + y * 3) % 11) ? 500 + (x + y) % 2000 : 0;
+        }
+        return depth;
+    }
+
+    // Runs frame() through warm-up, then returns the allocations of the steady-state frames
+    template<class Frame>
+    size_t steadyStateAllocations(const Frame& frame)
+    {
+        for (int i = 0; i < WARMUP_FRAMES; ++i)
+            frame();
+        auto before = allocations.load();
+        for (int i = 0; i < STEADY_FRAMES; ++i)
+            frame();
+        return allocations.load() - before;
+    }
+}
+
+TEST(AllocationTest, WorkerPoolParallelFor)
+{
+    WorkerPool pool(3);
+    std::vector<int> out(64);
+    EXPECT_EQ(0u, steadyStateAllocations([&]
+    {
+        pool.parallelFor(static_cast<int>(out.size()), [&](int index){ out[index] += index; });
+    }));
+}
+
+TEST(AllocationTest, DepthAlignment)
+{
+    auto depth_intrin = depthIntrinsics();
+    auto color_intrin = colorIntrinsics();
+    auto depth = depthImage(depth_intrin);
+    std::vector<uint8_t> color(color_intrin.width * color_intrin.height * 3, 128);
+    std::vector<uint8_t> aligned, resampled;
+    std::vector<uint32_t> rgb;
+    std::vector<DepthAligner::Target> targets(1);
+    targets[0] = {color_intrin, depthToColor(), &aligned, color.data(), 3, &resampled, &rgb};
+
+    WorkerPool pool(3);
+    DepthAligner aligner;
+    for (bool z_buffer : {true, false})
+    {
+        EXPECT_EQ(0u, steadyStateAllocations([&]
+        {
+            aligner.align(depth_intrin, depth.data(), 0.001f, z_buffer, targets, pool);
+        })) << "z_buffer " << z_buffer;
+    }
+}
+
+TEST(AllocationTest, PointCloud)
+{
+    auto depth_intrin = depthIntrinsics();
+    auto color_intrin = colorIntrinsics();
+    auto depth = depthImage(depth_intrin);
+    std::vector<uint8_t> color(color_intrin.width * color_intrin.height * 3, 128);
+
+    DeprojectionParams params = {0.001f, 0.f, 10.f, 0, depth_intrin.width, 0, depth_intrin.height, 1, false};
+    const int point_step = 12;
+    std::vector<float> points(depth_intrin.width * depth_intrin.height * point_step);
+    std::vector<float> u(depth_intrin.width), v(depth_intrin.width);
+    RayTable rays;
+    NormalEstimation normals;
+    VoxelGrid grid;
+    const float viewpoint[3] = {0.f, 0.f, 0.f};
+
+    EXPECT_EQ(0u, steadyStateAllocations([&]
+    {
+        rays.update(depth_intrin);
+        normals.resize(depth_intrin.width, depth_intrin.height);
+        grid.reset(0.02f);
+        for (int y = 0; y < depth_intrin.height; ++y)
+        {
+            auto row = points.data() + y * depth_intrin.width * point_step;
+            auto count = deprojectDepthRow(rays, y, depth.data() + y * depth_intrin.width, params, row, point_step);
+            projectToColor(depthToColor(), color_intrin, row, point_step, count, u.data(), v.data());
+            sampleColor(color_intrin, color.data(), u.data(), v.data(), count, true,
+                        reinterpret_cast<uint8_t*>(row + 3), point_step * sizeof(float));
+            normals.addRow(y, row, point_step);
+            for (int i = 0; i < count; ++i)
+                grid.add(row + i * point_step);
+        }
+        normals.integrateColumns(0, depth_intrin.width);
+        for (int y = 0; y < depth_intrin.height; ++y)
+            normals.computeRow(y, 2, viewpoint, points.data() + y * depth_intrin.width * point_step, point_step);
+    }));
+}
+
+TEST(AllocationTest, MessagePool)
+{
+    MessagePool<sensor_msgs::Image> pool(4);
+    boost::shared_ptr<sensor_msgs::Image> published;
+    EXPECT_EQ(0u, steadyStateAllocations([&]
+    {
+        // The previous frame is still held by a subscriber while the next one is filled
+        auto msg = pool.acquire();
+        msg->data.resize(640 * 480 * 2);
+        published = msg;
+    }));
+}
+
+TEST(AllocationTest, ProcessingGovernor)
+{
+    ProcessingGovernor governor;
+    governor.configure({GOVERNOR_TEMPORAL_FILTER, GOVERNOR_SPATIAL_FILTER}, 1.0 / 30, 0.9, 0.6);
+    EXPECT_EQ(0u, steadyStateAllocations([&]
+    {
+        governor.update(0.05);
+        governor.isDegraded(GOVERNOR_SPATIAL_FILTER);
+    }));
+}
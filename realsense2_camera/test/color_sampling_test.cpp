@@ -0,0 +1,174 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2018 Intel Corporation. All Rights Reserved
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include <gtest/gtest.h>
+#include <librealsense2/rsutil.h>
+
+#include <realsense2_camera/color_sampling.h>
+
+using namespace realsense2_camera;
+
+namespace
+{
+    const int POINT_STEP = 4;
+    const int COUNT = 1003;     // Leaves a tail for the scalar code after the vector kernels
+
+    rs2_intrinsics colorIntrinsics(rs2_distortion model)
+    {
+        rs2_intrinsics intrin = {};
+        intrin.width = 64;
+        intrin.height = 48;
+        intrin.fx = 50.f;
+        intrin.fy = 51.f;
+        intrin.ppx = 31.6f;
+        intrin.ppy = 24.3f;
+        intrin.model = model;
+        const float coeffs[5] = {0.1f, -0.04f, 0.002f, -0.001f, 0.01f};
+        std::copy(coeffs, coeffs + 5, intrin.coeffs);
+        return intrin;
+    }
+
+    rs2_extrinsics depthToColor()
+    {
+        const float c = std::cos(0.05f), s = std::sin(0.05f);
+        rs2_extrinsics extrin = {{c, s, 0, -s, c, 0, 0, 0, 1}, {0.015f, 0.001f, -0.002f}};
+        return extrin;
+    }
+
+    // In front of the camera, some of them projecting outside the image
+    std::vector<float> randomPoints(unsigned seed)
+    {
+        std::mt19937 rng(seed);
+        std::uniform_real_distribution<float> lateral(-0.9f, 0.9f), depth(0.3f, 3.f);
+        std::vector<float> points(COUNT * POINT_STEP);
+        for (int i = 0; i < COUNT; ++i)
+        {
+            auto z = depth(rng);
+            points[i * POINT_STEP] = lateral(rng) * z;
+            points[i * POINT_STEP + 1] = lateral(rng) * z;
+            points[i * POINT_STEP + 2] = z;
+        }
+        return points;
+    }
+
+    std::vector<uint8_t> colorImage(const rs2_intrinsics& intrin)
+    {
+        std::vector<uint8_t> image(intrin.width * intrin.height * 3);
+        for (size_t i = 0; i < image.size(); ++i)
+            image[i] = static_cast<uint8_t>((i * 37) ^ (i >> 5));
+        return image;
+    }
+
+    uint32_t pixelRgb(const std::vector<uint8_t>& image, const rs2_intrinsics& intrin, int x, int y)
+    {
+        auto p = &image[(y * intrin.width + x) * 3];
+        return (p[0] << 16) | (p[1] << 8) | p[2];
+    }
+
+    uint32_t channel(uint32_t rgb, int shift)
+    {
+        return (rgb >> shift) & 0xff;
+    }
+}
+
+TEST(ColorSamplingTest, ProjectionMatchesLibrealsense)
+{
+    auto points = randomPoints(1);
+    auto extrin = depthToColor();
+    // Vector kernels for the first two, librealsense for the rest; it can't project to inverse-distorted images
+    for (auto model : {RS2_DISTORTION_NONE, RS2_DISTORTION_MODIFIED_BROWN_CONRADY, RS2_DISTORTION_BROWN_CONRADY})
+    {
+        auto intrin = colorIntrinsics(model);
+        std::vector<float> u(COUNT), v(COUNT);
+        projectToColor(extrin, intrin, points.data(), POINT_STEP, COUNT, u.data(), v.data());
+        for (int i = 0; i < COUNT; ++i)
+        {
+            float color_point[3], pixel[2];
+            rs2_transform_point_to_point(color_point, &extrin, &points[i * POINT_STEP]);
+            rs2_project_point_to_pixel(pixel, &intrin, color_point);
+            EXPECT_FLOAT_EQ(pixel[0], u[i]) << "model " << model << " point " << i;
+            EXPECT_FLOAT_EQ(pixel[1], v[i]) << "model " << model << " point " << i;
+        }
+    }
+}
+
+TEST(ColorSamplingTest, NearestSampling)
+{
+    auto intrin = colorIntrinsics(RS2_DISTORTION_NONE);
+    auto image = colorImage(intrin);
+    std::mt19937 rng(2);
+    std::uniform_real_distribution<float> coordinate(-5.f, 70.f);
+    std::vector<float> u(COUNT), v(COUNT);
+    for (int i = 0; i < COUNT; ++i)
+    {
+        u[i] = coordinate(rng);
+        v[i] = coordinate(rng);
+    }
+
+    const size_t out_step = 16;
+    std::vector<uint8_t> out(COUNT * out_step);
+    sampleColor(intrin, image.data(), u.data(), v.data(), COUNT, false, out.data(), out_step);
+    for (int i = 0; i < COUNT; ++i)
+    {
+        uint32_t rgb;
+        std::memcpy(&rgb, &out[i * out_step], sizeof(rgb));
+        bool inside = u[i] >= 0.f && u[i] < intrin.width && v[i] >= 0.f && v[i] < intrin.height;
+        auto expected = inside ? pixelRgb(image, intrin, static_cast<int>(u[i]), static_cast<int>(v[i])) : OUT_OF_BOUNDS_RGB;
+        EXPECT_EQ(expected, rgb) << "u " << u[i] << " v " << v[i];
+    }
+}
+
+TEST(ColorSamplingTest, BilinearSampling)
+{
+    auto intrin = colorIntrinsics(RS2_DISTORTION_NONE);
+    auto image = colorImage(intrin);
+    std::mt19937 rng(3);
+    std::uniform_real_distribution<float> coordinate(-5.f, 70.f);
+    std::vector<float> u(COUNT), v(COUNT);
+    for (int i = 0; i < COUNT; ++i)
+    {
+        u[i] = coordinate(rng);
+        v[i] = coordinate(rng);
+    }
+    // Pixel centers and the last row and column, which clamp to the edge
+    u[0] = 10.f;
+    v[0] = 20.f;
+    u[1] = intrin.width - 0.5f;
+    v[1] = intrin.height - 0.25f;
+
+    const size_t out_step = 4;
+    std::vector<uint8_t> out(COUNT * out_step);
+    sampleColor(intrin, image.data(), u.data(), v.data(), COUNT, true, out.data(), out_step);
+    for (int i = 0; i < COUNT; ++i)
+    {
+        uint32_t rgb;
+        std::memcpy(&rgb, &out[i * out_step], sizeof(rgb));
+        if (!(u[i] >= 0.f && u[i] < intrin.width && v[i] >= 0.f && v[i] < intrin.height))
+        {
+            EXPECT_EQ(OUT_OF_BOUNDS_RGB, rgb) << "u " << u[i] << " v " << v[i];
+            continue;
+        }
+
+        int x0 = static_cast<int>(u[i]), y0 = static_cast<int>(v[i]);
+        int x1 = std::min(x0 + 1, intrin.width - 1), y1 = std::min(y0 + 1, intrin.height - 1);
+        double fx = u[i] - x0, fy = v[i] - y0;
+        for (int shift = 16; shift >= 0; shift -= 8)
+        {
+            double top = channel(pixelRgb(image, intrin, x0, y0), shift) * (1 - fx) + channel(pixelRgb(image, intrin, x1, y0), shift) * fx;
+            double bottom = channel(pixelRgb(image, intrin, x0, y1), shift) * (1 - fx) + channel(pixelRgb(image, intrin, x1, y1), shift) * fx;
+            // Rounded in float, may land on the other side of a half
+            EXPECT_NEAR(top * (1 - fy) + bottom * fy, channel(rgb, shift), 0.5 + 1e-3) << "u " << u[i] << " v " << v[i];
+        }
+    }
+    uint32_t center, corner;
+    std::memcpy(&center, &out[0], sizeof(center));
+    std::memcpy(&corner, &out[out_step], sizeof(corner));
+    EXPECT_EQ(pixelRgb(image, intrin, 10, 20), center);
+    EXPECT_EQ(pixelRgb(image, intrin, intrin.width - 1, intrin.height - 1), corner);
+}
@@ -0,0 +1,121 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2018 Intel Corporation. All Rights Reserved
+
+// Per-frame time of point cloud deprojection at the common depth resolutions: the per-pixel
+// rs2_deproject_pixel_to_point loop against each kernel this CPU runs.
+// Usage: deprojection_benchmark [frames]
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include <librealsense2/rsutil.h>
+
+#include <realsense2_camera/deprojection.h>
+
+using namespace realsense2_camera;
+
+namespace
+{
+    const int POINT_STEP = 4;   // As the node's XYZ clouds, in floats
+
+    rs2_intrinsics intrinsics(int width, int height, rs2_distortion model)
+    {
+        rs2_intrinsics intrin = {};
+        intrin.width = width;
+        intrin.height = height;
+        intrin.fx = intrin.fy = 0.6f * width;
+        intrin.ppx = width / 2.f;
+        intrin.ppy = height / 2.f;
+        intrin.model = model;
+        if (RS2_DISTORTION_INVERSE_BROWN_CONRADY == model)
+        {
+            const float coeffs[5] = {0.12f, -0.05f, 0.001f, -0.002f, 0.01f};
+            std::copy(coeffs, coeffs + 5, intrin.coeffs);
+        }
+        return intrin;
+    }
+
+    // About 30% of the pixels without depth, like an indoor scene
+    std::vector<uint16_t> depthImage(const rs2_intrinsics& intrin)
+    {
+        std::vector<uint16_t> depth(intrin.width * intrin.height);
+        std::srand(1);
+        for (auto& d : depth)
+            d = (std::rand() % 10 < 3) ? 0 : static_cast<uint16_t>(300 + std::rand() % 4000);
+        return depth;
+    }
+
+    // Best time of frames runs of frame(), in milliseconds
+    template<class Frame>
+    double bestMs(int frames, const Frame& frame)
+    {
+        double best = 1e9;
+        for (int i = 0; i < frames; ++i)
+        {
+            auto start = std::chrono::steady_clock::now();
+            frame();
+            best = std::min(best, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+        }
+        return best;
+    }
+
+    void run(int width, int height, rs2_distortion model, int frames)
+    {
+        auto intrin = intrinsics(width, height, model);
+        auto depth = depthImage(intrin);
+        std::vector<float> points(depth.size() * POINT_STEP);
+        const float depth_scale = 0.001f;
+
+        auto reference = bestMs(frames, [&]
+        {
+            for (int y = 0; y < height; ++y)
+            {
+                for (int x = 0; x < width; ++x)
+                {
+                    auto p = points.data() + (y * width + x) * POINT_STEP;
+                    float d = depth[y * width + x] * depth_scale;
+                    float pixel[2] = {static_cast<float>(x), static_cast<float>(y)};
+                    if (d > 0.f)
+                        rs2_deproject_pixel_to_point(p, &intrin, pixel, d);
+                    else
+                        p[0] = p[1] = p[2] = 0.f;
+                }
+            }
+        });
+        std::printf("%4dx%-4d %-22s per pixel %6.2f ms", width, height, rs2_distortion_to_string(model), reference);
+
+        RayTable rays;
+        rays.update(intrin);
+        DeprojectionParams params = {depth_scale, 0.f, 1e9f, 0, width, 0, height, 1, false};
+        for (auto kernel : {DEPROJECTION_SCALAR, DEPROJECTION_SSE42, DEPROJECTION_AVX2})
+        {
+            if (!deprojectionKernelSupported(kernel))
+                continue;
+
+            auto ms = bestMs(frames, [&]
+            {
+                for (int y = 0; y < height; ++y)
+                {
+                    deprojectDepthRow(rays, y, depth.data() + y * width, params,
+                                      points.data() + y * width * POINT_STEP, POINT_STEP, kernel);
+                }
+            });
+            std::printf("  %s %6.2f ms", deprojectionKernelName(kernel), ms);
+        }
+        std::printf("\n");
+    }
+}
+
+int main(int argc, char** argv)
+{
+    int frames = (argc > 1) ? std::max(1, std::atoi(argv[1])) : 100;
+    for (auto model : {RS2_DISTORTION_BROWN_CONRADY, RS2_DISTORTION_INVERSE_BROWN_CONRADY})
+    {
+        run(640, 480, model, frames);
+        run(1280, 720, model, frames);
+    }
+    return 0;
+}
@@ -0,0 +1,186 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2018 Intel Corporation. All Rights Reserved
+
+#include <cmath>
+#include <vector>
+
+#include <gtest/gtest.h>
+#include <librealsense2/rsutil.h>
+
+#include <realsense2_camera/deprojection.h>
+
+using namespace realsense2_camera;
+
+namespace
+{
+    // Rays are computed by librealsense itself, only the multiply by depth and the transform differ
+    const float EPSILON = 1e-5f;
+    const int POINT_STEP = 4;
+
+    rs2_intrinsics intrinsics(rs2_distortion model)
+    {
+        rs2_intrinsics intrin = {};
+        intrin.width = 67;      // Not a multiple of the vector widths, so the scalar tail runs too
+        intrin.height = 9;
+        intrin.fx = 60.f;
+        intrin.fy = 61.f;
+        intrin.ppx = 33.2f;
+        intrin.ppy = 4.7f;
+        intrin.model = model;
+        const float coeffs[5] = {0.12f, -0.05f, 0.001f, -0.002f, 0.01f};
+        std::copy(coeffs, coeffs + 5, intrin.coeffs);
+        return intrin;
+    }
+
+    rs2_extrinsics transform()
+    {
+        // 30 degrees around y, then a shift
+        const float c = std::cos(0.5236f), s = std::sin(0.5236f);
+        rs2_extrinsics extrin = {{c, 0, -s, 0, 1, 0, s, 0, c}, {0.1f, -0.2f, 0.3f}};
+        return extrin;
+    }
+
+    // Zero (invalid) depth every few pixels, the rest spread over the depth range
+    std::vector<uint16_t> depthImage(const rs2_intrinsics& intrin)
+    {
+        std::vector<uint16_t> depth(intrin.width * intrin.height);
+        for (size_t i = 0; i < depth.size(); ++i)
+            depth[i] = (i % 5 == 2) ? 0 : static_cast<uint16_t>(200 + (i * 97) % 6000);
+        return depth;
+    }
+
+    DeprojectionParams params(const rs2_intrinsics& intrin, bool compact)
+    {
+        DeprojectionParams params = {0.001f, 0.5f, 5.f, 0, intrin.width, 0, intrin.height, 1, compact};
+        return params;
+    }
+
+    // What librealsense gives for one pixel, or false when it has no valid point
+    bool reference(const rs2_intrinsics& intrin, const rs2_extrinsics* extrin, const DeprojectionParams& params,
+                   int x, int y, uint16_t raw, float* point)
+    {
+        float depth = raw * params.depth_scale;
+        if (depth <= 0.f || depth < params.min_z || depth > params.max_z)
+            return false;
+
+        float pixel[2] = {static_cast<float>(x), static_cast<float>(y)};
+        rs2_deproject_pixel_to_point(point, &intrin, pixel, depth);
+        if (extrin)
+        {
+            float camera_point[3] = {point[0], point[1], point[2]};
+            rs2_transform_point_to_point(point, extrin, camera_point);
+        }
+        return true;
+    }
+
+    std::vector<deprojection_kernel> supportedKernels()
+    {
+        std::vector<deprojection_kernel> kernels;
+        for (auto kernel : {DEPROJECTION_SCALAR, DEPROJECTION_SSE42, DEPROJECTION_AVX2})
+        {
+            if (deprojectionKernelSupported(kernel))
+                kernels.push_back(kernel);
+        }
+        return kernels;
+    }
+
+    void expectMatchesLibrealsense(rs2_distortion model, const rs2_extrinsics* extrin)
+    {
+        auto intrin = intrinsics(model);
+        auto depth = depthImage(intrin);
+        RayTable rays;
+        rays.update(intrin, extrin);
+
+        for (auto kernel : supportedKernels())
+        {
+            for (bool compact : {false, true})
+            {
+                SCOPED_TRACE(std::string(deprojectionKernelName(kernel)) + (compact ? " compact" : " organized"));
+                auto row_params = params(intrin, compact);
+                std::vector<float> out(intrin.width * POINT_STEP);
+                for (int y = 0; y < intrin.height; ++y)
+                {
+                    auto depth_row = depth.data() + y * intrin.width;
+                    int count = deprojectDepthRow(rays, y, depth_row, row_params, out.data(), POINT_STEP, kernel);
+
+                    int written = 0;
+                    for (int x = 0; x < intrin.width; ++x)
+                    {
+                        float expected[3];
+                        bool valid = reference(intrin, extrin, row_params, x, y, depth_row[x], expected);
+                        if (compact && !valid)
+                            continue;
+
+                        ASSERT_LT(written, count);
+                        auto point = out.data() + written * POINT_STEP;
+                        for (int i = 0; i < 3; ++i)
+                        {
+                            if (valid)
+                                EXPECT_NEAR(expected[i], point[i], EPSILON) << "pixel " << x << ", " << y;
+                            else
+                                EXPECT_EQ(0.f, point[i]) << "pixel " << x << ", " << y;
+                        }
+                        ++written;
+                    }
+                    EXPECT_EQ(written, count);
+                }
+            }
+        }
+    }
+}
+
+TEST(DeprojectionTest, ScalarKernelAlwaysSupported)
+{
+    EXPECT_TRUE(deprojectionKernelSupported(DEPROJECTION_SCALAR));
+    EXPECT_TRUE(deprojectionKernelSupported(DEPROJECTION_BEST));
+}
+
+TEST(DeprojectionTest, MatchesLibrealsenseForEveryModel)
+{
+    // librealsense can't deproject forward-distorted (modified Brown-Conrady) images
+    for (auto model : {RS2_DISTORTION_NONE, RS2_DISTORTION_BROWN_CONRADY, RS2_DISTORTION_INVERSE_BROWN_CONRADY})
+    {
+        SCOPED_TRACE(rs2_distortion_to_string(model));
+        expectMatchesLibrealsense(model, nullptr);
+    }
+}
+
+TEST(DeprojectionTest, MatchesLibrealsenseWithTransform)
+{
+    auto extrin = transform();
+    for (auto model : {RS2_DISTORTION_NONE, RS2_DISTORTION_INVERSE_BROWN_CONRADY})
+    {
+        SCOPED_TRACE(rs2_distortion_to_string(model));
+        expectMatchesLibrealsense(model, &extrin);
+    }
+}
+
+TEST(DeprojectionTest, ColumnRangeAndStride)
+{
+    auto intrin = intrinsics(RS2_DISTORTION_BROWN_CONRADY);
+    auto depth = depthImage(intrin);
+    RayTable rays;
+    rays.update(intrin);
+
+    auto row_params = params(intrin, false);
+    row_params.x_begin = 5;
+    row_params.x_end = 60;
+    row_params.stride = 3;
+    std::vector<float> out(intrin.width * POINT_STEP);
+    const int y = 4;
+    auto depth_row = depth.data() + y * intrin.width;
+    for (auto kernel : supportedKernels())
+    {
+        SCOPED_TRACE(deprojectionKernelName(kernel));
+        int count = deprojectDepthRow(rays, y, depth_row, row_params, out.data(), POINT_STEP, kernel);
+        EXPECT_EQ((row_params.x_end - row_params.x_begin + 2) / 3, count);
+        for (int i = 0; i < count; ++i)
+        {
+            int x = row_params.x_begin + i * row_params.stride;
+            float expected[3] = {0.f, 0.f, 0.f};
+            reference(intrin, nullptr, row_params, x, y, depth_row[x], expected);
+            for (int c = 0; c < 3; ++c)
+                EXPECT_NEAR(expected[c], out[i * POINT_STEP + c], EPSILON) << "pixel " << x;
+        }
+    }
+}
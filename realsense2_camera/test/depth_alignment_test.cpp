@@ -0,0 +1,319 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2018 Intel Corporation. All Rights Reserved
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include <gtest/gtest.h>
+#include <librealsense2/rsutil.h>
+
+#include <realsense2_camera/color_sampling.h>
+#include <realsense2_camera/depth_alignment.h>
+
+using namespace realsense2_camera;
+
+namespace
+{
+    const float DEPTH_SCALE = 0.001f;
+
+    rs2_intrinsics depthIntrinsics()
+    {
+        rs2_intrinsics intrin = {};
+        intrin.width = 160;
+        intrin.height = 120;
+        intrin.fx = intrin.fy = 96.f;
+        intrin.ppx = 80.3f;
+        intrin.ppy = 59.6f;
+        intrin.model = RS2_DISTORTION_BROWN_CONRADY;
+        return intrin;
+    }
+
+    // Sharper than depth, so neighboring depth pixels overlap in it and the z-buffer matters
+    rs2_intrinsics colorIntrinsics(rs2_distortion model)
+    {
+        rs2_intrinsics intrin = {};
+        intrin.width = 213;
+        intrin.height = 160;
+        intrin.fx = 140.f;
+        intrin.fy = 141.f;
+        intrin.ppx = 106.1f;
+        intrin.ppy = 80.4f;
+        intrin.model = model;
+        if (RS2_DISTORTION_MODIFIED_BROWN_CONRADY == model)
+        {
+            const float coeffs[5] = {0.08f, -0.03f, 0.001f, 0.0005f, 0.005f};
+            std::copy(coeffs, coeffs + 5, intrin.coeffs);
+        }
+        return intrin;
+    }
+
+    rs2_extrinsics depthToColor(float angle)
+    {
+        const float c = std::cos(angle), s = std::sin(angle);
+        rs2_extrinsics extrin = {{c, s, 0, -s, c, 0, 0, 0, 1}, {0.05f, 0.002f, -0.001f}};
+        return extrin;
+    }
+
+    // Boxes in front of a wall, with holes, so foreground and background land on the same color pixels
+    std::vector<uint16_t> depthImage(const rs2_intrinsics& intrin, unsigned seed)
+    {
+        std::mt19937 rng(seed);
+        std::uniform_int_distribution<int> noise(0, 30), hole(0, 9);
+        std::vector<uint16_t> depth(intrin.width * intrin.height);
+        for (int y = 0; y < intrin.height; ++y)
+        {
+            for (int x = 0; x < intrin.width; ++x)
+            {
+                bool box = ((x / 20) + (y / 20)) % 3 == 0;
+                depth[y * intrin.width + x] = (0 == hole(rng)) ? 0 : static_cast<uint16_t>((box ? 400 : 2500) + noise(rng));
+            }
+        }
+        return depth;
+    }
+
+    std::vector<uint8_t> colorImage(const rs2_intrinsics& intrin)
+    {
+        std::vector<uint8_t> image(intrin.width * intrin.height * 3);
+        for (size_t i = 0; i < image.size(); ++i)
+            image[i] = static_cast<uint8_t>(i * 7 + (i >> 8));
+        return image;
+    }
+
+    struct Rect
+    {
+        int x0, y0, x1, y1;
+    };
+
+    // Where librealsense's align puts one depth pixel, false if it drops it
+    bool referenceRect(const rs2_intrinsics& depth_intrin, const rs2_intrinsics& other, const rs2_extrinsics& extrin,
+                       int x, int y, uint16_t raw, Rect& rect)
+    {
+        if (!raw)
+            return false;
+        float depth = raw * DEPTH_SCALE;
+        int* out[2][2] = {{&rect.x0, &rect.y0}, {&rect.x1, &rect.y1}};
+        for (int corner = 0; corner < 2; ++corner)
+        {
+            float pixel[2] = {x - 0.5f + corner, y - 0.5f + corner}, point[3], other_point[3], other_pixel[2];
+            rs2_deproject_pixel_to_point(point, &depth_intrin, pixel, depth);
+            rs2_transform_point_to_point(other_point, &extrin, point);
+            rs2_project_point_to_pixel(other_pixel, &other, other_point);
+            *out[corner][0] = static_cast<int>(other_pixel[0] + 0.5f);
+            *out[corner][1] = static_cast<int>(other_pixel[1] + 0.5f);
+        }
+        return rect.x0 >= 0 && rect.y0 >= 0 && rect.x1 < other.width && rect.y1 < other.height &&
+               rect.x0 <= rect.x1 && rect.y0 <= rect.y1;
+    }
+
+    // Z16 in millimeters, nearest depth wins or, without the z-buffer, the last pixel in row order
+    std::vector<uint16_t> referenceAlign(const rs2_intrinsics& depth_intrin, const std::vector<uint16_t>& depth,
+                                         const rs2_intrinsics& other, const rs2_extrinsics& extrin, bool z_buffer)
+    {
+        std::vector<uint16_t> aligned(other.width * other.height, 0);
+        for (int y = 0; y < depth_intrin.height; ++y)
+        {
+            for (int x = 0; x < depth_intrin.width; ++x)
+            {
+                auto raw = depth[y * depth_intrin.width + x];
+                Rect rect;
+                if (!referenceRect(depth_intrin, other, extrin, x, y, raw, rect))
+                    continue;
+                uint16_t value = raw * (DEPTH_SCALE / 0.001f);
+                for (int v = rect.y0; v <= rect.y1; ++v)
+                {
+                    for (int u = rect.x0; u <= rect.x1; ++u)
+                    {
+                        auto& pixel = aligned[v * other.width + u];
+                        if (!z_buffer || 0 == pixel || value < pixel)
+                            pixel = value;
+                    }
+                }
+            }
+        }
+        return aligned;
+    }
+
+    std::vector<uint16_t> asDepth(const std::vector<uint8_t>& bytes)
+    {
+        std::vector<uint16_t> depth(bytes.size() / 2);
+        std::memcpy(depth.data(), bytes.data(), bytes.size());
+        return depth;
+    }
+
+    struct Result
+    {
+        std::vector<uint8_t> aligned;
+        std::vector<uint8_t> resampled;
+        std::vector<uint32_t> rgb;
+    };
+
+    Result align(DepthAligner& aligner, WorkerPool& pool, const rs2_intrinsics& depth_intrin, const std::vector<uint16_t>& depth,
+                 const rs2_intrinsics& other, const rs2_extrinsics& extrin, const std::vector<uint8_t>& image, bool z_buffer)
+    {
+        Result result;
+        std::vector<DepthAligner::Target> targets = {{other, extrin, &result.aligned, image.data(), 3, &result.resampled,
+                                                      &result.rgb}};
+        aligner.align(depth_intrin, depth.data(), DEPTH_SCALE, z_buffer, targets, pool);
+        return result;
+    }
+}
+
+TEST(DepthAlignmentTest, ParallelZBufferIsBitIdenticalToSerial)
+{
+    auto depth_intrin = depthIntrinsics();
+    auto depth = depthImage(depth_intrin, 1);
+    for (auto model : {RS2_DISTORTION_NONE, RS2_DISTORTION_MODIFIED_BROWN_CONRADY})
+    {
+        auto other = colorIntrinsics(model);
+        auto image = colorImage(other);
+        auto extrin = depthToColor(0.02f);
+
+        WorkerPool serial_pool(0);
+        DepthAligner serial_aligner;
+        auto serial = align(serial_aligner, serial_pool, depth_intrin, depth, other, extrin, image, true);
+
+        for (size_t threads : {1, 3, 7})
+        {
+            WorkerPool pool(threads);
+            DepthAligner aligner;
+            // Repeated, so differing thread interleavings get a chance to show
+            for (int run = 0; run < 5; ++run)
+            {
+                auto parallel = align(aligner, pool, depth_intrin, depth, other, extrin, image, true);
+                EXPECT_TRUE(serial.aligned == parallel.aligned) << "model " << model << ", " << threads << " threads";
+                EXPECT_TRUE(serial.resampled == parallel.resampled) << "model " << model << ", " << threads << " threads";
+                EXPECT_TRUE(serial.rgb == parallel.rgb) << "model " << model << ", " << threads << " threads";
+            }
+        }
+    }
+}
+
+TEST(DepthAlignmentTest, MatchesLibrealsenseAlign)
+{
+    auto depth_intrin = depthIntrinsics();
+    auto depth = depthImage(depth_intrin, 2);
+    auto other = colorIntrinsics(RS2_DISTORTION_MODIFIED_BROWN_CONRADY);
+    auto image = colorImage(other);
+    auto extrin = depthToColor(0.02f);
+
+    for (bool z_buffer : {true, false})
+    {
+        WorkerPool pool(z_buffer ? 3 : 0);
+        DepthAligner aligner;
+        auto result = align(aligner, pool, depth_intrin, depth, other, extrin, image, z_buffer);
+        auto expected = referenceAlign(depth_intrin, depth, other, extrin, z_buffer);
+        auto aligned = asDepth(result.aligned);
+        ASSERT_EQ(expected.size(), aligned.size());
+        size_t differing = 0;
+        for (size_t i = 0; i < expected.size(); ++i)
+            differing += (expected[i] != aligned[i]);
+        EXPECT_EQ(0u, differing) << "z_buffer " << z_buffer;
+    }
+}
+
+TEST(DepthAlignmentTest, ResampledImageTakesTheBottomRightCorner)
+{
+    auto depth_intrin = depthIntrinsics();
+    auto depth = depthImage(depth_intrin, 3);
+    auto other = colorIntrinsics(RS2_DISTORTION_NONE);
+    auto image = colorImage(other);
+    auto extrin = depthToColor(0.02f);
+
+    WorkerPool pool(3);
+    DepthAligner aligner;
+    auto result = align(aligner, pool, depth_intrin, depth, other, extrin, image, true);
+    ASSERT_EQ(static_cast<size_t>(depth_intrin.width * depth_intrin.height * 3), result.resampled.size());
+    for (int y = 0; y < depth_intrin.height; ++y)
+    {
+        for (int x = 0; x < depth_intrin.width; ++x)
+        {
+            Rect rect;
+            uint8_t expected[3] = {0, 0, 0};
+            if (referenceRect(depth_intrin, other, extrin, x, y, depth[y * depth_intrin.width + x], rect))
+                std::memcpy(expected, &image[(rect.y1 * other.width + rect.x1) * 3], 3);
+            auto pixel = &result.resampled[(y * depth_intrin.width + x) * 3];
+            EXPECT_TRUE(std::equal(expected, expected + 3, pixel)) << "pixel " << x << ", " << y;
+        }
+    }
+}
+
+TEST(DepthAlignmentTest, PackedColorsAreTheResampledPixels)
+{
+    auto depth_intrin = depthIntrinsics();
+    auto depth = depthImage(depth_intrin, 6);
+    auto other = colorIntrinsics(RS2_DISTORTION_NONE);
+    auto image = colorImage(other);
+    auto extrin = depthToColor(0.02f);
+
+    WorkerPool pool(3);
+    DepthAligner aligner;
+    auto result = align(aligner, pool, depth_intrin, depth, other, extrin, image, true);
+    ASSERT_EQ(static_cast<size_t>(depth_intrin.width * depth_intrin.height), result.rgb.size());
+    for (int y = 0; y < depth_intrin.height; ++y)
+    {
+        for (int x = 0; x < depth_intrin.width; ++x)
+        {
+            auto i = y * depth_intrin.width + x;
+            Rect rect;
+            auto expected = OUT_OF_BOUNDS_RGB;
+            if (referenceRect(depth_intrin, other, extrin, x, y, depth[i], rect))
+            {
+                auto pixel = &result.resampled[i * 3];
+                expected = (static_cast<uint32_t>(pixel[0]) << 16) | (static_cast<uint32_t>(pixel[1]) << 8) | pixel[2];
+            }
+            EXPECT_EQ(expected, result.rgb[i]) << "pixel " << x << ", " << y;
+        }
+    }
+
+    // Nothing else asked for, the colors come out the same
+    std::vector<uint32_t> rgb;
+    std::vector<DepthAligner::Target> targets = {{other, extrin, nullptr, image.data(), 3, nullptr, &rgb}};
+    aligner.align(depth_intrin, depth.data(), DEPTH_SCALE, true, targets, pool);
+    EXPECT_TRUE(result.rgb == rgb);
+}
+
+TEST(DepthAlignmentTest, ReusedBuffersAreCleared)
+{
+    auto depth_intrin = depthIntrinsics();
+    auto full = depthImage(depth_intrin, 4);
+    // Only a band of rows, so most of what the first image wrote must be cleared
+    auto band = full;
+    std::fill(band.begin(), band.begin() + 40 * depth_intrin.width, 0);
+    std::fill(band.begin() + 60 * depth_intrin.width, band.end(), 0);
+
+    auto other = colorIntrinsics(RS2_DISTORTION_NONE);
+    auto image = colorImage(other);
+    auto extrin = depthToColor(0.02f);
+    WorkerPool pool(3);
+
+    DepthAligner aligner;
+    std::vector<uint8_t> aligned, resampled;
+    std::vector<DepthAligner::Target> targets = {{other, extrin, &aligned, image.data(), 3, &resampled, nullptr}};
+    aligner.align(depth_intrin, full.data(), DEPTH_SCALE, true, targets, pool);
+    aligner.align(depth_intrin, band.data(), DEPTH_SCALE, true, targets, pool);
+
+    DepthAligner fresh_aligner;
+    auto fresh = align(fresh_aligner, pool, depth_intrin, band, other, extrin, image, true);
+    EXPECT_TRUE(fresh.aligned == aligned);
+    EXPECT_TRUE(fresh.resampled == resampled);
+}
+
+TEST(DepthAlignmentTest, InvertedRectanglesAreDropped)
+{
+    // Upside down: every bottom-right corner lands above and left of its top-left one
+    auto depth_intrin = depthIntrinsics();
+    auto depth = depthImage(depth_intrin, 5);
+    auto other = colorIntrinsics(RS2_DISTORTION_NONE);
+    auto image = colorImage(other);
+    auto extrin = depthToColor(3.14159265f);
+
+    WorkerPool pool(3);
+    DepthAligner aligner;
+    auto result = align(aligner, pool, depth_intrin, depth, other, extrin, image, true);
+    auto aligned = asDepth(result.aligned);
+    EXPECT_TRUE(std::all_of(aligned.begin(), aligned.end(), [](uint16_t d){ return 0 == d; }));
+    EXPECT_TRUE(std::all_of(result.resampled.begin(), result.resampled.end(), [](uint8_t c){ return 0 == c; }));
+}
@@ -0,0 +1,185 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2018 Intel Corporation. All Rights Reserved
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+#include <librealsense2/hpp/rs_internal.hpp>
+
+#include <realsense2_camera/frame_ring_buffer.h>
+
+using namespace realsense2_camera;
+
+namespace
+{
+    const int WIDTH = 8;
+    const int HEIGHT = 4;
+
+    // Real librealsense frames without a camera: a software device whose frame numbers count up from 0
+    class FrameSource
+    {
+    public:
+        FrameSource() : _queue(1), _pixels(WIDTH * HEIGHT, 0), _next(0)
+        {
+            auto sensor = _device.add_sensor("Depth");
+            rs2_intrinsics intrin = {WIDTH, HEIGHT, WIDTH / 2.f, HEIGHT / 2.f, 10.f, 10.f, RS2_DISTORTION_NONE, {0, 0, 0, 0, 0}};
+            _profile = sensor.add_video_stream({RS2_STREAM_DEPTH, 0, 0, WIDTH, HEIGHT, 30, 2, RS2_FORMAT_Z16, intrin});
+            sensor.open(_profile);
+            sensor.start(_queue);
+            _sensor.reset(new rs2::software_sensor(sensor));
+        }
+
+        ~FrameSource()
+        {
+            _sensor->stop();
+            _sensor->close();
+        }
+
+        rs2::frame next()
+        {
+            auto number = _next++;
+            _sensor->on_video_frame({_pixels.data(), [](void*){}, WIDTH * 2, 2, static_cast<rs2_time_t>(number),
+                                     RS2_TIMESTAMP_DOMAIN_HARDWARE_CLOCK, number, _profile.get()});
+            return _queue.wait_for_frame();
+        }
+
+    private:
+        rs2::software_device _device;
+        std::unique_ptr<rs2::software_sensor> _sensor;
+        rs2::stream_profile _profile;
+        rs2::frame_queue _queue;
+        std::vector<uint16_t> _pixels;
+        int _next;
+    };
+
+    // Pushes frames first to last, stamped with their frame number
+    void pushFrames(FrameSource& source, FrameRingBuffer& ring, int count)
+    {
+        for (int i = 0; i < count; ++i)
+        {
+            auto frame = source.next();
+            ring.push(frame, frame.get_frame_number());
+        }
+    }
+
+    // Frame numbers left in the ring, checking every frame travels with its own stamp
+    std::vector<uint64_t> popAll(FrameRingBuffer& ring)
+    {
+        std::vector<uint64_t> numbers;
+        rs2::frame frame;
+        uint64_t stamp;
+        while (ring.pop(frame, stamp))
+        {
+            EXPECT_EQ(frame.get_frame_number(), stamp);
+            numbers.push_back(stamp);
+        }
+        return numbers;
+    }
+}
+
+TEST(FrameRingBufferTest, DropOldestKeepsTheNewestFrames)
+{
+    FrameSource source;
+    FrameRingBuffer ring(4, DROP_OLDEST);
+    pushFrames(source, ring, 10);
+    EXPECT_EQ(std::vector<uint64_t>({6, 7, 8, 9}), popAll(ring));
+    EXPECT_EQ(6u, ring.overwritten());
+
+    // Read frames are gone, new ones come through
+    pushFrames(source, ring, 1);
+    EXPECT_EQ(std::vector<uint64_t>({10}), popAll(ring));
+}
+
+TEST(FrameRingBufferTest, LatestOnlyKeepsTheLastFrame)
+{
+    FrameSource source;
+    FrameRingBuffer ring(4, LATEST_ONLY);
+    pushFrames(source, ring, 5);
+    EXPECT_EQ(std::vector<uint64_t>({4}), popAll(ring));
+    EXPECT_EQ(4u, ring.overwritten());
+}
+
+TEST(FrameRingBufferTest, BlockWithTimeoutOverwritesOnceTheWaitRunsOut)
+{
+    FrameSource source;
+    FrameRingBuffer ring(4, BLOCK_WITH_TIMEOUT, std::chrono::microseconds(2000));
+    auto start = std::chrono::steady_clock::now();
+    pushFrames(source, ring, 6);
+    auto waited = std::chrono::steady_clock::now() - start;
+
+    // Nobody reads, so the last two pushes wait out the timeout, then the newest frames win
+    EXPECT_GE(waited, std::chrono::microseconds(4000));
+    EXPECT_EQ(2u, ring.timedOut());
+    EXPECT_EQ(std::vector<uint64_t>({2, 3, 4, 5}), popAll(ring));
+    EXPECT_EQ(2u, ring.overwritten());
+}
+
+TEST(FrameRingBufferTest, BlockWithTimeoutWaitsForTheConsumer)
+{
+    FrameSource source;
+    FrameRingBuffer ring(2, BLOCK_WITH_TIMEOUT, std::chrono::seconds(5));
+    const int count = 200;
+    std::vector<uint64_t> popped;
+    std::thread consumer([&]
+    {
+        rs2::frame frame;
+        uint64_t stamp;
+        while (popped.size() < static_cast<size_t>(count))
+        {
+            if (ring.pop(frame, stamp))
+                popped.push_back(stamp);
+            else
+                std::this_thread::yield();
+        }
+    });
+    pushFrames(source, ring, count);
+    consumer.join();
+
+    // A consumer that keeps up loses nothing
+    ASSERT_EQ(static_cast<size_t>(count), popped.size());
+    for (int i = 0; i < count; ++i)
+        EXPECT_EQ(static_cast<uint64_t>(i), popped[i]);
+    EXPECT_EQ(0u, ring.overwritten());
+    EXPECT_EQ(0u, ring.timedOut());
+}
+
+TEST(FrameRingBufferTest, ConcurrentReadsNeverLoseTheNewestFrame)
+{
+    for (auto policy : {DROP_OLDEST, LATEST_ONLY})
+    {
+        FrameSource source;
+        FrameRingBuffer ring(3, policy);
+        const int count = 2000;
+        std::atomic<bool> done(false);
+        std::vector<uint64_t> popped;
+        std::thread consumer([&]
+        {
+            rs2::frame frame;
+            uint64_t stamp;
+            while (!done)
+            {
+                // Frames come out in order, each with its own stamp, even when a slot is rewritten mid-read
+                while (ring.pop(frame, stamp))
+                {
+                    EXPECT_EQ(frame.get_frame_number(), stamp);
+                    EXPECT_TRUE(popped.empty() || popped.back() < stamp);
+                    popped.push_back(stamp);
+                }
+            }
+        });
+        pushFrames(source, ring, count);
+        // What the consumer misses from here on is still in the ring
+        done = true;
+        consumer.join();
+        auto rest = popAll(ring);
+        popped.insert(popped.end(), rest.begin(), rest.end());
+
+        ASSERT_FALSE(popped.empty()) << "policy " << policy;
+        EXPECT_EQ(static_cast<uint64_t>(count - 1), popped.back()) << "policy " << policy;
+        EXPECT_EQ(static_cast<uint64_t>(count), popped.size() + ring.overwritten()) << "policy " << policy;
+    }
+}
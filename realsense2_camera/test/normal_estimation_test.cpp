@@ -0,0 +1,189 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2018 Intel Corporation. All Rights Reserved
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include <realsense2_camera/normal_estimation.h>
+
+using namespace realsense2_camera;
+
+namespace
+{
+    const int WIDTH = 40;
+    const int HEIGHT = 30;
+    const int POINT_STEP = 12;    // PointNormal: x, y, z, pad, normal, pad, curvature, pad
+    const int HALF_WINDOW = 2;
+    const float VIEWPOINT[3] = {0.f, 0.f, 0.f};
+
+    typedef std::vector<float> Cloud;
+
+    // Organized cloud of z(x, y) seen from the origin, pixels of about 5 mm
+    template<class Surface>
+    Cloud cloudOf(const Surface& surface)
+    {
+        Cloud cloud(WIDTH * HEIGHT * POINT_STEP, 0.f);
+        for (int v = 0; v < HEIGHT; ++v)
+        {
+            for (int u = 0; u < WIDTH; ++u)
+            {
+                auto p = &cloud[(v * WIDTH + u) * POINT_STEP];
+                p[0] = (u - WIDTH / 2) * 0.005f;
+                p[1] = (v - HEIGHT / 2) * 0.005f;
+                p[2] = surface(p[0], p[1]);
+            }
+        }
+        return cloud;
+    }
+
+    void estimate(Cloud& cloud)
+    {
+        NormalEstimation estimation;
+        estimation.resize(WIDTH, HEIGHT);
+        for (int y = 0; y < HEIGHT; ++y)
+            estimation.addRow(y, &cloud[y * WIDTH * POINT_STEP], POINT_STEP);
+        estimation.integrateColumns(0, WIDTH);
+        for (int y = 0; y < HEIGHT; ++y)
+            estimation.computeRow(y, HALF_WINDOW, VIEWPOINT, &cloud[y * WIDTH * POINT_STEP], POINT_STEP);
+    }
+
+    const float* point(const Cloud& cloud, int u, int v)
+    {
+        return &cloud[(v * WIDTH + u) * POINT_STEP];
+    }
+
+    // Covariance (xx, xy, xz, yy, yz, zz) of the valid points in the window around (u, v), clipped to the cloud
+    int windowCovariance(const Cloud& cloud, int u, int v, double* covariance)
+    {
+        double sum[3] = {0, 0, 0}, products[6] = {0, 0, 0, 0, 0, 0};
+        int count = 0;
+        for (int y = std::max(0, v - HALF_WINDOW); y <= std::min(HEIGHT - 1, v + HALF_WINDOW); ++y)
+        {
+            for (int x = std::max(0, u - HALF_WINDOW); x <= std::min(WIDTH - 1, u + HALF_WINDOW); ++x)
+            {
+                auto p = point(cloud, x, y);
+                if (0.f == p[0] && 0.f == p[1] && 0.f == p[2])
+                    continue;
+                double q[3] = {p[0], p[1], p[2]};
+                for (int i = 0; i < 3; ++i)
+                    sum[i] += q[i];
+                products[0] += q[0] * q[0];
+                products[1] += q[0] * q[1];
+                products[2] += q[0] * q[2];
+                products[3] += q[1] * q[1];
+                products[4] += q[1] * q[2];
+                products[5] += q[2] * q[2];
+                ++count;
+            }
+        }
+        double mean[3] = {sum[0] / count, sum[1] / count, sum[2] / count};
+        const int a[6] = {0, 0, 0, 1, 1, 2}, b[6] = {0, 1, 2, 1, 2, 2};
+        for (int i = 0; i < 6; ++i)
+            covariance[i] = products[i] / count - mean[a[i]] * mean[b[i]];
+        return count;
+    }
+}
+
+TEST(NormalEstimationTest, TiltedPlane)
+{
+    auto cloud = cloudOf([](float x, float y){ return 1.f + 0.2f * x - 0.1f * y; });
+    estimate(cloud);
+
+    // The plane's normal, pointing back at the camera
+    double n[3] = {0.2, -0.1, -1.0};
+    double norm = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+    for (int v = 0; v < HEIGHT; ++v)
+    {
+        for (int u = 0; u < WIDTH; ++u)
+        {
+            auto p = point(cloud, u, v);
+            for (int i = 0; i < 3; ++i)
+                EXPECT_NEAR(n[i] / norm, p[4 + i], 1e-4) << "point " << u << ", " << v;
+            EXPECT_NEAR(0.0, p[8], 1e-6) << "point " << u << ", " << v;
+        }
+    }
+}
+
+TEST(NormalEstimationTest, MatchesWindowCovariance)
+{
+    // A bumpy surface, so the smallest eigenvalue isn't zero and curvature varies
+    auto cloud = cloudOf([](float x, float y){ return 0.8f + 0.5f * x * x + 0.3f * std::sin(40.f * y); });
+    estimate(cloud);
+
+    for (int v = 0; v < HEIGHT; ++v)
+    {
+        for (int u = 0; u < WIDTH; ++u)
+        {
+            auto p = point(cloud, u, v);
+            double c[6];
+            windowCovariance(cloud, u, v, c);
+            double n[3] = {p[4], p[5], p[6]};
+            double cn[3] = {c[0] * n[0] + c[1] * n[1] + c[2] * n[2],
+                            c[1] * n[0] + c[3] * n[1] + c[4] * n[2],
+                            c[2] * n[0] + c[4] * n[1] + c[5] * n[2]};
+            double lambda = n[0] * cn[0] + n[1] * cn[1] + n[2] * cn[2];
+            double trace = c[0] + c[3] + c[5];
+
+            // An eigenvector, of the smallest eigenvalue (no Rayleigh quotient is below it), facing the viewpoint
+            EXPECT_NEAR(1.0, n[0] * n[0] + n[1] * n[1] + n[2] * n[2], 1e-5) << "point " << u << ", " << v;
+            for (int i = 0; i < 3; ++i)
+                EXPECT_NEAR(lambda * n[i], cn[i], 1e-4 * trace) << "point " << u << ", " << v;
+            EXPECT_LE(lambda, std::min(c[0], std::min(c[3], c[5])) * (1 + 1e-6)) << "point " << u << ", " << v;
+            EXPECT_NEAR(lambda / trace, p[8], 1e-4) << "point " << u << ", " << v;
+            double facing = n[0] * (VIEWPOINT[0] - p[0]) + n[1] * (VIEWPOINT[1] - p[1]) + n[2] * (VIEWPOINT[2] - p[2]);
+            EXPECT_GE(facing, 0.0) << "point " << u << ", " << v;
+        }
+    }
+}
+
+TEST(NormalEstimationTest, InvalidPointsGetNaN)
+{
+    auto cloud = cloudOf([](float x, float y){ return 1.f + 0.1f * x; });
+    // An invalid point, and a corner point whose window keeps only itself and its right neighbor
+    auto invalidate = [&cloud](int u, int v){ std::fill_n(&cloud[(v * WIDTH + u) * POINT_STEP], 3, 0.f); };
+    invalidate(10, 10);
+    for (int v = 0; v <= HALF_WINDOW; ++v)
+    {
+        for (int u = 0; u <= HALF_WINDOW; ++u)
+        {
+            if (!(0 == v && u < 2))
+                invalidate(u, v);
+        }
+    }
+    estimate(cloud);
+
+    for (auto uv : {std::make_pair(10, 10), std::make_pair(0, 0)})
+    {
+        auto p = point(cloud, uv.first, uv.second);
+        EXPECT_TRUE(std::isnan(p[4]) && std::isnan(p[5]) && std::isnan(p[6]) && std::isnan(p[8]))
+            << "point " << uv.first << ", " << uv.second;
+    }
+    // Neighbors of the invalid point leave it out of their windows
+    auto p = point(cloud, 11, 10);
+    EXPECT_FALSE(std::isnan(p[4]));
+    EXPECT_NEAR(0.0, p[8], 1e-6);
+}
+
+TEST(NormalEstimationTest, SplitWorkGivesTheSameResult)
+{
+    auto surface = [](float x, float y){ return 1.f + std::cos(30.f * x) * 0.05f + y * y; };
+    auto sequential = cloudOf(surface);
+    estimate(sequential);
+
+    // Rows in reverse order and columns integrated in uneven blocks, as workers may do it
+    auto split = cloudOf(surface);
+    NormalEstimation estimation;
+    estimation.resize(WIDTH, HEIGHT);
+    for (int y = HEIGHT - 1; y >= 0; --y)
+        estimation.addRow(y, &split[y * WIDTH * POINT_STEP], POINT_STEP);
+    estimation.integrateColumns(17, WIDTH);
+    estimation.integrateColumns(0, 17);
+    for (int y = HEIGHT - 1; y >= 0; --y)
+        estimation.computeRow(y, HALF_WINDOW, VIEWPOINT, &split[y * WIDTH * POINT_STEP], POINT_STEP);
+
+    for (size_t i = 0; i < split.size(); ++i)
+        EXPECT_EQ(sequential[i], split[i]) << "float " << i;
+}
@@ -0,0 +1,120 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2018 Intel Corporation. All Rights Reserved
+
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include <realsense2_camera/processing_governor.h>
+
+using namespace realsense2_camera;
+
+namespace
+{
+    const double FRAME_PERIOD = 1.0 / 30;
+    const double HIGH_LOAD = 0.9;
+    const double LOW_LOAD = 0.6;
+
+    const std::vector<governor_step> LADDER = {GOVERNOR_TEMPORAL_FILTER, GOVERNOR_SPATIAL_FILTER,
+                                               GOVERNOR_POINTCLOUD_STRIDE, GOVERNOR_ALIGN_EVERY_OTHER};
+
+    // Feeds frames that take load times the frame period, returns the level reached
+    int run(ProcessingGovernor& governor, double load, int frames)
+    {
+        for (int i = 0; i < frames; ++i)
+            governor.update(load * FRAME_PERIOD);
+        return governor.level();
+    }
+
+    class ProcessingGovernorTest : public ::testing::Test
+    {
+    protected:
+        void SetUp() override
+        {
+            governor.configure(LADDER, FRAME_PERIOD, HIGH_LOAD, LOW_LOAD);
+        }
+
+        ProcessingGovernor governor;
+    };
+}
+
+TEST_F(ProcessingGovernorTest, StaysAtFullQualityUnderTheHighThreshold)
+{
+    EXPECT_EQ(0, run(governor, 0.85, 1000));
+    for (auto step : LADDER)
+        EXPECT_FALSE(governor.isDegraded(step));
+}
+
+TEST_F(ProcessingGovernorTest, StepsDownTheLadderInOrder)
+{
+    int level = 0;
+    for (int frame = 0; frame < 1000 && level < static_cast<int>(LADDER.size()); ++frame)
+    {
+        governor.update(1.5 * FRAME_PERIOD);
+        if (governor.level() != level)
+        {
+            // One step at a time, only the steps taken so far are degraded
+            EXPECT_EQ(level + 1, governor.level());
+            level = governor.level();
+            for (size_t i = 0; i < LADDER.size(); ++i)
+                EXPECT_EQ(static_cast<int>(i) < level, governor.isDegraded(LADDER[i])) << "level " << level;
+        }
+    }
+    EXPECT_EQ(static_cast<int>(LADDER.size()), level);
+
+    // There is no step left to take
+    EXPECT_EQ(static_cast<int>(LADDER.size()), run(governor, 3.0, 200));
+}
+
+TEST_F(ProcessingGovernorTest, IgnoresASingleSlowFrame)
+{
+    run(governor, 0.5, 100);
+    governor.update(5.0 * FRAME_PERIOD);
+    EXPECT_EQ(0, run(governor, 0.5, 100));
+}
+
+TEST_F(ProcessingGovernorTest, RecoversBelowTheLowThreshold)
+{
+    run(governor, 2.0, 500);
+    ASSERT_EQ(static_cast<int>(LADDER.size()), governor.level());
+
+    // Between the thresholds it holds the level it reached
+    EXPECT_EQ(static_cast<int>(LADDER.size()), run(governor, 0.75, 500));
+
+    // Below the low threshold it gives steps back one by one, the last one taken first
+    int level = governor.level();
+    for (int frame = 0; frame < 2000 && level > 0; ++frame)
+    {
+        governor.update(0.3 * FRAME_PERIOD);
+        if (governor.level() != level)
+        {
+            EXPECT_EQ(level - 1, governor.level());
+            level = governor.level();
+            EXPECT_FALSE(governor.isDegraded(LADDER[level]));
+            if (level > 0)
+            {
+                EXPECT_TRUE(governor.isDegraded(LADDER[level - 1]));
+            }
+        }
+    }
+    EXPECT_EQ(0, level);
+}
+
+TEST_F(ProcessingGovernorTest, SettlesWhereTheLoadFits)
+{
+    // Every step saves a quarter of the frame period: from 1.3 the load lands between
+    // the thresholds after two steps
+    for (int frame = 0; frame < 2000; ++frame)
+        governor.update((1.3 - 0.25 * governor.level()) * FRAME_PERIOD);
+    EXPECT_EQ(2, governor.level());
+}
+
+TEST(ProcessingGovernorStepTest, ParsesStepNames)
+{
+    for (int step = 0; step < GOVERNOR_STEP_COUNT; ++step)
+    {
+        auto name = ProcessingGovernor::stepName(static_cast<governor_step>(step));
+        EXPECT_EQ(step, ProcessingGovernor::parseStep(name)) << name;
+    }
+    EXPECT_EQ(GOVERNOR_STEP_COUNT, ProcessingGovernor::parseStep("unknown_step"));
+}
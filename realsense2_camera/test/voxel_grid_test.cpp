@@ -0,0 +1,188 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2018 Intel Corporation. All Rights Reserved
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <random>
+#include <tuple>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include <realsense2_camera/voxel_grid.h>
+
+using namespace realsense2_camera;
+
+namespace
+{
+    const float LEAF = 0.05f;
+    const size_t POINT_STEP = 16;   // x, y, z, rgb
+    const int RGB_OFFSET = 12;
+
+    struct Point
+    {
+        float xyz[3];
+        uint32_t rgb;
+    };
+
+    // Spread over negative and positive coordinates, a few dozen points per voxel, and enough
+    // voxels to grow the hash table
+    std::vector<Point> randomPoints(size_t count, unsigned seed)
+    {
+        std::mt19937 rng(seed);
+        std::uniform_real_distribution<float> coordinate(-0.3f, 0.3f);
+        std::uniform_int_distribution<uint32_t> channel(0, 255);
+        std::vector<Point> points(count);
+        for (auto& p : points)
+        {
+            for (auto& c : p.xyz)
+                c = coordinate(rng);
+            p.rgb = (channel(rng) << 16) | (channel(rng) << 8) | channel(rng);
+        }
+        return points;
+    }
+
+    // Voxels by integer coordinates, in the order they were first hit
+    struct Reference
+    {
+        struct Sums
+        {
+            double x, y, z;
+            uint32_t r, g, b, count;
+            size_t order;
+        };
+        std::map<std::tuple<int, int, int>, Sums> voxels;
+
+        void add(const Point& p)
+        {
+            auto key = std::make_tuple(static_cast<int>(std::floor(p.xyz[0] / LEAF)),
+                                       static_cast<int>(std::floor(p.xyz[1] / LEAF)),
+                                       static_cast<int>(std::floor(p.xyz[2] / LEAF)));
+            auto it = voxels.find(key);
+            if (it == voxels.end())
+                it = voxels.insert({key, Sums{0, 0, 0, 0, 0, 0, 0, voxels.size()}}).first;
+            auto& v = it->second;
+            v.x += p.xyz[0];
+            v.y += p.xyz[1];
+            v.z += p.xyz[2];
+            v.r += (p.rgb >> 16) & 0xff;
+            v.g += (p.rgb >> 8) & 0xff;
+            v.b += p.rgb & 0xff;
+            ++v.count;
+        }
+
+        std::vector<const Sums*> inOrder() const
+        {
+            std::vector<const Sums*> ordered(voxels.size());
+            for (const auto& v : voxels)
+                ordered[v.second.order] = &v.second;
+            return ordered;
+        }
+    };
+
+    void expectSameAsReference(const VoxelGrid& grid, const Reference& reference)
+    {
+        ASSERT_EQ(reference.voxels.size(), grid.size());
+        std::vector<uint8_t> out(grid.size() * POINT_STEP);
+        grid.write(out.data(), POINT_STEP, RGB_OFFSET);
+
+        auto expected = reference.inOrder();
+        for (size_t i = 0; i < expected.size(); ++i)
+        {
+            const auto& v = *expected[i];
+            float xyz[3];
+            uint32_t rgb;
+            std::memcpy(xyz, out.data() + i * POINT_STEP, sizeof(xyz));
+            std::memcpy(&rgb, out.data() + i * POINT_STEP + RGB_OFFSET, sizeof(rgb));
+
+            // Sums are float in the grid
+            EXPECT_NEAR(v.x / v.count, xyz[0], 1e-5) << "voxel " << i;
+            EXPECT_NEAR(v.y / v.count, xyz[1], 1e-5) << "voxel " << i;
+            EXPECT_NEAR(v.z / v.count, xyz[2], 1e-5) << "voxel " << i;
+            auto half = v.count / 2;
+            uint32_t expected_rgb = (((v.r + half) / v.count) << 16) | (((v.g + half) / v.count) << 8) |
+                                    ((v.b + half) / v.count);
+            EXPECT_EQ(expected_rgb, rgb) << "voxel " << i;
+        }
+    }
+}
+
+TEST(VoxelGridTest, CentroidsAndColors)
+{
+    auto points = randomPoints(50000, 1);
+    VoxelGrid grid;
+    Reference reference;
+    grid.reset(LEAF);
+    for (const auto& p : points)
+    {
+        grid.add(p.xyz, p.rgb);
+        reference.add(p);
+    }
+    expectSameAsReference(grid, reference);
+}
+
+TEST(VoxelGridTest, SinglePointPerVoxelIsKept)
+{
+    VoxelGrid grid;
+    grid.reset(LEAF);
+    const float a[3] = {0.01f, 0.01f, 0.01f};
+    const float b[3] = {-0.01f, 0.01f, 0.01f};    // Neighboring voxel across zero
+    grid.add(a, 0x102030);
+    grid.add(b, 0x405060);
+    ASSERT_EQ(2u, grid.size());
+
+    std::vector<uint8_t> out(2 * POINT_STEP);
+    grid.write(out.data(), POINT_STEP, RGB_OFFSET);
+    float xyz[3];
+    uint32_t rgb;
+    std::memcpy(xyz, out.data() + POINT_STEP, sizeof(xyz));
+    std::memcpy(&rgb, out.data() + POINT_STEP + RGB_OFFSET, sizeof(rgb));
+    EXPECT_FLOAT_EQ(b[0], xyz[0]);
+    EXPECT_FLOAT_EQ(b[1], xyz[1]);
+    EXPECT_FLOAT_EQ(b[2], xyz[2]);
+    EXPECT_EQ(0x405060u, rgb);
+}
+
+TEST(VoxelGridTest, MergeMatchesAddingInOrder)
+{
+    auto first = randomPoints(20000, 2);
+    auto second = randomPoints(20000, 3);
+    VoxelGrid a, b, merged;
+    Reference reference;
+    a.reset(LEAF);
+    b.reset(LEAF);
+    for (const auto& p : first)
+    {
+        a.add(p.xyz, p.rgb);
+        reference.add(p);
+    }
+    for (const auto& p : second)
+    {
+        b.add(p.xyz, p.rgb);
+        reference.add(p);
+    }
+    merged.reset(LEAF);
+    merged.merge(a);
+    merged.merge(b);
+    expectSameAsReference(merged, reference);
+}
+
+TEST(VoxelGridTest, ResetStartsOver)
+{
+    auto points = randomPoints(5000, 4);
+    VoxelGrid grid;
+    grid.reset(LEAF);
+    for (const auto& p : points)
+        grid.add(p.xyz, p.rgb);
+
+    Reference reference;
+    grid.reset(LEAF);
+    for (size_t i = 0; i < 100; ++i)
+    {
+        grid.add(points[i].xyz, points[i].rgb);
+        reference.add(points[i]);
+    }
+    expectSameAsReference(grid, reference);
+}